@@ -15,6 +15,9 @@
 #include "TypeDefines.h"
 #include <stdio.h>
 #include <stdlib.h>
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+#include <poll.h>
+#endif
 #include <time.h>
 #include <unistd.h>
 
@@ -51,12 +54,39 @@ void function2(void *arg) { print_time_msg(2); }
 
 void function3(void *arg) { print_time_msg(3); }
 
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+/*
+  @ run_event_loop().
+  - Event loop mode has no timer task, poll stdin and the timer fd together and
+  run the expired timers on this thread until 'q' is typed.
+*/
+void run_event_loop(void) {
+  struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0},
+                          {RTOSTmrFdGet(), POLLIN, 0}};
+  INT8 ch = 0;
+
+  fprintf(stdout, "\n\nType 'q' and hit enter to end the program\n");
+  while (ch != 'q') {
+    if (poll(fds, 2, -1) < 0) {
+      continue;
+    }
+    if (fds[1].revents & POLLIN) {
+      RTOSTmrProcess();
+    }
+    if ((fds[0].revents & (POLLIN | POLLHUP)) &&
+        read(STDIN_FILENO, &ch, 1) != 1) {
+      break;
+    }
+  }
+}
+#endif
+
 int main(void) {
   INT8U err_val = RTOS_ERR_NONE;
 
-  RTOS_TMR *timer_obj1 = NULL;
-  RTOS_TMR *timer_obj2 = NULL;
-  RTOS_TMR *timer_obj3 = NULL;
+  RTOS_TMR_HANDLE timer_obj1 = RTOS_TMR_NO_HANDLE;
+  RTOS_TMR_HANDLE timer_obj2 = RTOS_TMR_NO_HANDLE;
+  RTOS_TMR_HANDLE timer_obj3 = RTOS_TMR_NO_HANDLE;
 
   INT8 *timer_name[3] = {"Timer1", "Timer2", "Timer3"};
 
@@ -69,7 +99,7 @@ int main(void) {
   fprintf(stdout, "OS Tick Initialization completed successfully");
 
   // Initialize the RTOS timer.
-  RTOSTmrInit();
+  RTOSTmrInit(1, RTOS_TMR_STORE_WHEEL);
 
   fprintf(stdout, "\nApplication Started....... :-)\n");
 
@@ -82,7 +112,7 @@ int main(void) {
                              timer_name[0], &err_val);
   // Check the return value and determine if it created successfully or not.
   if (err_val != RTOS_ERR_NONE) {
-    fprintf(stdout, "\n Create Timer1 failed, Error: %d timer_obj1 = %p\n",
+    fprintf(stdout, "\n Create Timer1 failed, Error: %d timer_obj1 = %#x\n",
             err_val, timer_obj1);
     return 0;
   }
@@ -93,7 +123,7 @@ int main(void) {
                              timer_name[1], &err_val);
   // Check the return value and determine if it created successfully or not.
   if (err_val != RTOS_ERR_NONE) {
-    fprintf(stdout, "\n Create Timer2 failed, Error: %d timer_obj2 = %p\n",
+    fprintf(stdout, "\n Create Timer2 failed, Error: %d timer_obj2 = %#x\n",
             err_val, timer_obj2);
     return 0;
   }
@@ -104,7 +134,7 @@ int main(void) {
                              timer_name[2], &err_val);
   // Check the return value and determine if it created successfully or not.
   if (err_val != RTOS_ERR_NONE) {
-    fprintf(stdout, "\n Create Timer3 failed, Error: %d timer_obj3 = %p\n",
+    fprintf(stdout, "\n Create Timer3 failed, Error: %d timer_obj3 = %#x\n",
             err_val, timer_obj3);
     return 0;
   }
@@ -142,24 +172,28 @@ int main(void) {
     }
   }
 
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  run_event_loop();
+#else
   fprintf(stdout, "\n\nType 'q' and hit enter to end the program = %c\n",
           getchar());
   while (getchar() != 'q')
+#endif
 
     // Delete Timers
     if (timer_obj1 && (RTOSTmrDel(timer_obj1, &err_val) == RTOS_FALSE ||
                        err_val == RTOS_ERR_TMR_INVALID)) {
-      fprintf(stdout, "\n Delete Timer1 failed, Error: %d timer_obj1 = %p\n",
+      fprintf(stdout, "\n Delete Timer1 failed, Error: %d timer_obj1 = %#x\n",
               err_val, timer_obj1);
     }
   if (timer_obj2 && (RTOSTmrDel(timer_obj2, &err_val) == RTOS_FALSE ||
                      err_val == RTOS_ERR_TMR_INVALID)) {
-    fprintf(stdout, "\n Delete Timer2 failed, Error: %d timer_obj2 = %p\n",
+    fprintf(stdout, "\n Delete Timer2 failed, Error: %d timer_obj2 = %#x\n",
             err_val, timer_obj2);
   }
   if (timer_obj3 && (RTOSTmrDel(timer_obj3, &err_val) == RTOS_FALSE ||
                      err_val == RTOS_ERR_TMR_INVALID)) {
-    fprintf(stdout, "\n Delete Timer3 failed, Error: %d timer_obj3 = %p\n",
+    fprintf(stdout, "\n Delete Timer3 failed, Error: %d timer_obj3 = %#x\n",
             err_val, timer_obj3);
   }
 
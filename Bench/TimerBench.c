@@ -0,0 +1,1046 @@
+/*
+  - Benchmark suite of the Timer Manager, non-interactive.
+  - ops: create, start, stop and delete throughput for a sweep of timer counts
+  from 10 up to the maximum, through the batch APIs, which print nothing.
+  - expire: for the same sweep and a one shot, periodic and mixed population,
+  deadlines spread over as many ticks as there are timers; the ticks are
+  processed by hand and timed one by one, giving the expiry throughput, the
+  expiries per tick and the tick processing latency percentiles.
+  - cancel: start+stop pairs of one timer at a time (the "arm a timeout, then
+  cancel it" pattern) against a population of the same sweep of sizes, with
+  one tick processed per round over the population, so the cost of dropping
+  tombstones is included, then for 1 to 64 threads with BENCH_BURST timers
+  each. Build with RTOS_CFG_TMR_LAZY_CANCEL_EN=1 to compare the lazy
+  cancellation against the default.
+  - restart: push back the deadline of one running timer at a time out of a
+  population of the same sweep of sizes (the idle timeout pattern), one tick
+  per round over the population, by stop+start, RTOSTmrRestart() and
+  RTOSTmrRestartLazy().
+  - advance: a simulated day of BENCH_ADVANCE_TICKS ticks over a mixed
+  population of the same sweep of sizes, run with RTOSTmrAdvance(), giving the
+  expiry throughput of virtual time including the skipped empty ticks.
+  - scan: full passes of the timer store over a running mixed population of
+  the same sweep of sizes, the tombstone compaction pass with no tombstone to
+  drop, giving the cost of visiting one timer.
+  - payload: one shot timeouts carrying a BENCH_CONTEXT, created and started
+  BENCH_BURST at a time and expired by the next tick, with the context
+  malloc'ed per timer and freed by the callback, or copied into the timer by
+  RTOSTmrCreatePayload().
+  - prio: how long after the start of a tick one timer is dispatched when it
+  expires together with up to BENCH_PRIO_MAX_TIMERS others, at a random place
+  among them, as RTOS_TMR_PRIO_NORMAL like the others and as
+  RTOS_TMR_PRIO_CRITICAL.
+  - defer: virtual time under a tick budget of BENCH_DEFER_BUDGET_NS, the
+  same sweep of sizes up to BENCH_PRIO_MAX_TIMERS of normal one shot timers
+  with callbacks of BENCH_DEFER_CALLBACK_NS due on the same tick as a critical
+  one, run with one RTOSTmrAdvance() call. Every expiry the budget held back
+  must still run; per_tick is the expiries per tick it took.
+  - spread: the same sweep of sizes of periodic timers started together with
+  delay 0 and a period of BENCH_SPREAD_PERIOD ticks, once per phase spreading
+  mode (RTOSTmrSpreadSet()), over one period: the tick processing latency
+  percentiles, and in per_tick the most expiries of one tick.
+  - threads: create/start/stop/delete throughput of 1 to 64 threads in bursts
+  of BENCH_BURST timers, all sharing the pool and the shards.
+  - persist: with RTOS_CFG_TMR_PERSIST_EN=1, the time a restarted process
+  takes to have the same sweep of sizes of long running timers back, by
+  creating and starting them anew, or by restoring them from the pool file of
+  the last run (RTOSTmrPersistOpen()). Every run is a process of its own, the
+  first to use the pool.
+  - The whole suite runs once per timer store (RTOS_TMR_STORE_*), or only on
+  the one picked with -b, on freshly made shards each time.
+  - Every result is one record, written as CSV (default, to stdout) and/or as
+  JSON, so runs can be compared over releases. Progress goes to stderr.
+
+  Usage: TimerBench [-n max_timers] [-t max_threads] [-s shards]
+                    [-b wheel|heap] [-c csv_file] [-j json_file]
+*/
+
+// Include header files.
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BURST 128
+#define BENCH_THREAD_OPS 1000000
+#define BENCH_CANCEL_OPS 1000000
+#define BENCH_RESTART_OPS 1000000
+#define BENCH_ADVANCE_TICKS 864000 /* a day of 100 ms ticks */
+#define BENCH_SCAN_VISITS 10000000
+#define BENCH_PAYLOAD_OPS 1000000
+#define BENCH_PRIO_ROUNDS 1000
+#define BENCH_PRIO_MAX_TIMERS 10000
+#define BENCH_SPREAD_PERIOD 600 /* a minute of 100 ms ticks */
+#define BENCH_DEFER_BUDGET_NS 100000
+#define BENCH_DEFER_CALLBACK_NS 10000
+
+// Timer population of the expire benchmark.
+#define BENCH_MIX_ONE_SHOT 0
+#define BENCH_MIX_PERIODIC 1
+#define BENCH_MIX_MIXED 2
+
+// One result record.
+typedef struct bench_record {
+  const char *store;
+  const char *bench;
+  const char *mix;
+  INT32U timers;
+  INT32U threads;
+  INT64U ops;
+  double ns_per_op;
+  double mops;
+  double p50_ns;
+  double p90_ns;
+  double p99_ns;
+  double p999_ns;
+  double max_ns;
+  double per_tick;
+  INT32U bytes_per_timer;
+} BENCH_RECORD;
+
+extern TMR_SHARD *TmrShard;
+
+static const char *mix_name[] = {"one_shot", "periodic", "mixed"};
+
+// Ways to push back a deadline in the restart benchmark.
+#define BENCH_RESTART_STOP_START 0
+#define BENCH_RESTART_EAGER 1
+#define BENCH_RESTART_LAZY 2
+
+static const char *restart_name[] = {"stop_start", "restart", "lazy"};
+
+// Where the payload benchmark keeps the context of a timeout.
+#define BENCH_PAYLOAD_MALLOC 0
+#define BENCH_PAYLOAD_INLINE 1
+
+static const char *payload_name[] = {"malloc", "inline"};
+
+// How the persist benchmark gets the timers of the last run back.
+#define BENCH_PERSIST_RECREATE 0
+#define BENCH_PERSIST_WRITE 1
+#define BENCH_PERSIST_RESTORE 2
+#define BENCH_PERSIST_FILE "/tmp/TimerBench.pool"
+
+#if RTOS_CFG_TMR_PERSIST_EN
+static const char *persist_name[] = {"recreate", "write", "restore"};
+#endif
+
+// Class of the watched timer in the prio benchmark.
+#define BENCH_PRIO_NORMAL 0
+#define BENCH_PRIO_CRITICAL 1
+
+static const char *prio_name[] = {"normal", "critical"};
+
+// Phase spreading modes of the spread benchmark, by RTOS_TMR_SPREAD_*.
+static const char *spread_name[] = {"off", "hash", "random"};
+
+// Context of a timeout, as a request would keep for its callback.
+typedef struct bench_context {
+  INT64U request;
+  INT64U deadline_ns;
+  void *owner;
+  INT32U attempt;
+  INT32U flags;
+} BENCH_CONTEXT;
+
+// Timer stores the suite runs on.
+static const INT8U bench_store[] = {RTOS_TMR_STORE_WHEEL, RTOS_TMR_STORE_HEAP};
+static const char *store_name[] = {"wheel", "heap"};
+
+static FILE *csv_file = NULL;
+static FILE *json_file = NULL;
+static INT32U json_count = 0;
+
+static INT32U expired_count;
+static INT64U context_sum;
+static double prio_tick_start;
+static double prio_dispatch_ns;
+static INT32U defer_last_tick;
+
+static INT32U rand_state = 2463534242U;
+
+/*
+  @ bench_rand().
+  xorshift32, keeps the runs reproducible.
+*/
+static INT32U bench_rand(void) {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_expired(void *arg) { expired_count++; }
+
+static void bench_prio_expired(void *arg) {
+  prio_dispatch_ns = now_ns() - prio_tick_start;
+}
+
+static void bench_defer_expired(void *arg) {
+  double t0 = now_ns();
+  while (now_ns() - t0 < BENCH_DEFER_CALLBACK_NS) {
+  }
+  defer_last_tick = TmrShard[0].tick;
+  expired_count++;
+}
+
+static void bench_context_expired(void *arg) {
+  context_sum += ((BENCH_CONTEXT *)arg)->request;
+  expired_count++;
+}
+
+static void bench_context_freed(void *arg) {
+  context_sum += ((BENCH_CONTEXT *)arg)->request;
+  expired_count++;
+  free(arg);
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+  @ percentile().
+  Value at fraction q of a sorted sample.
+*/
+static double percentile(const double *sorted, INT32U n, double q) {
+  if (n == 0) {
+    return 0;
+  }
+  INT32U index = (INT32U)(q * (n - 1) + 0.5);
+  return sorted[index];
+}
+
+/*
+  @ emit_record().
+  Write a record to the CSV and JSON outputs, and a summary to stderr.
+*/
+static void emit_record(const BENCH_RECORD *r) {
+  if (csv_file != NULL) {
+    fprintf(csv_file,
+            "%s,%s,%s,%u,%u,%llu,%.1f,%.3f,%.0f,%.0f,%.0f,%.0f,%.0f,%.2f,%u\n",
+            r->store, r->bench, r->mix, r->timers, r->threads, r->ops, r->ns_per_op,
+            r->mops, r->p50_ns, r->p90_ns, r->p99_ns, r->p999_ns, r->max_ns,
+            r->per_tick, r->bytes_per_timer);
+  }
+  if (json_file != NULL) {
+    fprintf(json_file,
+            "%s\n  {\"store\": \"%s\", \"bench\": \"%s\", \"mix\": \"%s\", "
+            "\"timers\": %u, \"threads\": %u, \"ops\": %llu, "
+            "\"ns_per_op\": %.1f, \"mops\": %.3f, \"p50_ns\": %.0f, "
+            "\"p90_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, "
+            "\"max_ns\": %.0f, \"per_tick\": %.2f, \"bytes_per_timer\": %u}",
+            json_count++ ? "," : "", r->store, r->bench, r->mix, r->timers, r->threads,
+            r->ops, r->ns_per_op, r->mops, r->p50_ns, r->p90_ns, r->p99_ns,
+            r->p999_ns, r->max_ns, r->per_tick, r->bytes_per_timer);
+  }
+  fprintf(stderr,
+          "%-5s %-8s %-10s %8u timers %3u threads %10.1f ns/op %9.3f Mops",
+          r->store, r->bench, r->mix, r->timers, r->threads, r->ns_per_op, r->mops);
+  if (r->max_ns > 0) {
+    fprintf(stderr, "  tick p50 %.0f p99 %.0f max %.0f ns", r->p50_ns,
+            r->p99_ns, r->max_ns);
+  }
+  fprintf(stderr, "\n");
+}
+
+/*
+  @ emit_rate().
+  Record of a plain throughput measurement.
+*/
+static void emit_rate(const char *bench, const char *mix, INT32U timers,
+                      INT32U threads, INT64U ops, double ns) {
+  BENCH_RECORD r;
+  RTOS_TMR_POOL_INFO pool_info;
+
+  memset(&r, 0, sizeof(r));
+  RTOSTmrPoolInfoGet(&pool_info);
+  r.store = TmrShard[0].store->name;
+  r.bench = bench;
+  r.mix = mix;
+  r.timers = timers;
+  r.threads = threads;
+  r.ops = ops;
+  r.ns_per_op = ops ? ns / ops : 0;
+  r.mops = ns > 0 ? ops / ns * 1e3 : 0;
+  r.bytes_per_timer = pool_info.bytes_per_timer;
+  emit_record(&r);
+}
+
+/*
+  @ fill_specs().
+  Arguments of timer_count timers of the given mix, deadlines spread over
+  span ticks. A periodic timer fires once every span ticks.
+*/
+static void fill_specs(RTOS_TMR_SPEC *specs, INT32U timer_count, INT32U span,
+                       INT32U mix) {
+  for (INT32U i = 0; i < timer_count; i++) {
+    INT8U periodic = mix == BENCH_MIX_PERIODIC ||
+                     (mix == BENCH_MIX_MIXED && (bench_rand() & 1));
+    specs[i].delay = 1 + bench_rand() % span;
+    specs[i].period = periodic ? span : 0;
+    specs[i].option = periodic ? RTOS_TMR_PERIODIC : RTOS_TMR_ONE_SHOT;
+    specs[i].callback = bench_expired;
+    specs[i].callback_arg = NULL;
+    specs[i].name = "bench";
+    specs[i].payload_size = 0;
+  }
+}
+
+/*
+  @ bench_ops().
+  Create, start, stop and delete timer_count timers with the batch APIs.
+*/
+static void bench_ops(INT32U timer_count, RTOS_TMR_SPEC *specs,
+                      RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  double t0, t1, t2, t3, t4;
+
+  fill_specs(specs, timer_count, timer_count, BENCH_MIX_MIXED);
+  t0 = now_ns();
+  RTOSTmrCreateBatch(specs, timer_count, timers, errs);
+  t1 = now_ns();
+  RTOSTmrStartBatch(timers, timer_count, errs);
+  t2 = now_ns();
+  RTOSTmrStopBatch(timers, timer_count, errs);
+  t3 = now_ns();
+  emit_rate("create", "mixed", timer_count, 1, timer_count, t1 - t0);
+  emit_rate("start", "mixed", timer_count, 1, timer_count, t2 - t1);
+  emit_rate("stop", "mixed", timer_count, 1, timer_count, t3 - t2);
+  t3 = now_ns();
+  RTOSTmrDelBatch(timers, timer_count, errs);
+  t4 = now_ns();
+  emit_rate("delete", "mixed", timer_count, 1, timer_count, t4 - t3);
+}
+
+/*
+  @ bench_expire().
+  Let timer_count timers of the given mix expire once each, processing and
+  timing the ticks of shard 0 by hand.
+*/
+static void bench_expire(INT32U timer_count, INT32U mix, RTOS_TMR_SPEC *specs,
+                         RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  TMR_SHARD *shard = &TmrShard[0];
+  INT32U span = timer_count;
+  INT32U ticks = span + 1;
+  double *tick_ns = malloc(ticks * sizeof(double));
+  double total = 0;
+  BENCH_RECORD r;
+
+  if (tick_ns == NULL) {
+    fprintf(stderr, "\nOut of memory for %u ticks\n", ticks);
+    return;
+  }
+  // Every timer is created and started on shard 0.
+  fill_specs(specs, timer_count, span, mix);
+  RTOSTmrCreateBatch(specs, timer_count, timers, errs);
+  RTOSTmrStartBatch(timers, timer_count, errs);
+
+  expired_count = 0;
+  for (INT32U i = 0; i < ticks; i++) {
+    double t0 = now_ns();
+    process_timer_tick(shard);
+    tick_ns[i] = now_ns() - t0;
+    total += tick_ns[i];
+  }
+  qsort(tick_ns, ticks, sizeof(double), compare_double);
+
+  memset(&r, 0, sizeof(r));
+  r.store = shard->store->name;
+  r.bench = "expire";
+  r.mix = mix_name[mix];
+  r.timers = timer_count;
+  r.threads = 1;
+  r.ops = expired_count;
+  r.ns_per_op = expired_count ? total / expired_count : 0;
+  r.mops = expired_count / total * 1e3;
+  r.p50_ns = percentile(tick_ns, ticks, 0.50);
+  r.p90_ns = percentile(tick_ns, ticks, 0.90);
+  r.p99_ns = percentile(tick_ns, ticks, 0.99);
+  r.p999_ns = percentile(tick_ns, ticks, 0.999);
+  r.max_ns = tick_ns[ticks - 1];
+  r.per_tick = (double)expired_count / ticks;
+  r.bytes_per_timer = 0;
+  emit_record(&r);
+
+  // The one shot timers freed themselves, delete the periodic ones.
+  INT32U left = 0;
+  for (INT32U i = 0; i < timer_count; i++) {
+    if (timers[i] != RTOS_TMR_NO_HANDLE &&
+        specs[i].option == RTOS_TMR_PERIODIC) {
+      timers[left++] = timers[i];
+    }
+  }
+  RTOSTmrDelBatch(timers, left, errs);
+  free(tick_ns);
+}
+
+/*
+  @ bench_cancel().
+  Start and stop timer_count timers one at a time, round robin, for
+  BENCH_CANCEL_OPS pairs, processing one tick of shard 0 per round.
+*/
+static void bench_cancel(INT32U timer_count, RTOS_TMR_SPEC *specs,
+                         RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  TMR_SHARD *shard = &TmrShard[0];
+  INT32U ops = BENCH_CANCEL_OPS < timer_count ? timer_count : BENCH_CANCEL_OPS;
+
+  fill_specs(specs, timer_count, timer_count, BENCH_MIX_ONE_SHOT);
+  RTOSTmrCreateBatch(specs, timer_count, timers, errs);
+  double t0 = now_ns();
+  for (INT32U i = 0, next = 0; i < ops; i++) {
+    RTOSTmrStartBatch(&timers[next], 1, errs);
+    RTOSTmrStopBatch(&timers[next], 1, errs);
+    if (++next == timer_count) {
+      next = 0;
+      process_timer_tick(shard);
+    }
+  }
+  emit_rate("cancel", "one_shot", timer_count, 1, ops, now_ns() - t0);
+  RTOSTmrDelBatch(timers, timer_count, errs);
+}
+
+/*
+  @ bench_restart().
+  Push back the deadline of timer_count running timers one at a time, round
+  robin, for BENCH_RESTART_OPS restarts, processing one tick of shard 0 per
+  round. The deadline is always timer_count ticks ahead, so none expires.
+*/
+static void bench_restart(INT32U timer_count, INT32U how, RTOS_TMR_SPEC *specs,
+                          RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  TMR_SHARD *shard = &TmrShard[0];
+  INT32U ops =
+      BENCH_RESTART_OPS < timer_count ? timer_count : BENCH_RESTART_OPS;
+  INT8U err;
+
+  fill_specs(specs, timer_count, timer_count, BENCH_MIX_ONE_SHOT);
+  for (INT32U i = 0; i < timer_count; i++) {
+    specs[i].delay = timer_count;
+  }
+  RTOSTmrCreateBatch(specs, timer_count, timers, errs);
+  RTOSTmrStartBatch(timers, timer_count, errs);
+  expired_count = 0;
+  double t0 = now_ns();
+  for (INT32U i = 0, next = 0; i < ops; i++) {
+    if (how == BENCH_RESTART_STOP_START) {
+      RTOSTmrStopBatch(&timers[next], 1, errs);
+      RTOSTmrStartBatch(&timers[next], 1, errs);
+    } else if (how == BENCH_RESTART_EAGER) {
+      RTOSTmrRestart(timers[next], timer_count, &err);
+    } else {
+      RTOSTmrRestartLazy(timers[next], timer_count, &err);
+    }
+    if (++next == timer_count) {
+      next = 0;
+      process_timer_tick(shard);
+    }
+  }
+  emit_rate("restart", restart_name[how], timer_count, 1, ops, now_ns() - t0);
+  if (expired_count != 0) {
+    fprintf(stderr, "\n%u timers expired while restarted\n", expired_count);
+  }
+  RTOSTmrDelBatch(timers, timer_count, errs);
+}
+
+/*
+  @ bench_advance().
+  Run BENCH_ADVANCE_TICKS ticks of virtual time over timer_count timers of the
+  mixed population in one RTOSTmrAdvance() call.
+*/
+static void bench_advance(INT32U timer_count, RTOS_TMR_SPEC *specs,
+                          RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  INT8U err;
+
+  fill_specs(specs, timer_count, timer_count, BENCH_MIX_MIXED);
+  RTOSTmrCreateBatch(specs, timer_count, timers, errs);
+  RTOSTmrStartBatch(timers, timer_count, errs);
+  expired_count = 0;
+  double t0 = now_ns();
+  RTOSTmrAdvance(BENCH_ADVANCE_TICKS, &err);
+  double t1 = now_ns();
+  emit_rate("advance", "mixed", timer_count, 1, expired_count, t1 - t0);
+
+  // The one shot timers freed themselves, delete the periodic ones.
+  INT32U left = 0;
+  for (INT32U i = 0; i < timer_count; i++) {
+    if (timers[i] != RTOS_TMR_NO_HANDLE &&
+        specs[i].option == RTOS_TMR_PERIODIC) {
+      timers[left++] = timers[i];
+    }
+  }
+  RTOSTmrDelBatch(timers, left, errs);
+}
+
+/*
+  @ bench_scan().
+  Pass over all timer_count running timers of shard 0 with the compaction of
+  its store until BENCH_SCAN_VISITS timers were visited.
+*/
+static void bench_scan(INT32U timer_count, RTOS_TMR_SPEC *specs,
+                       RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  TMR_SHARD *shard = &TmrShard[0];
+  INT32U rounds = (BENCH_SCAN_VISITS + timer_count - 1) / timer_count;
+
+  fill_specs(specs, timer_count, timer_count, BENCH_MIX_MIXED);
+  RTOSTmrCreateBatch(specs, timer_count, timers, errs);
+  RTOSTmrStartBatch(timers, timer_count, errs);
+  double t0 = now_ns();
+  for (INT32U i = 0; i < rounds; i++) {
+    pthread_mutex_lock(&shard->mutex);
+    shard->store->compact(shard);
+    pthread_mutex_unlock(&shard->mutex);
+  }
+  emit_rate("scan", "mixed", timer_count, 1, (INT64U)rounds * timer_count,
+            now_ns() - t0);
+  RTOSTmrDelBatch(timers, timer_count, errs);
+}
+
+/*
+  @ bench_payload().
+  BENCH_PAYLOAD_OPS one shot timeouts with a context kept as how says, each
+  created, started and expired on shard 0.
+*/
+static void bench_payload(INT32U how) {
+  TMR_SHARD *shard = &TmrShard[0];
+  BENCH_CONTEXT context = {.owner = shard};
+  INT32U ops = 0;
+  INT8U err;
+
+  expired_count = 0;
+  double t0 = now_ns();
+  while (ops < BENCH_PAYLOAD_OPS) {
+    for (INT32U i = 0; i < BENCH_BURST; i++, ops++) {
+      RTOS_TMR_HANDLE timer;
+      context.request = ops;
+      if (how == BENCH_PAYLOAD_MALLOC) {
+        BENCH_CONTEXT *copy = malloc(sizeof(BENCH_CONTEXT));
+        *copy = context;
+        timer = RTOSTmrCreate(1, 0, RTOS_TMR_ONE_SHOT, bench_context_freed,
+                              copy, "bench", &err);
+      } else {
+        timer = RTOSTmrCreatePayload(1, 0, RTOS_TMR_ONE_SHOT,
+                                     bench_context_expired, &context,
+                                     sizeof(context), "bench", &err);
+      }
+      RTOSTmrStart(timer, &err);
+    }
+    process_timer_tick(shard);
+  }
+  // The last burst expires on the tick after.
+  process_timer_tick(shard);
+  emit_rate("payload", payload_name[how], BENCH_BURST, 1, expired_count,
+            now_ns() - t0);
+}
+
+#if RTOS_CFG_TMR_PERSIST_EN
+/*
+  @ run_persist().
+  - In a child process, with the pool still empty: create and start
+  timer_count timers spread over a day, in the pool file for how ==
+  BENCH_PERSIST_WRITE, or open the pool file and restore them.
+  - Returns the time it took the child, or a negative value if it failed.
+*/
+static double run_persist(INT32U timer_count, INT32U how,
+                          RTOS_TMR_SPEC *specs, RTOS_TMR_HANDLE *timers,
+                          INT8U *errs) {
+  double ns = -1;
+  int fds[2];
+  int status;
+
+  fflush(NULL);
+  if (pipe(fds) != 0) {
+    return ns;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    INT8U err;
+    close(fds[0]);
+    RTOSTmrCallbackRegister(0, bench_expired, "bench", &err);
+    if (how == BENCH_PERSIST_WRITE) {
+      unlink(BENCH_PERSIST_FILE);
+    }
+    double t0 = now_ns();
+    if (how != BENCH_PERSIST_RECREATE &&
+        !RTOSTmrPersistOpen(BENCH_PERSIST_FILE, &err)) {
+      _exit(1);
+    }
+    if (how == BENCH_PERSIST_RESTORE) {
+      RTOS_TMR_PERSIST_INFO info;
+      restore_timer_pool();
+      RTOSTmrPersistInfoGet(&info);
+      if (info.restored != timer_count) {
+        _exit(1);
+      }
+    } else {
+      fill_specs(specs, timer_count, BENCH_ADVANCE_TICKS, BENCH_MIX_MIXED);
+      if (RTOSTmrCreateBatch(specs, timer_count, timers, errs) !=
+              timer_count ||
+          RTOSTmrStartBatch(timers, timer_count, errs) != timer_count) {
+        _exit(1);
+      }
+    }
+    ns = now_ns() - t0;
+    _exit(write(fds[1], &ns, sizeof(ns)) == sizeof(ns) ? 0 : 1);
+  }
+  close(fds[1]);
+  if (pid < 0 || read(fds[0], &ns, sizeof(ns)) != sizeof(ns)) {
+    ns = -1;
+  }
+  close(fds[0]);
+  if (pid > 0) {
+    waitpid(pid, &status, 0);
+  }
+  return ns;
+}
+
+/*
+  @ bench_persist().
+  Have timer_count timers back after a restart, by recreating them and by
+  restoring them from the pool file a child left behind.
+*/
+static void bench_persist(INT32U timer_count, RTOS_TMR_SPEC *specs,
+                          RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  for (INT32U how = BENCH_PERSIST_RECREATE; how <= BENCH_PERSIST_RESTORE;
+       how++) {
+    double ns = run_persist(timer_count, how, specs, timers, errs);
+    if (ns < 0) {
+      fprintf(stderr, "\npersist %s of %u timers failed\n", persist_name[how],
+              timer_count);
+      break;
+    }
+    if (how != BENCH_PERSIST_WRITE) {
+      emit_rate("persist", persist_name[how], timer_count, 1, timer_count, ns);
+    }
+  }
+  unlink(BENCH_PERSIST_FILE);
+}
+#endif
+
+/*
+  @ bench_prio().
+  BENCH_PRIO_ROUNDS ticks on shard 0, each expiring timer_count one shot
+  timers and the watched one of class how in between, timing the dispatch of
+  the watched timer from the start of the tick.
+*/
+static void bench_prio(INT32U timer_count, INT32U how, RTOS_TMR_SPEC *specs,
+                       RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  TMR_SHARD *shard = &TmrShard[0];
+  double *dispatch_ns = malloc(BENCH_PRIO_ROUNDS * sizeof(double));
+  INT8U option = RTOS_TMR_ONE_SHOT;
+  double total = 0;
+  BENCH_RECORD r;
+  INT8U err;
+
+  if (dispatch_ns == NULL) {
+    fprintf(stderr, "\nOut of memory for %u rounds\n", BENCH_PRIO_ROUNDS);
+    return;
+  }
+  if (how == BENCH_PRIO_CRITICAL) {
+    option |= RTOS_TMR_OPT_PRIO(RTOS_TMR_PRIO_CRITICAL);
+  }
+  fill_specs(specs, timer_count, 1, BENCH_MIX_ONE_SHOT);
+  for (INT32U i = 0; i < BENCH_PRIO_ROUNDS; i++) {
+    INT32U before = bench_rand() % (timer_count + 1);
+    RTOSTmrCreateBatch(specs, before, timers, errs);
+    RTOSTmrStartBatch(timers, before, errs);
+    RTOS_TMR_HANDLE watched = RTOSTmrCreate(1, 0, option, bench_prio_expired,
+                                            NULL, "bench", &err);
+    RTOSTmrStart(watched, &err);
+    RTOSTmrCreateBatch(specs, timer_count - before, timers, errs);
+    RTOSTmrStartBatch(timers, timer_count - before, errs);
+    // Expire them all in one tick.
+    process_timer_tick(shard);
+    prio_tick_start = now_ns();
+    process_timer_tick(shard);
+    dispatch_ns[i] = prio_dispatch_ns;
+    total += prio_dispatch_ns;
+  }
+  qsort(dispatch_ns, BENCH_PRIO_ROUNDS, sizeof(double), compare_double);
+
+  memset(&r, 0, sizeof(r));
+  r.store = shard->store->name;
+  r.bench = "prio";
+  r.mix = prio_name[how];
+  r.timers = timer_count;
+  r.threads = 1;
+  r.ops = BENCH_PRIO_ROUNDS;
+  r.ns_per_op = total / BENCH_PRIO_ROUNDS;
+  r.mops = 0;
+  r.p50_ns = percentile(dispatch_ns, BENCH_PRIO_ROUNDS, 0.50);
+  r.p90_ns = percentile(dispatch_ns, BENCH_PRIO_ROUNDS, 0.90);
+  r.p99_ns = percentile(dispatch_ns, BENCH_PRIO_ROUNDS, 0.99);
+  r.p999_ns = percentile(dispatch_ns, BENCH_PRIO_ROUNDS, 0.999);
+  r.max_ns = dispatch_ns[BENCH_PRIO_ROUNDS - 1];
+  r.per_tick = timer_count + 1;
+  r.bytes_per_timer = 0;
+  emit_record(&r);
+  free(dispatch_ns);
+}
+
+/*
+  @ bench_defer().
+  Expire timer_count normal one shot timers and a critical one on the same
+  tick of shard 0 under a tick budget, advancing virtual time by enough ticks
+  to run one callback per tick, and check that all of them ran.
+*/
+static void bench_defer(INT32U timer_count, RTOS_TMR_SPEC *specs,
+                        RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  TMR_SHARD *shard = &TmrShard[0];
+  INT32U first = shard->tick + 1;
+  BENCH_RECORD r;
+  INT8U err;
+
+  fill_specs(specs, timer_count, 1, BENCH_MIX_ONE_SHOT);
+  for (INT32U i = 0; i < timer_count; i++) {
+    specs[i].callback = bench_defer_expired;
+  }
+  RTOSTmrCreateBatch(specs, timer_count, timers, errs);
+  RTOSTmrStartBatch(timers, timer_count, errs);
+  RTOS_TMR_HANDLE critical = RTOSTmrCreate(
+      1, 0, RTOS_TMR_ONE_SHOT | RTOS_TMR_OPT_PRIO(RTOS_TMR_PRIO_CRITICAL),
+      bench_defer_expired, NULL, "bench", &err);
+  RTOSTmrStart(critical, &err);
+
+  RTOSTmrBudgetSet(BENCH_DEFER_BUDGET_NS);
+  expired_count = 0;
+  double t0 = now_ns();
+  RTOSTmrAdvance(timer_count + 2, &err);
+  double t1 = now_ns();
+  RTOSTmrBudgetSet(RTOS_CFG_TMR_TICK_BUDGET_NS);
+  if (expired_count != timer_count + 1) {
+    fprintf(stderr, "\ndefer: %u of %u expiries never ran\n",
+            timer_count + 1 - expired_count, timer_count + 1);
+  }
+
+  memset(&r, 0, sizeof(r));
+  r.store = shard->store->name;
+  r.bench = "defer";
+  r.mix = "one_shot";
+  r.timers = timer_count;
+  r.threads = 1;
+  r.ops = expired_count;
+  r.ns_per_op = expired_count ? (t1 - t0) / expired_count : 0;
+  r.mops = expired_count / (t1 - t0) * 1e3;
+  r.per_tick = (double)expired_count / (defer_last_tick - first + 1);
+  r.bytes_per_timer = 0;
+  emit_record(&r);
+}
+
+/*
+  @ bench_spread().
+  Start timer_count periodic timers of delay 0 together in phase spreading
+  mode how, then process and time one period of ticks of shard 0, counting
+  the expiries of every tick.
+*/
+static void bench_spread(INT32U timer_count, INT8U how, RTOS_TMR_SPEC *specs,
+                         RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  TMR_SHARD *shard = &TmrShard[0];
+  INT32U ticks = BENCH_SPREAD_PERIOD;
+  double tick_ns[BENCH_SPREAD_PERIOD];
+  INT32U most = 0;
+  double total = 0;
+  BENCH_RECORD r;
+  INT8U err;
+
+  fill_specs(specs, timer_count, BENCH_SPREAD_PERIOD, BENCH_MIX_PERIODIC);
+  for (INT32U i = 0; i < timer_count; i++) {
+    specs[i].delay = 0;
+  }
+  RTOSTmrSpreadSet(how, &err);
+  RTOSTmrCreateBatch(specs, timer_count, timers, errs);
+  RTOSTmrStartBatch(timers, timer_count, errs);
+  RTOSTmrSpreadSet(RTOS_TMR_SPREAD_OFF, &err);
+
+  expired_count = 0;
+  for (INT32U i = 0; i < ticks; i++) {
+    INT32U before = expired_count;
+    double t0 = now_ns();
+    process_timer_tick(shard);
+    tick_ns[i] = now_ns() - t0;
+    total += tick_ns[i];
+    if (expired_count - before > most) {
+      most = expired_count - before;
+    }
+  }
+  qsort(tick_ns, ticks, sizeof(double), compare_double);
+
+  memset(&r, 0, sizeof(r));
+  r.store = shard->store->name;
+  r.bench = "spread";
+  r.mix = spread_name[how];
+  r.timers = timer_count;
+  r.threads = 1;
+  r.ops = expired_count;
+  r.ns_per_op = expired_count ? total / expired_count : 0;
+  r.mops = expired_count / total * 1e3;
+  r.p50_ns = percentile(tick_ns, ticks, 0.50);
+  r.p90_ns = percentile(tick_ns, ticks, 0.90);
+  r.p99_ns = percentile(tick_ns, ticks, 0.99);
+  r.p999_ns = percentile(tick_ns, ticks, 0.999);
+  r.max_ns = tick_ns[ticks - 1];
+  r.per_tick = most;
+  r.bytes_per_timer = 0;
+  emit_record(&r);
+  RTOSTmrDelBatch(timers, timer_count, errs);
+}
+
+/*
+  @ bench_cancel_thread().
+  Start and stop BENCH_BURST timers of the own one at a time.
+*/
+static void *bench_cancel_thread(void *arg) {
+  INT32U ops = *(INT32U *)arg;
+  RTOS_TMR_SPEC specs[BENCH_BURST];
+  RTOS_TMR_HANDLE timers[BENCH_BURST];
+  INT8U errs[BENCH_BURST];
+
+  for (int i = 0; i < BENCH_BURST; i++) {
+    specs[i].delay = 1000 + i;
+    specs[i].period = 0;
+    specs[i].option = RTOS_TMR_ONE_SHOT;
+    specs[i].callback = bench_expired;
+    specs[i].callback_arg = NULL;
+    specs[i].name = "bench";
+    specs[i].payload_size = 0;
+  }
+  RTOSTmrCreateBatch(specs, BENCH_BURST, timers, errs);
+  for (INT32U i = 0; i < ops; i++) {
+    RTOSTmrStartBatch(&timers[i % BENCH_BURST], 1, errs);
+    RTOSTmrStopBatch(&timers[i % BENCH_BURST], 1, errs);
+  }
+  RTOSTmrDelBatch(timers, BENCH_BURST, errs);
+  return NULL;
+}
+
+/*
+  @ bench_cancel_threads().
+  Start+stop pairs of thread_count threads sharing the shards.
+*/
+static void bench_cancel_threads(INT32U thread_count) {
+  pthread_t threads[64];
+  INT32U ops = BENCH_CANCEL_OPS / thread_count;
+  double t0 = now_ns();
+
+  for (INT32U i = 0; i < thread_count; i++) {
+    pthread_create(&threads[i], NULL, bench_cancel_thread, &ops);
+  }
+  for (INT32U i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  emit_rate("cancel", "one_shot", BENCH_BURST, thread_count,
+            (INT64U)ops * thread_count, now_ns() - t0);
+}
+
+/*
+  @ bench_thread().
+  Create, start, stop and delete timers in bursts of BENCH_BURST.
+*/
+static void *bench_thread(void *arg) {
+  INT32U ops = *(INT32U *)arg;
+  RTOS_TMR_SPEC specs[BENCH_BURST];
+  RTOS_TMR_HANDLE burst[BENCH_BURST];
+  INT8U errs[BENCH_BURST];
+
+  for (int i = 0; i < BENCH_BURST; i++) {
+    specs[i].delay = 1000 + i;
+    specs[i].period = 0;
+    specs[i].option = RTOS_TMR_ONE_SHOT;
+    specs[i].callback = bench_expired;
+    specs[i].callback_arg = NULL;
+    specs[i].name = "bench";
+    specs[i].payload_size = 0;
+  }
+  for (INT32U done = 0; done < ops; done += BENCH_BURST) {
+    RTOSTmrCreateBatch(specs, BENCH_BURST, burst, errs);
+    RTOSTmrStartBatch(burst, BENCH_BURST, errs);
+    RTOSTmrStopBatch(burst, BENCH_BURST, errs);
+    RTOSTmrDelBatch(burst, BENCH_BURST, errs);
+  }
+  return NULL;
+}
+
+/*
+  @ bench_threads().
+  Throughput of thread_count threads sharing the pool and the shards, one op
+  being a create/start/stop/delete cycle of one timer.
+*/
+static void bench_threads(INT32U thread_count) {
+  pthread_t threads[64];
+  INT32U ops = BENCH_THREAD_OPS / thread_count;
+  double t0 = now_ns();
+
+  for (INT32U i = 0; i < thread_count; i++) {
+    pthread_create(&threads[i], NULL, bench_thread, &ops);
+  }
+  for (INT32U i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  emit_rate("threads", "one_shot", BENCH_BURST, thread_count,
+            (INT64U)ops * thread_count, now_ns() - t0);
+}
+
+int main(int argc, char **argv) {
+  INT32U max_timers = 1000000;
+  INT32U max_threads = 64;
+  INT32U shards = 1;
+  const char *csv_name = NULL;
+  const char *json_name = NULL;
+  const char *only_store = NULL;
+  INT8U err;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:t:s:b:c:j:")) != -1) {
+    if (opt == 'n') {
+      max_timers = (INT32U)strtoul(optarg, NULL, 10);
+    } else if (opt == 't') {
+      max_threads = (INT32U)strtoul(optarg, NULL, 10);
+    } else if (opt == 's') {
+      shards = (INT32U)strtoul(optarg, NULL, 10);
+    } else if (opt == 'b') {
+      only_store = optarg;
+    } else if (opt == 'c') {
+      csv_name = optarg;
+    } else if (opt == 'j') {
+      json_name = optarg;
+    } else {
+      fprintf(stderr, "usage: %s [-n max_timers] [-t max_threads] "
+                      "[-s shards] [-b wheel|heap] [-c csv_file] "
+                      "[-j json_file]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (max_timers < 10 || max_threads > 64) {
+    fprintf(stderr, "\nmax_timers must be >= 10, max_threads <= 64\n");
+    return 1;
+  }
+  if (only_store != NULL && strcmp(only_store, store_name[0]) != 0 &&
+      strcmp(only_store, store_name[1]) != 0) {
+    fprintf(stderr, "\nUnknown timer store %s\n", only_store);
+    return 1;
+  }
+  csv_file = csv_name ? fopen(csv_name, "w") : (json_name ? NULL : stdout);
+  json_file = json_name ? fopen(json_name, "w") : NULL;
+  if ((csv_name && csv_file == NULL) || (json_name && json_file == NULL)) {
+    fprintf(stderr, "\nCannot open the output file\n");
+    return 1;
+  }
+  if (csv_file != NULL) {
+    fprintf(csv_file, "store,bench,mix,timers,threads,ops,ns_per_op,mops,p50_ns,"
+                      "p90_ns,p99_ns,p999_ns,max_ns,per_tick,"
+                      "bytes_per_timer\n");
+  }
+  if (json_file != NULL) {
+    fprintf(json_file, "[");
+  }
+
+  RTOS_TMR_SPEC *specs = malloc(max_timers * sizeof(RTOS_TMR_SPEC));
+  RTOS_TMR_HANDLE *timers = malloc(max_timers * sizeof(RTOS_TMR_HANDLE));
+  INT8U *errs = malloc(max_timers);
+  if (specs == NULL || timers == NULL || errs == NULL) {
+    fprintf(stderr, "\nOut of memory for %u timers\n", max_timers);
+    return 1;
+  }
+
+#if RTOS_CFG_TMR_PERSIST_EN
+  // First, the children must find the pool empty.
+  for (INT32U i = 0; i < sizeof(bench_store); i++) {
+    if (only_store != NULL && strcmp(only_store, store_name[i]) != 0) {
+      continue;
+    }
+    if (init_timer_shards(shards, bench_store[i]) != RTOS_SUCCESS) {
+      fprintf(stderr, "\nShard creation failed\n");
+      return 1;
+    }
+    for (INT32U count = 10; count <= max_timers; count *= 10) {
+      bench_persist(count, specs, timers, errs);
+    }
+    free_timer_shards();
+  }
+#endif
+  for (INT32U i = 0; i < sizeof(bench_store); i++) {
+    if (only_store != NULL && strcmp(only_store, store_name[i]) != 0) {
+      continue;
+    }
+    // The shards are driven by hand instead of by their timer tasks.
+    if (init_timer_shards(shards, bench_store[i]) != RTOS_SUCCESS) {
+      fprintf(stderr, "\nShard creation failed\n");
+      return 1;
+    }
+    RTOSTmrShardSelect(0, &err);
+
+    for (INT32U count = 10; count <= max_timers; count *= 10) {
+      bench_ops(count, specs, timers, errs);
+    }
+    for (INT32U mix = BENCH_MIX_ONE_SHOT; mix <= BENCH_MIX_MIXED; mix++) {
+      for (INT32U count = 10; count <= max_timers; count *= 10) {
+        bench_expire(count, mix, specs, timers, errs);
+      }
+    }
+    for (INT32U count = 10; count <= max_timers; count *= 10) {
+      bench_cancel(count, specs, timers, errs);
+    }
+    for (INT32U threads = 1; threads <= max_threads; threads *= 2) {
+      bench_cancel_threads(threads);
+    }
+    for (INT32U how = BENCH_RESTART_STOP_START; how <= BENCH_RESTART_LAZY;
+         how++) {
+      for (INT32U count = 10; count <= max_timers; count *= 10) {
+        bench_restart(count, how, specs, timers, errs);
+      }
+    }
+    for (INT32U count = 10; count <= max_timers; count *= 10) {
+      bench_advance(count, specs, timers, errs);
+    }
+    for (INT32U count = 10; count <= max_timers; count *= 10) {
+      bench_scan(count, specs, timers, errs);
+    }
+    bench_payload(BENCH_PAYLOAD_MALLOC);
+    bench_payload(BENCH_PAYLOAD_INLINE);
+    for (INT32U how = BENCH_PRIO_NORMAL; how <= BENCH_PRIO_CRITICAL; how++) {
+      for (INT32U count = 10;
+           count <= max_timers && count <= BENCH_PRIO_MAX_TIMERS;
+           count *= 10) {
+        bench_prio(count, how, specs, timers, errs);
+      }
+    }
+    for (INT32U count = 10;
+         count <= max_timers && count <= BENCH_PRIO_MAX_TIMERS; count *= 10) {
+      bench_defer(count, specs, timers, errs);
+    }
+    for (INT8U how = RTOS_TMR_SPREAD_OFF; how <= RTOS_TMR_SPREAD_RANDOM;
+         how++) {
+      for (INT32U count = 10; count <= max_timers; count *= 10) {
+        bench_spread(count, how, specs, timers, errs);
+      }
+    }
+    for (INT32U threads = 1; threads <= max_threads; threads *= 2) {
+      bench_threads(threads);
+    }
+    free_timer_shards();
+  }
+
+  if (json_file != NULL) {
+    fprintf(json_file, "\n]\n");
+    fclose(json_file);
+  }
+  if (csv_file != NULL && csv_file != stdout) {
+    fclose(csv_file);
+  }
+  free(specs);
+  free(timers);
+  free(errs);
+  return 0;
+}
@@ -0,0 +1,345 @@
+/*
+  - Benchmark of the C++ front-end (TimerMgr.hpp) against the same work done
+  through the C API, non-interactive. Every benchmark runs once with the C API
+  ("c_api") and once with rtos::Timer ("timer").
+  - timeout: one shot timeouts carrying a two pointer context, created and
+  started BENCH_BURST at a time and expired by the next tick, then deleted
+  (a no-op for rtos::Timer, whose destructor finds them expired).
+  - restart: push back the deadline of one of BENCH_BURST running timers at a
+  time.
+  - expire: BENCH_BURST periodic timers of one tick, the cost of dispatching a
+  callback.
+  - sleep: BENCH_BURST coroutines looping on co_await rtos::sleep_for() of one
+  tick (TimerCoro.hpp), the cost of a suspend and resume.
+  - wait: BENCH_BURST coroutines looping on co_await rtos::with_timeout() of
+  an rtos::Event, set by the benchmark ("signaled") or never ("timed_out").
+  - The heap allocations made while the coroutines run are counted and
+  reported on stderr, there should be none.
+  - The suite runs once per timer store, on shard 0 driven by hand, and writes
+  the records of TimerBench as CSV to stdout.
+
+  Usage: TimerBenchCpp
+*/
+
+// Include header files.
+#include "TimerCoro.hpp"
+#include "TimerMgr.hpp"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <new>
+#include <vector>
+
+#define BENCH_BURST 128
+#define BENCH_OPS 1000000
+#define BENCH_WAIT_ROUNDS (BENCH_OPS / BENCH_BURST)
+
+using namespace std::chrono_literals;
+
+extern "C" TMR_SHARD *TmrShard;
+
+// One tick of the library, and 100 of them.
+static constexpr std::chrono::nanoseconds one_tick(RTOS_CFG_TMR_TASK_RATE);
+static constexpr auto far_away = 100 * one_tick;
+static_assert(rtos::to_ticks(one_tick) == 1 && rtos::to_ticks(far_away) == 100,
+              "durations convert to ticks at compile time");
+
+static const INT8U bench_store[] = {RTOS_TMR_STORE_WHEEL, RTOS_TMR_STORE_HEAP};
+
+static INT64U expired_count;
+static INT64U last_request;
+static INT64U heap_allocs;
+
+// Count the heap allocations of the whole program.
+void *operator new(std::size_t size) {
+  heap_allocs++;
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+// Coroutine started by its call and left to run on its own.
+struct BenchTask {
+  struct promise_type {
+    BenchTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Context of a timeout, as a request would keep for its callback.
+struct BenchContext {
+  INT64U *counter;
+  INT64U request;
+};
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void emit_rate(const char *bench, const char *mix, INT64U ops,
+                      double ns) {
+  printf("%s,%s,%s,%u,1,%llu,%.1f,%.3f,0,0,0,0,0,0.00,0\n",
+         TmrShard[0].store->name, bench, mix, BENCH_BURST,
+         (unsigned long long)ops, ns / ops, ops / ns * 1e3);
+}
+
+static void bench_context_expired(void *arg) {
+  BenchContext *context = static_cast<BenchContext *>(arg);
+  ++*context->counter;
+  last_request = context->request;
+}
+
+/*
+  @ expire_burst().
+  Process the ticks expiring the timers started with a delay of one tick.
+*/
+static void expire_burst(TMR_SHARD *shard) {
+  process_timer_tick(shard);
+  process_timer_tick(shard);
+}
+
+/*
+  @ bench_timeout().
+  BENCH_OPS one shot timeouts of one tick, created, started and deleted in
+  bursts of BENCH_BURST.
+*/
+static void bench_timeout() {
+  TMR_SHARD *shard = &TmrShard[0];
+  RTOS_TMR_HANDLE handles[BENCH_BURST];
+  INT8U err;
+
+  expired_count = 0;
+  double t0 = now_ns();
+  for (INT64U ops = 0; ops < BENCH_OPS; ops += BENCH_BURST) {
+    for (INT32U i = 0; i < BENCH_BURST; i++) {
+      BenchContext context = {&expired_count, ops + i};
+      handles[i] = RTOSTmrCreatePayload(
+          1, 0, RTOS_TMR_ONE_SHOT, bench_context_expired, &context,
+          sizeof(context), const_cast<INT8 *>("bench"), &err);
+      RTOSTmrStart(handles[i], &err);
+    }
+    expire_burst(shard);
+    for (INT32U i = 0; i < BENCH_BURST; i++) {
+      RTOSTmrDel(handles[i], &err);
+    }
+  }
+  emit_rate("timeout", "c_api", expired_count, now_ns() - t0);
+
+  auto make_timer = [](INT64U *counter, INT64U request) {
+    return rtos::Timer(
+        [counter, request] {
+          ++*counter;
+          last_request = request;
+        },
+        one_tick, 0ns, "bench");
+  };
+  std::vector<decltype(make_timer(nullptr, 0))> timers;
+  timers.reserve(BENCH_BURST);
+
+  expired_count = 0;
+  t0 = now_ns();
+  for (INT64U ops = 0; ops < BENCH_OPS; ops += BENCH_BURST) {
+    for (INT32U i = 0; i < BENCH_BURST; i++) {
+      timers.push_back(make_timer(&expired_count, ops + i));
+      timers.back().start();
+    }
+    expire_burst(shard);
+    timers.clear();
+  }
+  emit_rate("timeout", "timer", expired_count, now_ns() - t0);
+}
+
+/*
+  @ bench_restart().
+  BENCH_OPS restarts, 100 ticks away, of one of BENCH_BURST running timers at
+  a time.
+*/
+static void bench_restart() {
+  RTOS_TMR_HANDLE handles[BENCH_BURST];
+  INT8U err;
+
+  for (INT32U i = 0; i < BENCH_BURST; i++) {
+    handles[i] = RTOSTmrCreate(100, 0, RTOS_TMR_ONE_SHOT,
+                               bench_context_expired, nullptr,
+                               const_cast<INT8 *>("bench"), &err);
+    RTOSTmrStart(handles[i], &err);
+  }
+  double t0 = now_ns();
+  for (INT32U ops = 0; ops < BENCH_OPS; ops++) {
+    RTOSTmrRestart(handles[ops % BENCH_BURST], 100, &err);
+  }
+  emit_rate("restart", "c_api", BENCH_OPS, now_ns() - t0);
+  for (INT32U i = 0; i < BENCH_BURST; i++) {
+    RTOSTmrDel(handles[i], &err);
+  }
+
+  auto callback = [] {};
+  std::vector<rtos::Timer<decltype(callback)>> timers;
+  for (INT32U i = 0; i < BENCH_BURST; i++) {
+    timers.emplace_back(callback, far_away);
+    timers.back().start();
+  }
+  t0 = now_ns();
+  for (INT32U ops = 0; ops < BENCH_OPS; ops++) {
+    timers[ops % BENCH_BURST].restart(far_away);
+  }
+  emit_rate("restart", "timer", BENCH_OPS, now_ns() - t0);
+}
+
+/*
+  @ bench_expire().
+  BENCH_BURST periodic timers of one tick expiring BENCH_OPS times in all.
+*/
+static void bench_expire() {
+  TMR_SHARD *shard = &TmrShard[0];
+  RTOS_TMR_HANDLE handles[BENCH_BURST];
+  BenchContext context = {&expired_count, 0};
+  INT8U err;
+
+  for (INT32U i = 0; i < BENCH_BURST; i++) {
+    handles[i] = RTOSTmrCreatePayload(
+        0, 1, RTOS_TMR_PERIODIC, bench_context_expired, &context,
+        sizeof(context), const_cast<INT8 *>("bench"), &err);
+    RTOSTmrStart(handles[i], &err);
+  }
+  expired_count = 0;
+  double t0 = now_ns();
+  for (INT32U ops = 0; ops < BENCH_OPS; ops += BENCH_BURST) {
+    process_timer_tick(shard);
+  }
+  emit_rate("expire", "c_api", expired_count, now_ns() - t0);
+  for (INT32U i = 0; i < BENCH_BURST; i++) {
+    RTOSTmrDel(handles[i], &err);
+  }
+
+  INT64U *counter = &expired_count;
+  auto callback = [counter] { ++*counter; };
+  std::vector<rtos::Timer<decltype(callback)>> timers;
+  for (INT32U i = 0; i < BENCH_BURST; i++) {
+    timers.emplace_back(callback, 0ns, one_tick);
+    timers.back().start();
+  }
+  expired_count = 0;
+  t0 = now_ns();
+  for (INT32U ops = 0; ops < BENCH_OPS; ops += BENCH_BURST) {
+    process_timer_tick(shard);
+  }
+  emit_rate("expire", "timer", expired_count, now_ns() - t0);
+}
+
+static BenchTask sleeper(INT32U rounds, INT32U *running) {
+  for (INT32U i = 0; i < rounds; i++) {
+    co_await rtos::sleep_for(one_tick);
+    expired_count++;
+  }
+  --*running;
+}
+
+static BenchTask waiter(rtos::Event &event, INT32U rounds, INT32U ticks,
+                        INT32U *running) {
+  for (INT32U i = 0; i < rounds; i++) {
+    bool signaled = co_await rtos::with_timeout(event, ticks * one_tick);
+    event.reset();
+    expired_count += signaled;
+    last_request += !signaled;
+  }
+  --*running;
+}
+
+/*
+  @ report_allocs().
+  Report the heap allocations made since allocs on stderr.
+*/
+static void report_allocs(const char *bench, INT64U allocs) {
+  fprintf(stderr, "%s: %s, %llu heap allocations\n", TmrShard[0].store->name,
+          bench, (unsigned long long)(heap_allocs - allocs));
+}
+
+/*
+  @ bench_sleep().
+  BENCH_BURST coroutines sleeping one tick BENCH_WAIT_ROUNDS times each.
+*/
+static void bench_sleep() {
+  TMR_SHARD *shard = &TmrShard[0];
+  INT32U running = BENCH_BURST;
+
+  expired_count = 0;
+  double t0 = now_ns();
+  for (INT32U i = 0; i < BENCH_BURST; i++) {
+    sleeper(BENCH_WAIT_ROUNDS, &running);
+  }
+  // The coroutine frames are the only allocations.
+  INT64U allocs = heap_allocs;
+  while (running != 0) {
+    process_timer_tick(shard);
+  }
+  emit_rate("sleep", "coroutine", expired_count, now_ns() - t0);
+  report_allocs("sleep", allocs);
+}
+
+/*
+  @ bench_wait().
+  BENCH_BURST coroutines waiting BENCH_WAIT_ROUNDS times each for their event,
+  set every time or left to time out after one tick.
+*/
+static void bench_wait(bool signal) {
+  TMR_SHARD *shard = &TmrShard[0];
+  std::array<rtos::Event, BENCH_BURST> events;
+  INT32U running = BENCH_BURST;
+
+  expired_count = 0;
+  last_request = 0;
+  double t0 = now_ns();
+  for (INT32U i = 0; i < BENCH_BURST; i++) {
+    waiter(events[i], BENCH_WAIT_ROUNDS, signal ? 100 : 1, &running);
+  }
+  INT64U allocs = heap_allocs;
+  while (running != 0) {
+    if (signal) {
+      for (rtos::Event &event : events) {
+        event.set();
+      }
+    } else {
+      process_timer_tick(shard);
+    }
+  }
+  emit_rate("wait", signal ? "signaled" : "timed_out",
+            signal ? expired_count : last_request, now_ns() - t0);
+  report_allocs(signal ? "wait signaled" : "wait timed_out", allocs);
+}
+
+int main() {
+  INT8U err;
+
+  printf("store,bench,mix,timers,threads,ops,ns_per_op,mops,p50_ns,p90_ns,"
+         "p99_ns,p999_ns,max_ns,per_tick,bytes_per_timer\n");
+  for (INT8U store : bench_store) {
+    // The shard is driven by hand instead of by its timer task.
+    if (init_timer_shards(1, store) != RTOS_SUCCESS) {
+      fprintf(stderr, "\nShard creation failed\n");
+      return 1;
+    }
+    RTOSTmrShardSelect(0, &err);
+    bench_timeout();
+    bench_restart();
+    bench_expire();
+    bench_sleep();
+    bench_wait(true);
+    bench_wait(false);
+    free_timer_shards();
+  }
+  return 0;
+}
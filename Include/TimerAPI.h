@@ -5,44 +5,214 @@
 #include "TimerMgrHeader.h"
 #include "TypeDefines.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // TIMER MANAGER APIs
 
-extern void RTOSTmrInit(void);
+extern void RTOSTmrInit(INT32U shard_count, INT8U store);
+
+extern RTOS_TMR_HANDLE RTOSTmrCreate(INT32U delay, INT32U period,
+                                     INT8U option, RTOS_TMR_CALLBACK callback,
+                                     void *callback_arg, INT8 *name,
+                                     INT8U *err);
 
-extern RTOS_TMR *RTOSTmrCreate(INT32U delay, INT32U period, INT8U option,
-                               RTOS_TMR_CALLBACK callback, void *callback_arg,
-                               INT8 *name, INT8U *err);
+extern RTOS_TMR_HANDLE RTOSTmrCreatePayload(INT32U delay, INT32U period,
+                                            INT8U option,
+                                            RTOS_TMR_CALLBACK callback,
+                                            const void *payload,
+                                            INT32U payload_size, INT8 *name,
+                                            INT8U *err);
 
-extern INT8U RTOSTmrDel(RTOS_TMR *ptmr, INT8U *perr);
+extern INT8U RTOSTmrDel(RTOS_TMR_HANDLE timer, INT8U *perr);
 
-extern INT8 *RTOSTmrNameGet(RTOS_TMR *ptmr, INT8U *perr);
+extern INT8 *RTOSTmrNameGet(RTOS_TMR_HANDLE timer, INT8U *perr);
 
-extern INT32U RTOSTmrRemainGet(RTOS_TMR *ptmr, INT8U *perr);
+extern INT32U RTOSTmrRemainGet(RTOS_TMR_HANDLE timer, INT8U *perr);
 
-extern INT8U RTOSTmrStateGet(RTOS_TMR *ptmr, INT8U *perr);
+extern INT8U RTOSTmrStateGet(RTOS_TMR_HANDLE timer, INT8U *perr);
 
-extern INT8U RTOSTmrStart(RTOS_TMR *ptmr, INT8U *perr);
+extern INT8U RTOSTmrStart(RTOS_TMR_HANDLE timer, INT8U *perr);
 
-extern INT8U RTOSTmrStop(RTOS_TMR *ptmr, INT8U opt, void *callback_arg,
+extern INT8U RTOSTmrStop(RTOS_TMR_HANDLE timer, INT8U opt, void *callback_arg,
                          INT8U *perr);
 
+extern INT8U RTOSTmrCancel(RTOS_TMR_HANDLE timer, INT8U *perr);
+
+extern INT8U RTOSTmrRestart(RTOS_TMR_HANDLE timer, INT32U delay, INT8U *perr);
+
+extern INT8U RTOSTmrRestartLazy(RTOS_TMR_HANDLE timer, INT32U delay,
+                                INT8U *perr);
+
+extern INT8U RTOSTmrModify(RTOS_TMR_HANDLE timer, INT32U delay, INT32U period,
+                           INT8U *perr);
+
+extern INT32U RTOSTmrCreateBatch(const RTOS_TMR_SPEC *specs, INT32U count,
+                                 RTOS_TMR_HANDLE *timers, INT8U *errs);
+
+extern INT32U RTOSTmrStartBatch(const RTOS_TMR_HANDLE *timers, INT32U count,
+                                INT8U *errs);
+
+extern INT32U RTOSTmrStopBatch(const RTOS_TMR_HANDLE *timers, INT32U count,
+                               INT8U *errs);
+
+extern INT32U RTOSTmrDelBatch(const RTOS_TMR_HANDLE *timers, INT32U count,
+                              INT8U *errs);
+
 extern void RTOSTmrSignal(int signum);
 
+extern INT32 RTOSTmrFdGet(void);
+
+extern void RTOSTmrProcess(void);
+
+extern INT8U RTOSTmrAdvance(INT64U ticks, INT8U *perr);
+
+extern INT8U RTOSTmrExecSet(RTOS_TMR_HANDLE timer, INT8U exec, INT8U *perr);
+
+extern INT8U RTOSTmrSlackSet(RTOS_TMR_HANDLE timer, INT32U slack, INT8U *perr);
+
+extern INT8U RTOSTmrPrioSet(RTOS_TMR_HANDLE timer, INT8U prio, INT8U *perr);
+
+extern void RTOSTmrBudgetSet(INT64U ns);
+
+extern INT8U RTOSTmrSpreadSet(INT8U mode, INT8U *perr);
+
+extern INT8U RTOSTmrShardSelect(INT32U shard, INT8U *perr);
+
+extern INT32U RTOSTmrShardGet(RTOS_TMR_HANDLE timer, INT8U *perr);
+
+extern INT32U RTOSTmrShardCount(void);
+
+extern void RTOSTmrPoolInfoGet(RTOS_TMR_POOL_INFO *info);
+
+extern void RTOSTmrQueueStatsGet(RTOS_TMR_QUEUE_STATS *stats);
+
+extern void RTOSTmrStatsGet(RTOS_TMR_STATS *stats);
+
+extern void RTOSTmrStatsReset(void);
+
+extern INT64U RTOSTmrHistPercentile(const RTOS_TMR_HIST *hist, double q);
+
+extern INT32U RTOSTmrProfileGet(RTOS_TMR_PROFILE *profiles, INT32U max);
+
+extern INT32U RTOSTmrSlowGet(RTOS_TMR_SLOW_CB *slow, INT32U max);
+
+extern void RTOSTmrSlowThresholdSet(INT64U ns);
+
+extern void RTOSTmrProfileReset(void);
+
+extern INT8U RTOSTmrTraceStart(const INT8 *path, INT8U *perr);
+
+extern void RTOSTmrTraceStop(void);
+
+extern INT8U RTOSTmrCallbackRegister(INT32U id, RTOS_TMR_CALLBACK callback,
+                                     INT8 *name, INT8U *perr);
+
+extern INT8U RTOSTmrPersistOpen(const INT8 *path, INT8U *perr);
+
+extern INT8U RTOSTmrPersistSync(INT8U *perr);
+
+extern void RTOSTmrPersistInfoGet(RTOS_TMR_PERSIST_INFO *info);
+
 // Internal Functions
 INT8U Create_Timer_Pool(INT32U timer_count);
 
-void init_hash_table(void);
+INT8U init_timer_shards(INT32U shard_count, INT8U store);
+
+void free_timer_shards(void);
+
+INT8U insert_timer_entry(RTOS_TMR *timer_obj, INT32U delay);
 
-void insert_hash_entry(RTOS_TMR *timer_obj);
+INT8U delete_timer_entry(RTOS_TMR *timer_obj, RTOS_TMR_HANDLE handle);
 
-void remove_hash_entry(RTOS_TMR *timer_obj);
+INT8U stop_timer_entry(RTOS_TMR *timer_obj);
+
+INT8U next_timer_deadline(TMR_SHARD *shard, INT32U *deadline);
+
+void send_timer_cmd(INT8U op, RTOS_TMR *timer, RTOS_TMR_HANDLE handle,
+                    INT32U match);
+
+void drain_timer_cmds(TMR_SHARD *shard);
+
+void process_timer_tick(TMR_SHARD *shard);
+
+void advance_timer_ticks(TMR_SHARD *shard, INT32U last_tick);
+
+INT32U current_timer_tick(TMR_SHARD *shard);
 
 void *RTOSTmrTask(void *temp);
 
+INT8U grow_timer_pool(void);
+
+RTOS_TMR *get_timer_obj(INT32U id);
+
+RTOS_TMR_COLD *get_timer_cold(RTOS_TMR *timer);
+
+void refill_timer_cache(TMR_CACHE *cache);
+
+void flush_timer_cache(TMR_CACHE *cache, INT32U count);
+
 RTOS_TMR *alloc_timer_obj(void);
 
 void free_timer_obj(RTOS_TMR *ptmr);
 
+INT32U alloc_timer_batch(RTOS_TMR **timers, INT32U count);
+
+void free_timer_batch(RTOS_TMR **timers, INT32U count);
+
+INT8U defer_timer_free(RTOS_TMR *ptmr);
+
+void release_timer_obj(RTOS_TMR *ptmr);
+
+void free_expired_timer(RTOS_TMR *ptmr);
+
+INT8U init_timer_exec(void);
+
+INT8U submit_timer_exec(RTOS_TMR *timer);
+
+void run_timer_exec(RTOS_TMR *timer, INT32U runner);
+
+void *RTOSTmrExecTask(void *temp);
+
 void OSTickInitialize(void);
 
+INT64U timer_clock_ns(void);
+
+void record_timer_hist(RTOS_TMR_HIST *hist, INT64U value);
+
+void record_timer_lateness(TMR_SHARD *shard, INT32U match, INT8U prio);
+
+void reset_pool_low_water(void);
+
+INT32U get_pool_low_water(void);
+
+void run_timer_callback(RTOS_TMR *timer, void *arg, INT32U runner);
+
+INT8U init_timer_watchdog(void);
+
+void *RTOSTmrWatchdogTask(void *temp);
+
+void trace_timer_event(INT8U event, RTOS_TMR *timer, INT32U arg);
+
+INT8U init_timer_ring(TMR_RING *ring, INT32U size);
+
+INT8U push_timer_ring(TMR_RING *ring, const TMR_CMD *cmd);
+
+INT8U pop_timer_ring(TMR_RING *ring, TMR_CMD *cmd);
+
+INT32U timer_ring_depth(TMR_RING *ring);
+
+INT8U map_persist_chunk(INT32U index, RTOS_TMR **chunk, RTOS_TMR_COLD **cold);
+
+void persist_timer_chunks(INT32U chunk_count);
+
+void persist_timer_clock(TMR_SHARD *shard);
+
+void restore_timer_pool(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
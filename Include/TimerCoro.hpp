@@ -0,0 +1,304 @@
+// Header-only C++20 coroutine awaitables over the Timer APIs
+#ifndef TIMER_CORO_HPP
+#define TIMER_CORO_HPP
+
+#include "TimerMgr.hpp"
+#include <atomic>
+#include <coroutine>
+#include <type_traits>
+
+/*
+  - co_await rtos::sleep_for(d) suspends the coroutine for the duration d,
+  rounded up to ticks. co_await rtos::with_timeout(event, d) waits for an
+  rtos::Event to be set, at most d, and is true if the event came first.
+  - A wait is one one shot timer from the pool (the per-thread cache of free
+  timers, most of the time) carrying in its payload what it needs to resume
+  the coroutine, and the awaiter lives in the coroutine frame: suspending and
+  resuming allocate nothing.
+  - The coroutine resumes on the thread running the expiry (the timer task, or
+  the callback executor threads for RTOS_TMR_EXEC_POOL timers), on the thread
+  setting the event, or wherever the post() of a Resumer sends it.
+  - A wait that cannot get a timer throws rtos::Error out of the co_await.
+*/
+
+namespace rtos {
+
+// Where to resume a coroutine: post(ctx, h), or h.resume() right away if
+// post is null. Trivially copyable, so it fits in a timer payload.
+struct Resumer {
+  void (*post)(void *ctx, std::coroutine_handle<> h) = nullptr;
+  void *ctx = nullptr;
+
+  void operator()(std::coroutine_handle<> h) const {
+    if (post == nullptr) {
+      h.resume();
+    } else {
+      post(ctx, h);
+    }
+  }
+};
+
+/*
+  @ resume_on().
+  Resumer handing the coroutine to executor.post(std::coroutine_handle<>),
+  which should queue it rather than block the timer task. The executor must
+  outlive the waits using it.
+*/
+template <class Executor> Resumer resume_on(Executor &executor) {
+  return {[](void *ctx, std::coroutine_handle<> h) {
+            static_cast<Executor *>(ctx)->post(h);
+          },
+          &executor};
+}
+
+namespace detail {
+
+/*
+  @ start_wait_timer().
+  Create and start a one shot timer of ticks ticks calling callback with a
+  copy of payload. Throws Error if it fails.
+*/
+template <class Payload>
+RTOS_TMR_HANDLE start_wait_timer(INT32U ticks, RTOS_TMR_CALLBACK callback,
+                                 const Payload &payload) {
+  static_assert(std::is_trivially_copyable_v<Payload> &&
+                    sizeof(Payload) <= RTOS_CFG_TMR_PAYLOAD_SIZE,
+                "the wait does not fit in the payload of a timer");
+  INT8U err;
+  RTOS_TMR_HANDLE timer = RTOSTmrCreatePayload(
+      ticks, 0, RTOS_TMR_ONE_SHOT, callback, &payload, sizeof(Payload),
+      const_cast<INT8 *>("co_await"), &err);
+
+  if (timer == RTOS_TMR_NO_HANDLE) {
+    throw Error(err);
+  }
+  if (!RTOSTmrStart(timer, &err)) {
+    INT8U del_err;
+    RTOSTmrDel(timer, &del_err);
+    throw Error(err);
+  }
+  return timer;
+}
+
+} // namespace detail
+
+// Awaiter of sleep_for().
+class SleepAwaiter {
+ public:
+  SleepAwaiter(INT32U ticks, Resumer resumer)
+      : ticks_(ticks), resumer_(resumer) {}
+
+  bool await_ready() const noexcept { return ticks_ == 0; }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    detail::start_wait_timer(ticks_, &expired, Payload{h, resumer_});
+  }
+
+  void await_resume() const noexcept {}
+
+ private:
+  struct Payload {
+    std::coroutine_handle<> h;
+    Resumer resumer;
+  };
+
+  static void expired(void *arg) noexcept {
+    Payload *payload = static_cast<Payload *>(arg);
+    payload->resumer(payload->h);
+  }
+
+  INT32U ticks_;
+  Resumer resumer_;
+};
+
+/*
+  @ sleep_for().
+  co_await sleep_for(d) resumes the coroutine d later, through resumer.
+*/
+template <class Tick = TickPeriod, class Rep, class Period>
+SleepAwaiter sleep_for(std::chrono::duration<Rep, Period> d,
+                       Resumer resumer = {}) {
+  static_assert(std::ratio_equal_v<Tick, TickPeriod>,
+                "the library counts ticks of RTOS_CFG_TMR_TASK_RATE");
+  return SleepAwaiter(to_ticks(d), resumer);
+}
+
+class TimeoutAwaiter;
+
+/*
+  - A flag coroutines wait for with with_timeout(), one coroutine at a time.
+  set() wakes the waiting coroutine, if any, and leaves the event set until
+  reset().
+  - The event must outlive the wait.
+*/
+class Event {
+ public:
+  Event() = default;
+  Event(const Event &) = delete;
+  Event &operator=(const Event &) = delete;
+
+  void set() noexcept;
+
+  // Back to not set, while no coroutine waits.
+  void reset() noexcept {
+    void *set = set_mark();
+    state_.compare_exchange_strong(set, nullptr, std::memory_order_acq_rel);
+  }
+
+  bool is_set() const noexcept {
+    return state_.load(std::memory_order_acquire) == set_mark();
+  }
+
+ private:
+  friend class TimeoutAwaiter;
+
+  void *set_mark() const noexcept { return const_cast<Event *>(this); }
+
+  // nullptr, set_mark() once set, or the TimeoutAwaiter waiting.
+  std::atomic<void *> state_{nullptr};
+};
+
+/*
+  - Awaiter of with_timeout(). Three parties touch it: the suspending
+  coroutine, the timer callback and Event::set(). The first of the timer and
+  the event to claim outcome_ decides the result, and the last party to drop
+  its reference resumes the coroutine, so no party touches the awaiter or the
+  event once the coroutine runs again.
+  - The event claims it and RTOSTmrCancel() succeeds: the timer never fires,
+  the event drops both references. The timer claims it and takes the awaiter
+  out of the event: set() never sees it, the timer drops both references.
+*/
+class TimeoutAwaiter {
+ public:
+  TimeoutAwaiter(Event &event, INT32U ticks, Resumer resumer)
+      : event_(event), ticks_(ticks), resumer_(resumer) {}
+
+  TimeoutAwaiter(const TimeoutAwaiter &) = delete;
+  TimeoutAwaiter &operator=(const TimeoutAwaiter &) = delete;
+
+  bool await_ready() const noexcept { return ticks_ == 0 || event_.is_set(); }
+
+  bool await_suspend(std::coroutine_handle<> h) {
+    INT8U drop = 1;
+
+    h_ = h;
+    timer_ = detail::start_wait_timer(ticks_, &expired, Payload{this});
+    void *expected = nullptr;
+    if (!event_.state_.compare_exchange_strong(expected, this,
+                                               std::memory_order_acq_rel)) {
+      // Set meanwhile: claim for the event, set() will not see the awaiter.
+      drop++;
+      if (claim(SIGNALED)) {
+        drop += cancel_timer();
+      }
+    } else if (outcome_.load(std::memory_order_acquire) != PENDING &&
+               unlink()) {
+      // Timed out before the awaiter was in the event.
+      drop++;
+    }
+    // Resume now if the other parties are done already.
+    return !release(drop);
+  }
+
+  bool await_resume() const noexcept {
+    INT8U outcome = outcome_.load(std::memory_order_acquire);
+    return outcome == PENDING ? event_.is_set() : outcome == SIGNALED;
+  }
+
+ private:
+  friend class Event;
+
+  static constexpr INT8U PENDING = 0;
+  static constexpr INT8U SIGNALED = 1;
+  static constexpr INT8U TIMED_OUT = 2;
+
+  struct Payload {
+    TimeoutAwaiter *awaiter;
+  };
+
+  bool claim(INT8U outcome) noexcept {
+    INT8U pending = PENDING;
+    return outcome_.compare_exchange_strong(pending, outcome,
+                                            std::memory_order_acq_rel);
+  }
+
+  // Take the awaiter out of the event, true if set() had not taken it.
+  bool unlink() noexcept {
+    void *self = this;
+    return event_.state_.compare_exchange_strong(self, nullptr,
+                                                 std::memory_order_acq_rel);
+  }
+
+  // 1 if the timer will not fire, its reference is dropped by the caller.
+  INT8U cancel_timer() noexcept {
+    INT8U err;
+    if (!RTOSTmrCancel(timer_, &err)) {
+      return 0;
+    }
+    RTOSTmrDel(timer_, &err);
+    return 1;
+  }
+
+  // Drop count references, true (and the coroutine resumed) for the last.
+  bool release(INT8U count) noexcept {
+    return refs_.fetch_sub(count, std::memory_order_acq_rel) == count;
+  }
+
+  void resume() noexcept { resumer_(h_); }
+
+  static void expired(void *arg) noexcept {
+    TimeoutAwaiter *awaiter = static_cast<Payload *>(arg)->awaiter;
+    INT8U drop = 1;
+
+    if (awaiter->claim(TIMED_OUT) && awaiter->unlink()) {
+      drop++;
+    }
+    if (awaiter->release(drop)) {
+      awaiter->resume();
+    }
+  }
+
+  void signaled() noexcept {
+    INT8U drop = 1;
+
+    if (claim(SIGNALED)) {
+      drop += cancel_timer();
+    }
+    if (release(drop)) {
+      resume();
+    }
+  }
+
+  Event &event_;
+  INT32U ticks_;
+  Resumer resumer_;
+  std::coroutine_handle<> h_;
+  RTOS_TMR_HANDLE timer_ = RTOS_TMR_NO_HANDLE;
+  std::atomic<INT8U> outcome_{PENDING};
+  // The coroutine suspending, the timer and the event.
+  std::atomic<INT8U> refs_{3};
+};
+
+inline void Event::set() noexcept {
+  void *waiter = state_.exchange(set_mark(), std::memory_order_acq_rel);
+  if (waiter != nullptr && waiter != set_mark()) {
+    static_cast<TimeoutAwaiter *>(waiter)->signaled();
+  }
+}
+
+/*
+  @ with_timeout().
+  co_await with_timeout(event, d) waits for the event at most d, true if the
+  event was set first. Resumes through resumer.
+*/
+template <class Tick = TickPeriod, class Rep, class Period>
+TimeoutAwaiter with_timeout(Event &event, std::chrono::duration<Rep, Period> d,
+                            Resumer resumer = {}) {
+  static_assert(std::ratio_equal_v<Tick, TickPeriod>,
+                "the library counts ticks of RTOS_CFG_TMR_TASK_RATE");
+  return TimeoutAwaiter(event, to_ticks(d), resumer);
+}
+
+} // namespace rtos
+
+#endif
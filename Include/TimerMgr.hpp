@@ -0,0 +1,186 @@
+// Header-only C++ front-end of the Timer APIs
+#ifndef TIMER_MGR_HPP
+#define TIMER_MGR_HPP
+
+#include "TimerAPI.h"
+#include <chrono>
+#include <ratio>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/*
+  - rtos::Timer<Callable, Tick> owns one timer of the pool. The callable is
+  copied into the timer itself (see RTOSTmrCreatePayload()), so a timer
+  costs no allocation beyond its pool object and the handle moves freely: the
+  callback never points back into the C++ object.
+  - Durations are std::chrono durations, converted to library ticks (of
+  TickPeriod) by to_ticks(), at compile time for constant durations. Tick is
+  only the unit remaining() reports in.
+  - The destructor deletes the timer, RTOSTmrDel() being a no-op on a one shot
+  timer that expired already.
+*/
+
+namespace rtos {
+
+// Period of a tick, the RTOS_CFG_TMR_TASK_RATE ns the library is built with.
+using TickPeriod = std::ratio<RTOS_CFG_TMR_TASK_RATE, 1000000000>;
+
+/*
+  @ to_ticks().
+  Ticks of Tick in a duration, rounded up so no timer expires early. A
+  duration beyond 32 bits of ticks gives 0xFFFFFFFF, which the timer APIs
+  reject as above RTOS_TMR_MAX_TICKS.
+*/
+template <class Tick = TickPeriod, class Rep, class Period>
+constexpr INT32U to_ticks(std::chrono::duration<Rep, Period> d) {
+  INT64U ticks =
+      std::chrono::ceil<std::chrono::duration<INT64U, Tick>>(d).count();
+  return ticks > 0xFFFFFFFFULL ? 0xFFFFFFFFU : static_cast<INT32U>(ticks);
+}
+
+// Failure to create a timer, code() is the RTOS_ERR_TMR_* error code.
+class Error : public std::runtime_error {
+ public:
+  explicit Error(INT8U code)
+      : std::runtime_error("RTOS timer error"), code_(code) {}
+
+  INT8U code() const noexcept { return code_; }
+
+ private:
+  INT8U code_;
+};
+
+template <class Callable, class Tick = TickPeriod> class Timer {
+  static_assert(std::is_invocable_v<Callable &>,
+                "the callable takes no argument");
+  static_assert(std::is_trivially_copyable_v<Callable> &&
+                    std::is_trivially_destructible_v<Callable>,
+                "the callable is copied into the timer: capture pointers or "
+                "references, not objects owning memory");
+  static_assert(sizeof(Callable) <= RTOS_CFG_TMR_PAYLOAD_SIZE,
+                "the callable does not fit in RTOS_CFG_TMR_PAYLOAD_SIZE");
+  static_assert(alignof(Callable) <= alignof(INT64U),
+                "the payload of a timer is 8 byte aligned");
+
+ public:
+  using duration = std::chrono::duration<INT64U, Tick>;
+
+  /*
+    @ Timer().
+    Create a stopped timer calling callable: one shot after delay, or periodic
+    every period if period is not zero (first expiry after delay; with delay
+    zero on the next tick, or at a phase within the first period while
+    RTOSTmrSpreadSet() spreads them). Throws Error if the timer cannot be
+    created.
+  */
+  template <class Rep1, class Period1, class Rep2 = INT64U,
+            class Period2 = Tick>
+  Timer(Callable callable, std::chrono::duration<Rep1, Period1> delay,
+        std::chrono::duration<Rep2, Period2> period = {},
+        const char *name = "timer") {
+    INT32U period_ticks = to_ticks(period);
+    INT8U err;
+
+    handle_ = RTOSTmrCreatePayload(
+        to_ticks(delay), period_ticks,
+        period_ticks ? RTOS_TMR_PERIODIC : RTOS_TMR_ONE_SHOT, &invoke,
+        &callable, sizeof(Callable), const_cast<INT8 *>(name), &err);
+    if (handle_ == RTOS_TMR_NO_HANDLE) {
+      throw Error(err);
+    }
+  }
+
+  Timer(Timer &&other) noexcept
+      : handle_(std::exchange(other.handle_, RTOS_TMR_NO_HANDLE)) {}
+
+  Timer &operator=(Timer &&other) noexcept {
+    if (this != &other) {
+      reset();
+      handle_ = std::exchange(other.handle_, RTOS_TMR_NO_HANDLE);
+    }
+    return *this;
+  }
+
+  Timer(const Timer &) = delete;
+  Timer &operator=(const Timer &) = delete;
+
+  ~Timer() { reset(); }
+
+  // The calls below return the error code of the C API, RTOS_SUCCESS if done.
+  INT8U start() noexcept {
+    INT8U err;
+    RTOSTmrStart(handle_, &err);
+    return err;
+  }
+
+  INT8U stop() noexcept {
+    INT8U err;
+    RTOSTmrStop(handle_, RTOS_TMR_OPT_NONE, nullptr, &err);
+    return err;
+  }
+
+  template <class Rep, class Period>
+  INT8U restart(std::chrono::duration<Rep, Period> delay) noexcept {
+    INT8U err;
+    RTOSTmrRestart(handle_, to_ticks(delay), &err);
+    return err;
+  }
+
+  // Priority class of the timer, RTOS_TMR_PRIO_*, see RTOSTmrPrioSet().
+  INT8U prio(INT8U prio) noexcept {
+    INT8U err;
+    RTOSTmrPrioSet(handle_, prio, &err);
+    return err;
+  }
+
+  duration remaining() const noexcept {
+    INT8U err;
+    std::chrono::duration<INT64U, TickPeriod> ticks(
+        RTOSTmrRemainGet(handle_, &err));
+    return std::chrono::ceil<duration>(ticks);
+  }
+
+  INT8U state() const noexcept {
+    INT8U err;
+    return RTOSTmrStateGet(handle_, &err);
+  }
+
+  RTOS_TMR_HANDLE handle() const noexcept { return handle_; }
+
+  explicit operator bool() const noexcept {
+    return handle_ != RTOS_TMR_NO_HANDLE;
+  }
+
+  /*
+    @ release().
+    Give up the timer without deleting it, e.g. a one shot timer left to
+    expire on its own. Returns its handle.
+  */
+  RTOS_TMR_HANDLE release() noexcept {
+    return std::exchange(handle_, RTOS_TMR_NO_HANDLE);
+  }
+
+  /*
+    @ reset().
+    Delete the timer now, if any.
+  */
+  void reset() noexcept {
+    if (handle_ != RTOS_TMR_NO_HANDLE) {
+      INT8U err;
+      RTOSTmrDel(std::exchange(handle_, RTOS_TMR_NO_HANDLE), &err);
+    }
+  }
+
+ private:
+  // Callback of the C API, the argument is the copy of the callable.
+  static void invoke(void *callable) noexcept {
+    (*static_cast<Callable *>(callable))();
+  }
+
+  RTOS_TMR_HANDLE handle_ = RTOS_TMR_NO_HANDLE;
+};
+
+} // namespace rtos
+
+#endif
@@ -3,12 +3,45 @@
 #define TIMER_MGR_HEADER
 
 #include "TypeDefines.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
 
 // OS Tick Time in ns
 #define RTOS_CFG_TMR_TASK_RATE 100000000
 
-// Lets assume RTOS Timer Type = 20
-#define RTOS_TMR_TYPE 20
+// Tickless mode: instead of a periodic tick every RTOS_CFG_TMR_TASK_RATE the OS
+// timer is armed one shot for the next tick that has work in the timing wheel.
+#ifndef RTOS_CFG_TMR_TICKLESS_EN
+#define RTOS_CFG_TMR_TICKLESS_EN 0
+#endif
+
+// Event loop mode: no SIGALRM and no timer tasks. The ticks come from timerfds
+// and wakeups from an eventfd, all behind one epoll fd (RTOSTmrFdGet()) that
+// the application polls, calling RTOSTmrProcess() when it is readable.
+#ifndef RTOS_CFG_TMR_EVENT_LOOP_EN
+#define RTOS_CFG_TMR_EVENT_LOOP_EN 0
+#endif
+
+// Log levels: messages above RTOS_CFG_TMR_LOG_LEVEL are compiled out, their
+// arguments are not even evaluated. Errors of the API calls, the start-up
+// report and the per-call debug trail of the pool and the API, in that order.
+#define RTOS_TMR_LOG_NONE 0
+#define RTOS_TMR_LOG_ERROR 1
+#define RTOS_TMR_LOG_INFO 2
+#define RTOS_TMR_LOG_DEBUG 3
+#ifndef RTOS_CFG_TMR_LOG_LEVEL
+#define RTOS_CFG_TMR_LOG_LEVEL RTOS_TMR_LOG_INFO
+#endif
+#define RTOS_TMR_LOG(level, ...)                                               \
+  do {                                                                         \
+    if (RTOS_CFG_TMR_LOG_LEVEL >= (level)) {                                   \
+      fprintf(stdout, __VA_ARGS__);                                            \
+    }                                                                          \
+  } while (0)
+#define RTOS_TMR_ERR(...) RTOS_TMR_LOG(RTOS_TMR_LOG_ERROR, __VA_ARGS__)
+#define RTOS_TMR_INFO(...) RTOS_TMR_LOG(RTOS_TMR_LOG_INFO, __VA_ARGS__)
+#define RTOS_TMR_DEBUG(...) RTOS_TMR_LOG(RTOS_TMR_LOG_DEBUG, __VA_ARGS__)
 
 // RTOS SUCCESS/FAILURE
 #define RTOS_FALSE 0
@@ -19,10 +52,32 @@
 #define RTOS_TMR_STATE_STOPPED 2
 #define RTOS_TMR_STATE_RUNNING 3
 #define RTOS_TMR_STATE_COMPLETED 4
+// Deleted, not yet back in the pool: RTOSTmrStateGet() reports it as
+// RTOS_TMR_STATE_UNUSED and every call on it fails as on a stale handle.
+#define RTOS_TMR_STATE_DELETING 5
 
 // RTOS Timer Options
 #define RTOS_TMR_ONE_SHOT 1
 #define RTOS_TMR_PERIODIC 2
+#define RTOS_TMR_OPT_TYPE_MASK 0x0F
+
+// RTOS Timer Priority Classes. The expiries of a tick are dispatched highest
+// class first. A class is given at create by OR'ing RTOS_TMR_OPT_PRIO(class)
+// into the option, or later by RTOSTmrPrioSet().
+#define RTOS_TMR_PRIO_NORMAL 0 /* Default */
+#define RTOS_TMR_PRIO_HIGH 1
+#define RTOS_TMR_PRIO_URGENT 2
+#define RTOS_TMR_PRIO_CRITICAL 3
+#define RTOS_TMR_PRIO_CLASSES 4
+#define RTOS_TMR_OPT_PRIO_SHIFT 4
+#define RTOS_TMR_OPT_PRIO(prio) ((prio) << RTOS_TMR_OPT_PRIO_SHIFT)
+
+// RTOS Timer Phase Spreading, see RTOSTmrSpreadSet(). A Periodic timer started
+// with delay 0 takes its first expiry in [0, period) from its pool id
+// (RTOS_TMR_SPREAD_HASH) or from a random number (RTOS_TMR_SPREAD_RANDOM).
+#define RTOS_TMR_SPREAD_OFF 0 /* Default */
+#define RTOS_TMR_SPREAD_HASH 1
+#define RTOS_TMR_SPREAD_RANDOM 2
 
 // Error Code
 #define RTOS_ERR_NONE 0
@@ -38,36 +93,310 @@
 #define RTOS_ERR_TMR_INVALID 9
 #define RTOS_ERR_TMR_STOPPED 10
 #define RTOS_ERR_TMR_NO_CALLBACK 11
+#define RTOS_ERR_TMR_INVALID_SHARD 12
+#define RTOS_ERR_TMR_INVALID_SLACK 13
+#define RTOS_ERR_TMR_INVALID_STORE 14
+#define RTOS_ERR_TMR_EVENT_FD 15
+#define RTOS_ERR_TMR_TICK_RUNNING 16
+#define RTOS_ERR_TMR_TRACE 17
+#define RTOS_ERR_TMR_PERSIST 18
+#define RTOS_ERR_TMR_CALLBACK_ID 19
+#define RTOS_ERR_TMR_INVALID_PRIO 20
+#define RTOS_ERR_TMR_INVALID_SPREAD 21
+
+// Sharding: RTOSTmrInit() creates shard_count shards (0 for one per online
+// CPU), each with its own timing wheel, lock and timer task. A timer stays on
+// the shard of the thread that created it. With RTOS_CFG_TMR_SHARD_PIN_EN the
+// timer task of shard n is pinned to CPU n modulo the online CPUs.
+#define RTOS_CFG_TMR_MAX_SHARDS 256
+#ifndef RTOS_CFG_TMR_SHARD_PIN_EN
+#define RTOS_CFG_TMR_SHARD_PIN_EN 0
+#endif
+
+// Command queue: RTOSTmrStart/Stop/Del push commands into a lock-free ring of
+// RTOS_CFG_TMR_CMD_QUEUE_SIZE entries (power of 2), which the timer task
+// applies to the wheel in one batch at the start of each tick.
+// 0 makes the API update the wheel directly under the shard mutex.
+#ifndef RTOS_CFG_TMR_CMD_QUEUE_SIZE
+#define RTOS_CFG_TMR_CMD_QUEUE_SIZE 0
+#endif
+
+// Lazy cancellation: RTOSTmrStop() only marks a running timer STOPPED, in O(1)
+// and without the shard mutex, and leaves it linked as a tombstone. The timer
+// task drops tombstones when it reaches their slot, and unlinks all of them in
+// one pass over the wheel once there are RTOS_CFG_TMR_COMPACT_MIN or more and
+// they are over half of the linked timers, at most once per turn of level 0.
+// The command queue already stops timers without the mutex, so it turns lazy
+// cancellation off.
+#ifndef RTOS_CFG_TMR_LAZY_CANCEL_EN
+#define RTOS_CFG_TMR_LAZY_CANCEL_EN 0
+#endif
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+#undef RTOS_CFG_TMR_LAZY_CANCEL_EN
+#define RTOS_CFG_TMR_LAZY_CANCEL_EN 0
+#endif
+#define RTOS_CFG_TMR_COMPACT_MIN 64
+
+// Callback executor: RTOS_CFG_TMR_EXEC_THREADS worker threads run the callbacks
+// of timers set to RTOS_TMR_EXEC_POOL (the default when enabled), so the timer
+// task only detects expiries. Every worker has a ring of
+// RTOS_CFG_TMR_EXEC_QUEUE_SIZE jobs (power of 2) and idle workers steal from
+// the rings of the others. 0 runs every callback inline in the timer task.
+#ifndef RTOS_CFG_TMR_EXEC_THREADS
+#define RTOS_CFG_TMR_EXEC_THREADS 0
+#endif
+#define RTOS_CFG_TMR_EXEC_QUEUE_SIZE 1024
+
+// Tick budget: once the callbacks of a tick have run for
+// RTOS_CFG_TMR_TICK_BUDGET_NS, the expiries left below class
+// RTOS_CFG_TMR_BUDGET_PRIO wait for the next tick, ahead of its own expiries
+// of the same class. 0 runs every expiry on its tick, see RTOSTmrBudgetSet().
+#ifndef RTOS_CFG_TMR_TICK_BUDGET_NS
+#define RTOS_CFG_TMR_TICK_BUDGET_NS 0
+#endif
+#ifndef RTOS_CFG_TMR_BUDGET_PRIO
+#define RTOS_CFG_TMR_BUDGET_PRIO RTOS_TMR_PRIO_HIGH
+#endif
+
+// Phase spreading of the Periodic timers started with delay 0, one of
+// RTOS_TMR_SPREAD_*, see RTOSTmrSpreadSet().
+#ifndef RTOS_CFG_TMR_SPREAD_MODE
+#define RTOS_CFG_TMR_SPREAD_MODE RTOS_TMR_SPREAD_OFF
+#endif
+
+// Expired timers of a tick: the dispatch array of a shard, and its scratch
+// array, start with RTOS_TMR_DUE_INIT_SIZE entries and double when full.
+#define RTOS_TMR_DUE_INIT_SIZE 256
+
+// Batch APIs process the timers in chunks of RTOS_TMR_BATCH_CHUNK, one lock
+// acquisition per chunk and shard.
+#define RTOS_TMR_BATCH_CHUNK 256
+
+// Statistics: every shard keeps lock-free log-linear histograms of the expiry
+// lateness, the tick processing time and the timers expired per tick, read
+// with RTOSTmrStatsGet(). 0 removes them and their clock reads.
+#ifndef RTOS_CFG_TMR_STATS_EN
+#define RTOS_CFG_TMR_STATS_EN 1
+#endif
+// Every power of 2 is split in 2^RTOS_TMR_HIST_SUB_BITS buckets, so a value is
+// known within 12.5%.
+#define RTOS_TMR_HIST_SUB_BITS 3
+#define RTOS_TMR_HIST_BUCKETS (64 << RTOS_TMR_HIST_SUB_BITS)
+
+// Callback profiling: every callback run is timed and added up per timer name
+// in a table of RTOS_CFG_TMR_PROFILE_SIZE names (power of 2). Callbacks taking
+// longer than RTOS_CFG_TMR_SLOW_CB_NS (see RTOSTmrSlowThresholdSet()) are kept
+// in a ring of the last RTOS_CFG_TMR_SLOW_RING_SIZE, and a watchdog thread
+// reports callbacks still running after RTOS_CFG_TMR_WATCHDOG_TICKS ticks
+// (0, the default, for no watchdog: it wakes every tick, even when idle).
+// RTOS_CFG_TMR_PROFILE_EN 0 removes the profiling and its clock reads.
+#ifndef RTOS_CFG_TMR_PROFILE_EN
+#define RTOS_CFG_TMR_PROFILE_EN 1
+#endif
+#define RTOS_CFG_TMR_PROFILE_SIZE 256
+#ifndef RTOS_CFG_TMR_SLOW_CB_NS
+#define RTOS_CFG_TMR_SLOW_CB_NS 1000000
+#endif
+#define RTOS_CFG_TMR_SLOW_RING_SIZE 64
+#ifndef RTOS_CFG_TMR_WATCHDOG_TICKS
+#define RTOS_CFG_TMR_WATCHDOG_TICKS 0
+#endif
+#define RTOS_TMR_PROFILE_NAME_LEN 32
+
+// Trace: every thread records the create, start, stop, delete and expiry of
+// its timers as 16 byte binary events in its own ring of
+// RTOS_CFG_TMR_TRACE_SIZE events (power of 2), without a lock or a clock read.
+// While RTOSTmrTraceStart() runs, a drainer thread writes the rings to a file
+// every RTOS_CFG_TMR_TRACE_DRAIN_NS, read back with TimerTraceDump. A full ring
+// drops events and counts them. 0 removes the trace points.
+#ifndef RTOS_CFG_TMR_TRACE_EN
+#define RTOS_CFG_TMR_TRACE_EN 0
+#endif
+#ifndef RTOS_CFG_TMR_TRACE_SIZE
+#define RTOS_CFG_TMR_TRACE_SIZE 4096
+#endif
+#ifndef RTOS_CFG_TMR_TRACE_DRAIN_NS
+#define RTOS_CFG_TMR_TRACE_DRAIN_NS 10000000
+#endif
+
+// Persistence: RTOSTmrPersistOpen(), before RTOSTmrInit(), puts the timer
+// pool in a file mapped into memory, so a restarted process finds its timers
+// in place and only relinks them, deadlines rebased on the wall clock. Function
+// addresses change from one run to the next, so a timer is restored through
+// the id its callback got from RTOSTmrCallbackRegister(), below
+// RTOS_CFG_TMR_CALLBACK_IDS. 0 keeps the pool in the heap.
+#ifndef RTOS_CFG_TMR_PERSIST_EN
+#define RTOS_CFG_TMR_PERSIST_EN 0
+#endif
+#define RTOS_CFG_TMR_CALLBACK_IDS 256
+
+// Callback runners: shard n is runner n, executor worker n is runner
+// RTOS_CFG_TMR_MAX_SHARDS + n. Callbacks run by RTOSTmrStop() have none.
+#define RTOS_TMR_RUNNERS (RTOS_CFG_TMR_MAX_SHARDS + RTOS_CFG_TMR_EXEC_THREADS)
+#define RTOS_TMR_NO_RUNNER 0xFFFFFFFF
+
+// Command Queue Operations
+#define RTOS_TMR_CMD_START 1
+#define RTOS_TMR_CMD_STOP 2
+#define RTOS_TMR_CMD_DEL 3
+#define RTOS_TMR_CMD_EXEC 4
+
+// Trace Events
+#define RTOS_TMR_TRACE_CREATE 1 /* arg = Delay */
+#define RTOS_TMR_TRACE_START 2  /* arg = Delay of this start */
+#define RTOS_TMR_TRACE_STOP 3
+#define RTOS_TMR_TRACE_DEL 4
+#define RTOS_TMR_TRACE_EXPIRE 5 /* arg = RTOSTmrMatch */
+#define RTOS_TMR_TRACE_DROP 6   /* arg = events lost to a full ring */
+
+// Trace File
+// A RTOS_TMR_TRACE_HEADER followed by RTOS_TMR_TRACE_EVENTs, in order per
+// thread and in batches across threads.
+#define RTOS_TMR_TRACE_MAGIC "TMRTRACE"
+#define RTOS_TMR_TRACE_VERSION 1
+
+// Persisted Pool File
+// A RTOS_TMR_PERSIST_HEADER padded to RTOS_TMR_PERSIST_HEADER_BYTES, then for
+// every chunk of the pool its timers and their cold fields. The file is mapped
+// over RTOS_TMR_PERSIST_MAX_BYTES of address space, the largest pool, and
+// grows with the pool.
+#define RTOS_TMR_PERSIST_MAGIC "TMRSTATE"
+#define RTOS_TMR_PERSIST_VERSION 1
+#define RTOS_TMR_PERSIST_HEADER_BYTES 65536
+#define RTOS_TMR_PERSIST_CHUNK_BYTES                                           \
+  (RTOS_TMR_CHUNK_BYTES + RTOS_TMR_COLD_CHUNK_BYTES)
+#define RTOS_TMR_PERSIST_MAX_BYTES                                             \
+  (RTOS_TMR_PERSIST_HEADER_BYTES +                                             \
+   (INT64U)RTOS_CFG_TMR_POOL_MAX_CHUNKS * RTOS_TMR_PERSIST_CHUNK_BYTES)
+
+// RTOS Timer Callback Execution
+#define RTOS_TMR_EXEC_INLINE 1
+#define RTOS_TMR_EXEC_POOL 2
+
+// RTOS Timer Flags
+#define RTOS_TMR_FLAG_POOL 0x01  /* Callback runs on the executor */
+#define RTOS_TMR_FLAG_BUSY 0x02  /* Queued or running on the executor */
+#define RTOS_TMR_FLAG_AGAIN 0x04 /* Expired again while busy, run once more */
+#define RTOS_TMR_FLAG_FREE 0x08  /* Deleted while busy, executor frees it */
+#define RTOS_TMR_FLAG_SLACK 0x10 /* Slack moved RTOSTmrMatch, the deadline
+                                    is RTOSTmrDeadline */
 
 // RTOS Stop Options
 #define RTOS_TMR_OPT_NONE 1
 #define RTOS_TMR_OPT_CALLBACK 2
 #define RTOS_TMR_OPT_CALLBACK_ARG 3
 
-#define HASH_TABLE_SIZE 10
+// Hierarchical Timing Wheel
+// Level 0 has one slot per tick, every further level has
+// RTOS_TMR_WHEEL_LN_SIZE slots each spanning a whole turn of the level below.
+// 8 + 4 * 6 bits covers the full INT32U tick range.
+#define RTOS_TMR_WHEEL_L0_BITS 8
+#define RTOS_TMR_WHEEL_LN_BITS 6
+#define RTOS_TMR_WHEEL_LEVELS 5
+#define RTOS_TMR_WHEEL_L0_SIZE (1U << RTOS_TMR_WHEEL_L0_BITS)
+#define RTOS_TMR_WHEEL_LN_SIZE (1U << RTOS_TMR_WHEEL_LN_BITS)
+#define RTOS_TMR_WHEEL_SLOTS                                                   \
+  (RTOS_TMR_WHEEL_L0_SIZE +                                                    \
+   (RTOS_TMR_WHEEL_LEVELS - 1) * RTOS_TMR_WHEEL_LN_SIZE)
+
+// RTOSTmrSlot value of a Timer that is not linked in the timer store
+#define RTOS_TMR_WHEEL_NO_SLOT 0xFFFF
+
+// Timer Stores, the structure a shard keeps its running timers in, chosen by
+// RTOSTmrInit()
+#define RTOS_TMR_STORE_WHEEL 1 /* Hierarchical timing wheel */
+#define RTOS_TMR_STORE_HEAP 2  /* 4-ary min-heap on the deadline */
+
+// 4-ary Min-Heap
+// Children of entry i are 4 * i + 1 to 4 * i + 4. The heap array starts at
+// RTOS_TMR_HEAP_INIT_SIZE entries and doubles when full.
+#define RTOS_TMR_HEAP_ARITY 4
+#define RTOS_TMR_HEAP_INIT_SIZE 1024
+
+// Largest Delay/Period in ticks, later deadlines would look already expired
+#define RTOS_TMR_MAX_TICKS 0x7FFFFFFF
+
+// Most ticks RTOSTmrAdvance() processes in one step, far enough below
+// 2^31 that the wrap-safe tick compares hold across the step
+#define RTOS_TMR_ADVANCE_STEP 0x40000000
+
+// Timer slack: a timer with slack may expire up to RTOSTmrSlack ticks late, so
+// its deadline can be moved onto a tick that already has expiries, see
+// RTOSTmrSlackSet(). At most one turn of wheel level 0.
+#define RTOS_TMR_MAX_SLACK (RTOS_TMR_WHEEL_L0_SIZE - 1)
+
+// Timer Handles
+// The API names a timer by a handle: its pool id in the low
+// RTOS_TMR_HANDLE_ID_BITS bits and a generation in the bits above. The
+// generation moves on every time the timer goes back to the pool, so a handle
+// kept after RTOSTmrDel() (or the end of a one shot timer) no longer matches
+// and is rejected in O(1). It skips 0, so 0 is never a handle.
+typedef INT32U RTOS_TMR_HANDLE;
+#define RTOS_TMR_HANDLE_ID_BITS 22
+#define RTOS_TMR_HANDLE_ID_MASK ((1U << RTOS_TMR_HANDLE_ID_BITS) - 1)
+#define RTOS_TMR_HANDLE_GEN_ONE (1U << RTOS_TMR_HANDLE_ID_BITS)
+#define RTOS_TMR_HANDLE_ID(handle) ((handle) & RTOS_TMR_HANDLE_ID_MASK)
+#define RTOS_TMR_NO_HANDLE 0
+// No timer, as a pool id
+#define RTOS_TMR_NO_ID 0xFFFFFFFF
+
+// Timer Pool
+// Timers are carved out of cache line aligned chunks of
+// RTOS_CFG_TMR_POOL_CHUNK_SIZE contiguous timers. The pool grows by a chunk
+// whenever it runs dry, up to RTOS_CFG_TMR_POOL_MAX_CHUNKS chunks (4M timers,
+// every pool id must fit in a handle).
+#define RTOS_CFG_TMR_POOL_CHUNK_BITS 10
+#define RTOS_CFG_TMR_POOL_CHUNK_SIZE (1U << RTOS_CFG_TMR_POOL_CHUNK_BITS)
+#define RTOS_CFG_TMR_POOL_MAX_CHUNKS                                           \
+  (1U << (RTOS_TMR_HANDLE_ID_BITS - RTOS_CFG_TMR_POOL_CHUNK_BITS))
+
+// Per-thread cache (magazine) of free timer ids in front of the pool. Refilled
+// from and flushed to the pool RTOS_CFG_TMR_CACHE_SIZE / 2 ids at a time.
+// 0 disables the caches.
+#ifndef RTOS_CFG_TMR_CACHE_SIZE
+#define RTOS_CFG_TMR_CACHE_SIZE 64
+#endif
+#define RTOS_CACHE_LINE_SIZE 64
+// Bytes of callback argument a timer can hold itself, see
+// RTOSTmrCreatePayload(). The default fills the cold fields of a timer up to
+// one cache line; 0 keeps no payload.
+#ifndef RTOS_CFG_TMR_PAYLOAD_SIZE
+#define RTOS_CFG_TMR_PAYLOAD_SIZE 32
+#endif
+// Bytes of a chunk of timers and of the matching chunk of their cold fields,
+// rounded up to whole cache lines.
+#define RTOS_TMR_CHUNK_BYTES                                                   \
+  ((RTOS_CFG_TMR_POOL_CHUNK_SIZE * sizeof(RTOS_TMR) + RTOS_CACHE_LINE_SIZE -   \
+    1) / RTOS_CACHE_LINE_SIZE * RTOS_CACHE_LINE_SIZE)
+#define RTOS_TMR_COLD_CHUNK_BYTES                                              \
+  ((RTOS_CFG_TMR_POOL_CHUNK_SIZE * sizeof(RTOS_TMR_COLD) +                     \
+    RTOS_CACHE_LINE_SIZE - 1) / RTOS_CACHE_LINE_SIZE * RTOS_CACHE_LINE_SIZE)
 
 // Timer Callback
 typedef void (*RTOS_TMR_CALLBACK)(void *p_arg);
 
 // OS Timer Object Structure
+// What the timer store, the API and the tick walk through, packed into 32
+// bytes so two timers share a cache line: the wheel links timers by pool id
+// rather than by pointer. The rest lives in RTOS_TMR_COLD.
 typedef struct os_timer {
-  INT8U RTOSTmrType; /* Should Always be set to RTOS_TMR_TYPE for Timers*/
-
-  RTOS_TMR_CALLBACK RTOSTmrCallback; /* Function to call when Timer Expires */
-
-  void *RTOSTmrCallbackArg; /* Callback Function Arguments */
-
-  struct os_timer *RTOSTmrNext; /* Double Link List Pointers */
-  struct os_timer *RTOSTmrPrev;
+  union {
+    struct {
+      INT32U RTOSTmrNext; /* Double Link List, pool ids (wheel) */
+      INT32U RTOSTmrPrev;
+    };
+    INT32U RTOSTmrIndex; /* Position in the heap array (heap) */
+  };
 
-  INT32U RTOSTmrMatch; /* Timer Expires when RTOSTmrTickCtr = RTOSTmrMatch */
+  INT32U RTOSTmrMatch; /* Timer Expires when the shard tick = RTOSTmrMatch */
 
   INT32U RTOSTmrDelay; /* One Shot Timer - Time for one shot, Periodic Timer -
                           Delay before periodic update starts */
 
   INT32U RTOSTmrPeriod; /* Period to repeat Timer*/
 
-  INT8 *RTOSTmrName; /* Name to give to the Timer */
+  RTOS_TMR_HANDLE RTOSTmrHandle; /* Handle of the Timer, pool id and
+                                    generation */
 
   INT8U RTOSTmrOpt; /* Timer Options */
 
@@ -75,13 +404,318 @@ typedef struct os_timer {
                          RTOS_TMR_STATE_UNUSED
                          RTOS_TMR_STATE_STOPPED
                          RTOS_TMR_STATE_RUNNING
-                         RTOS_TMR_STATE_COMPLETED	*/
+                         RTOS_TMR_STATE_COMPLETED
+                         RTOS_TMR_STATE_DELETING	*/
+
+  INT8U RTOSTmrFlags; /* RTOS_TMR_FLAG_* */
+
+  INT8U RTOSTmrShard; /* Shard the Timer runs on */
+
+  INT8U RTOSTmrSlack; /* Ticks the expiry may be delayed to coalesce it */
+
+  INT8U RTOSTmrPrio; /* Priority class, RTOS_TMR_PRIO_* */
+
+  INT16U RTOSTmrSlot; /* Wheel slot the Timer is linked in (0 in the heap),
+                         RTOS_TMR_WHEEL_NO_SLOT if not running */
 } RTOS_TMR;
 
-// Hash Table Entry Structure
-typedef struct hash_obj {
-  INT8U timer_count;
-  RTOS_TMR *list_ptr;
-} HASH_OBJ;
+// Cold fields of a Timer, only read to run its callback. Kept in chunks
+// parallel to the timer chunks, at the same pool id.
+typedef struct os_timer_cold {
+  RTOS_TMR_CALLBACK RTOSTmrCallback; /* Function to call when Timer Expires */
+
+  void *RTOSTmrCallbackArg; /* Callback Function Arguments */
+
+  INT8 *RTOSTmrName; /* Name to give to the Timer */
+
+  INT32U RTOSTmrDeadline; /* RTOSTmrMatch before the slack moved it, valid
+                             with RTOS_TMR_FLAG_SLACK */
+
+#if RTOS_CFG_TMR_PAYLOAD_SIZE
+  INT64U RTOSTmrPayload[(RTOS_CFG_TMR_PAYLOAD_SIZE + 7) / 8]; /* Copy of the
+                        callback argument, RTOSTmrCallbackArg points to it */
+#endif
+} RTOS_TMR_COLD;
+
+// Timer Batch Create Element, the arguments of RTOSTmrCreate()
+typedef struct rtos_tmr_spec {
+  INT32U delay;
+  INT32U period;
+  INT8U option;
+  RTOS_TMR_CALLBACK callback;
+  void *callback_arg;
+  INT8 *name;
+  INT32U payload_size; /* 0: callback_arg is passed as is, else the bytes it
+                          points to, see RTOSTmrCreatePayload() */
+} RTOS_TMR_SPEC;
+
+// Timer Batch Entry, a timer and the ticks until it expires
+typedef struct tmr_batch_entry {
+  INT32U dist;
+  RTOS_TMR_HANDLE handle;
+  RTOS_TMR *timer;
+} TMR_BATCH_ENTRY;
+
+// Timer Pool Information
+typedef struct rtos_tmr_pool_info {
+  INT32U pool_size;       /* Timers carved out of the chunks so far */
+  INT32U free_count;      /* Timers free in the pool, without thread caches */
+  INT32U chunk_count;     /* Chunks allocated */
+  INT64U pool_bytes;      /* Chunks plus free index stack */
+  INT32U bytes_per_timer; /* pool_bytes / pool_size */
+} RTOS_TMR_POOL_INFO;
+
+// Per-thread Timer Cache Structure
+typedef struct tmr_cache {
+  INT32U count;
+  INT8U registered; /* Flushed to the pool when the thread exits */
+  INT32U id[RTOS_CFG_TMR_CACHE_SIZE];
+} TMR_CACHE;
+
+// Timer Command Structure
+typedef struct tmr_cmd {
+  RTOS_TMR *timer;
+  INT32U match; /* RTOSTmrMatch to apply for RTOS_TMR_CMD_START */
+  RTOS_TMR_HANDLE handle; /* Stale once the timer went back to the pool */
+  INT8U op;
+} TMR_CMD;
+
+// Bounded Lock-free Ring Structure
+// Every cell carries a sequence number telling producers and consumers whose
+// turn it is, so head and tail are the only contended words.
+typedef struct tmr_ring_cell {
+  INT32U seq;
+  TMR_CMD cmd;
+} TMR_RING_CELL;
+
+typedef struct tmr_ring {
+  INT32U head __attribute__((aligned(RTOS_CACHE_LINE_SIZE))); /* producers */
+  INT32U tail __attribute__((aligned(RTOS_CACHE_LINE_SIZE))); /* consumers */
+  INT32U mask;
+  TMR_RING_CELL *cell;
+} TMR_RING;
+
+// Command Queue Statistics
+typedef struct rtos_tmr_queue_stats {
+  INT32U depth;          /* Commands waiting now */
+  INT32U max_depth;      /* Most commands applied by one drain */
+  INT64U applied;        /* Commands applied */
+  INT64U drains;         /* Drains that found commands */
+  INT64U overflows;      /* Pushes that found the queue full */
+  INT64U last_drain_ns;  /* Duration of the last drain */
+  INT64U max_drain_ns;   /* Longest drain */
+  INT64U total_drain_ns; /* Sum of all drains */
+} RTOS_TMR_QUEUE_STATS;
+
+// Trace Event, as recorded and as written to the trace file
+typedef struct rtos_tmr_trace_event {
+  INT32U tick;   /* Tick of the timer's shard when it happened */
+  INT32U id;     /* RTOSTmrHandle of the timer */
+  INT32U arg;    /* See RTOS_TMR_TRACE_* */
+  INT16U thread; /* Ring it was recorded in, one per thread */
+  INT8U event;   /* RTOS_TMR_TRACE_* */
+  INT8U shard;   /* Shard of the timer */
+} RTOS_TMR_TRACE_EVENT;
+
+// Trace File Header
+typedef struct rtos_tmr_trace_header {
+  INT8 magic[8];     /* RTOS_TMR_TRACE_MAGIC, not terminated */
+  INT32U version;    /* RTOS_TMR_TRACE_VERSION */
+  INT32U event_size; /* sizeof(RTOS_TMR_TRACE_EVENT) */
+  INT64U tick_ns;    /* RTOS_CFG_TMR_TASK_RATE */
+} RTOS_TMR_TRACE_HEADER;
+
+// Per-thread Trace Ring
+// Single producer (the owning thread) and single consumer (the drainer), so
+// head and tail are plain counters on their own cache lines.
+typedef struct tmr_trace_ring {
+  INT64U head __attribute__((aligned(RTOS_CACHE_LINE_SIZE))); /* owner */
+  INT64U dropped; /* Events lost to a full ring, owner */
+  INT64U tail __attribute__((aligned(RTOS_CACHE_LINE_SIZE))); /* drainer */
+  INT64U dropped_seen;  /* dropped already written, drainer */
+  INT16U thread;        /* RTOS_TMR_TRACE_EVENT thread */
+  INT8U closed;         /* Owner exited, freed once drained */
+  struct tmr_trace_ring *next;
+  RTOS_TMR_TRACE_EVENT event[RTOS_CFG_TMR_TRACE_SIZE];
+} TMR_TRACE_RING;
+
+// Persisted Shard Clock, the tick of a shard at a wall clock time
+typedef struct rtos_tmr_persist_clock {
+  INT64U wall_ns; /* CLOCK_REALTIME, 0 if never set */
+  INT32U tick;    /* Tick counter of the shard then */
+  INT32U pad;
+} RTOS_TMR_PERSIST_CLOCK;
+
+// Persisted Pool File Header
+typedef struct rtos_tmr_persist_header {
+  INT8 magic[8];      /* RTOS_TMR_PERSIST_MAGIC, not terminated */
+  INT32U version;     /* RTOS_TMR_PERSIST_VERSION */
+  INT32U timer_size;  /* sizeof(RTOS_TMR) */
+  INT32U cold_size;   /* sizeof(RTOS_TMR_COLD) */
+  INT32U chunk_size;  /* RTOS_CFG_TMR_POOL_CHUNK_SIZE */
+  INT64U tick_ns;     /* RTOS_CFG_TMR_TASK_RATE */
+  INT64U base;        /* Address the file is mapped at */
+  INT32U chunk_count; /* Chunks of the pool in the file */
+  INT32U shard_count; /* Shards of the process */
+  RTOS_TMR_PERSIST_CLOCK clock[RTOS_CFG_TMR_MAX_SHARDS]; /* Per shard, last
+                                                            tick processed */
+  INT64U callback[RTOS_CFG_TMR_CALLBACK_IDS]; /* Address of the callback of
+                                                 every id, 0 if none */
+} RTOS_TMR_PERSIST_HEADER;
+
+// Persisted Pool Information, see RTOSTmrPersistInfoGet()
+typedef struct rtos_tmr_persist_info {
+  INT32U restored;   /* Timers found in the file and kept */
+  INT32U overdue;    /* Of which came due while no process ran them */
+  INT32U dropped;    /* Timers freed, their callback had no id */
+  INT64U restore_ns; /* Time taken to relink the timers */
+  INT64U file_bytes; /* Size of the file */
+} RTOS_TMR_PERSIST_INFO;
+
+// Log-linear (HDR style) Histogram
+typedef struct rtos_tmr_hist {
+  INT64U count; /* Values recorded */
+  INT64U sum;   /* Sum of the values */
+  INT64U max;   /* Largest value */
+  INT64U bucket[RTOS_TMR_HIST_BUCKETS];
+} RTOS_TMR_HIST;
+
+// Timer Manager Statistics
+typedef struct rtos_tmr_stats {
+  RTOS_TMR_HIST lateness;     /* ns from deadline to callback dispatch */
+  RTOS_TMR_HIST prio_lateness[RTOS_TMR_PRIO_CLASSES]; /* lateness per class */
+  RTOS_TMR_HIST tick_time;    /* ns to process one tick */
+  RTOS_TMR_HIST tick_expired; /* Timers expired per processed tick */
+  INT64U budget_deferred;     /* Expiries the tick budget held back, once
+                                 per tick they waited */
+  INT32U pool_low_water;      /* Fewest free timers left in the pool */
+  INT64U slack_placed;        /* Deadlines placed using the timer slack */
+  INT64U slack_coalesced;     /* Of which moved onto a tick with expiries */
+  double coalesce_ratio;      /* Expiries per tick that had any */
+  INT32U tombstones;          /* Stopped timers still linked in the wheels */
+  INT64U compactions;         /* Wheel passes that unlinked the tombstones */
+} RTOS_TMR_STATS;
+
+// Callback Profile of the timers with one name
+typedef struct rtos_tmr_profile {
+  INT8 name[RTOS_TMR_PROFILE_NAME_LEN];
+  INT64U count;    /* Callbacks run */
+  INT64U total_ns; /* Time spent in the callbacks */
+  INT64U max_ns;   /* Longest callback */
+  INT64U slow;     /* Callbacks over the slow threshold */
+  INT64U stalls;   /* Callbacks reported by the watchdog */
+} RTOS_TMR_PROFILE;
+
+// Slow Callback Record
+typedef struct rtos_tmr_slow_cb {
+  INT8 name[RTOS_TMR_PROFILE_NAME_LEN];
+  INT32U id;          /* RTOSTmrHandle of the timer */
+  INT32U runner;      /* Runner of the callback, see RTOS_TMR_RUNNERS */
+  INT64U start_ns;    /* CLOCK_MONOTONIC at the callback start */
+  INT64U duration_ns; /* Callback run time */
+} RTOS_TMR_SLOW_CB;
+
+// Running Callback of a Runner, watched by the watchdog
+typedef struct __attribute__((aligned(RTOS_CACHE_LINE_SIZE))) tmr_cb_run {
+  INT64U start_ns; /* CLOCK_MONOTONIC at the callback start, 0 if idle */
+  INT8 *name;      /* RTOSTmrName of the timer */
+  INT32U id;       /* RTOSTmrHandle of the timer */
+  INT32U seq;      /* Callbacks started */
+  INT32U flagged;  /* seq of the last callback the watchdog reported */
+} TMR_CB_RUN;
+
+// Timing Wheel Slot Structure
+typedef struct wheel_slot {
+  INT32U timer_count;
+  INT32U list_id; /* Pool id of the first timer, RTOS_TMR_NO_ID if none */
+} WHEEL_SLOT;
+
+struct tmr_shard;
+
+// Timer Store Operations
+// - Every timer store implements these, all are called with the shard mutex
+// held. busy_tick may be NULL.
+// - insert links a timer at its RTOSTmrMatch and sets RTOSTmrSlot, remove
+// unlinks a linked timer and sets RTOSTmrSlot to RTOS_TMR_WHEEL_NO_SLOT.
+// - begin_tick prepares the expiries of shard->tick, pop_expired then unlinks
+// and returns them one by one (NULL when none is left).
+// - next_deadline finds the next tick with work, busy_tick the first tick in
+// [match, match + slack] that already has expiries.
+// - begin_tick and compact may unlink tombstones (stopped timers left linked,
+// see RTOS_CFG_TMR_LAZY_CANCEL_EN) and return how many.
+// - lazy_rearm is set if RTOSTmrMatch of a linked timer may move later
+// without the mutex: pop_expired then moves the timer on instead of returning
+// it, see RTOSTmrRestartLazy().
+typedef struct tmr_store_ops {
+  const char *name;
+  INT8U lazy_rearm;
+  INT8U (*init)(struct tmr_shard *shard);
+  void (*destroy)(struct tmr_shard *shard);
+  INT8U (*insert)(struct tmr_shard *shard, RTOS_TMR *timer);
+  void (*remove)(struct tmr_shard *shard, RTOS_TMR *timer);
+  INT32U (*begin_tick)(struct tmr_shard *shard);
+  RTOS_TMR *(*pop_expired)(struct tmr_shard *shard);
+  INT8U (*next_deadline)(struct tmr_shard *shard, INT32U *deadline);
+  INT8U (*busy_tick)(struct tmr_shard *shard, INT32U match, INT32U slack,
+                     INT32U *tick);
+  INT32U (*compact)(struct tmr_shard *shard);
+} TMR_STORE_OPS;
+
+// Expired Timer waiting for dispatch, see process_timer_tick()
+typedef struct tmr_due {
+  RTOS_TMR *timer;
+  RTOS_TMR_HANDLE handle; /* RTOSTmrHandle at the expiry */
+  INT32U match;           /* RTOSTmrMatch at the expiry, the deadline */
+  INT8U prio;             /* RTOSTmrPrio at the expiry */
+} TMR_DUE;
+
+// Timer Shard Structure
+// A timer store with its own tick counter, lock and timer task.
+typedef struct __attribute__((aligned(RTOS_CACHE_LINE_SIZE))) tmr_shard {
+  pthread_mutex_t mutex; /* Protects the store and the tick counter */
+  INT32U tick;           /* Tick counter */
+  INT32 cpu;             /* CPU the timer task is pinned to, -1 if none */
+  sem_t task_sem;        /* Signals the timer task */
+  pthread_t thread;      /* Timer task */
+  const TMR_STORE_OPS *store; /* Timer store of the shard */
+  WHEEL_SLOT wheel[RTOS_TMR_WHEEL_SLOTS];      /* Wheel store */
+  INT64U wheel_map[RTOS_TMR_WHEEL_SLOTS / 64]; /* Slot occupancy bitmap */
+  RTOS_TMR **heap;  /* Heap store, heap_size entries */
+  INT32U heap_size;
+  INT32U heap_cap;
+  TMR_DUE *due;      /* Expired timers in dispatch order, due_count entries */
+  TMR_DUE *due_sort; /* Scratch array of the same size to order them */
+  INT32U due_count;
+  INT32U due_cap;
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+  INT32U timer_count;  /* Timers linked in the store */
+  INT32 tombstones;    /* Stopped timers still linked, may lag by a few */
+  INT64U compactions;  /* Passes that unlinked all tombstones */
+  INT32U compact_tick; /* Tick of the last pass */
+#endif
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  TMR_RING cmd_ring;              /* Start/stop/delete commands */
+  RTOS_TMR_QUEUE_STATS cmd_stats; /* Statistics of cmd_ring */
+#endif
+#if RTOS_CFG_TMR_STATS_EN
+  RTOS_TMR_HIST lateness;     /* See RTOS_TMR_STATS */
+  RTOS_TMR_HIST prio_lateness[RTOS_TMR_PRIO_CLASSES]; /* See RTOS_TMR_STATS */
+  RTOS_TMR_HIST tick_time;    /* See RTOS_TMR_STATS */
+  RTOS_TMR_HIST tick_expired; /* See RTOS_TMR_STATS */
+  INT64U budget_deferred;     /* See RTOS_TMR_STATS */
+  INT64U slack_placed;        /* See RTOS_TMR_STATS */
+  INT64U slack_coalesced;     /* See RTOS_TMR_STATS */
+#endif
+#if RTOS_CFG_TMR_TICKLESS_EN
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  INT32 tick_timer_id;     /* One shot timerfd */
+#else
+  timer_t tick_timer_id;   /* One shot OS timer */
+#endif
+  INT8U tick_timer_ready;  /* tick_timer_id is created */
+  INT8U tick_timer_armed;  /* tick_timer_id is armed */
+  INT32U tick_timer_match; /* Tick tick_timer_id is armed for */
+#endif
+} TMR_SHARD;
 
 #endif
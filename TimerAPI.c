@@ -1,3 +1,6 @@
+// sched_getcpu() and the thread affinity calls.
+#define _GNU_SOURCE
+
 // Header Files
 #include "TimerAPI.h"
 #include "TimerMgrHeader.h"
@@ -7,33 +10,74 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
 
 /*****************************************************
  * Global Variables
  *****************************************************
  */
 // Timer pool global variables.
-INT8U FreeTmrCount = 0;
-RTOS_TMR *FreeTmrListPtr = NULL;
+// Chunks of contiguous timers, the chunks of their cold fields, and a stack
+// with the ids of the free ones.
+RTOS_TMR *TmrPoolChunk[RTOS_CFG_TMR_POOL_MAX_CHUNKS];
+RTOS_TMR_COLD *TmrPoolCold[RTOS_CFG_TMR_POOL_MAX_CHUNKS];
+INT32U TmrPoolChunkCount = 0;
+INT32U *FreeTmrStack = NULL;
+INT32U FreeTmrStackSize = 0;
+INT32U FreeTmrCount = 0;
+INT32U FreeTmrLowWater = 0xFFFFFFFF;
+
+// Mutex for protecting timer pool.
+pthread_mutex_t timer_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-// Tick counter.
-INT32U RTOSTmrTickCtr = 0;
+#if RTOS_CFG_TMR_CACHE_SIZE
+// Per-thread cache of free timer ids, flushed by tmr_cache_key at thread exit.
+static __thread TMR_CACHE tmr_cache;
+static pthread_key_t tmr_cache_key;
+static pthread_once_t tmr_cache_once = PTHREAD_ONCE_INIT;
+#endif
 
-// Hash table.
-HASH_OBJ hash_table[HASH_TABLE_SIZE];
+// Timer shards, each with its own timer store, tick counter and timer task.
+TMR_SHARD *TmrShard = NULL;
+INT32U TmrShardCount = 0;
 
-// Thread variable for timer task.
-pthread_t thread;
+// Timer stores, see TimerWheel.c and TimerHeap.c.
+extern const TMR_STORE_OPS timer_wheel_store;
+extern const TMR_STORE_OPS timer_heap_store;
 
-// Semaphore for signaling the timer task.
-sem_t timer_task_sem;
+// Shard the calling thread creates its timers on, -1 until it has one.
+static __thread INT32 tmr_shard_select = -1;
 
-// Mutex for protecting Hash table.
-pthread_mutex_t hash_table_mutex;
+// Time the callbacks of a tick may take before the low classes wait, 0 for
+// none, see RTOSTmrBudgetSet().
+static INT64U tick_budget_ns = RTOS_CFG_TMR_TICK_BUDGET_NS;
 
-// Mutex for protecting timer pool.
-pthread_mutex_t timer_pool_mutex;
+// Phase spreading of the Periodic timers started with delay 0, see
+// RTOSTmrSpreadSet(), and the xorshift state of RTOS_TMR_SPREAD_RANDOM.
+static INT8U tmr_spread_mode = RTOS_CFG_TMR_SPREAD_MODE;
+static __thread INT32U tmr_spread_seed;
+
+// Time of tick 0 on CLOCK_MONOTONIC, shared by all shards, set by
+// OSTickInitialize().
+struct timespec tick_epoch;
+INT8U tick_clock_ready = RTOS_FALSE;
+
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+// Event loop mode: the epoll fd handed to the application, the eventfd that
+// wakes it and, without tickless mode, the periodic tick timerfd.
+static INT32 tmr_epoll_fd = -1;
+static INT32 tmr_wake_fd = -1;
+#if !RTOS_CFG_TMR_TICKLESS_EN
+static INT32 tmr_tick_fd = -1;
+#endif
+#endif
 
 /*****************************************************
  * Timer API Functions
@@ -41,87 +85,300 @@ pthread_mutex_t timer_pool_mutex;
  */
 
 /*
-  @RTOSTmrCreate().
-  Create timer and fill the timer object.
+  @ timer_shard().
+  Shard the timer runs on.
 */
-RTOS_TMR *RTOSTmrCreate(INT32U delay, INT32U period, INT8U option,
-                        RTOS_TMR_CALLBACK callback, void *callback_arg,
-                        INT8 *name, INT8U *err) {
+static inline TMR_SHARD *timer_shard(RTOS_TMR *timer) {
+  return &TmrShard[timer->RTOSTmrShard];
+}
 
-  if (FreeTmrCount == 0) {
-    *err = RTOS_ERR_NONE;
-    return NULL;
+/*
+  @ select_timer_shard().
+  Shard for the timers of the calling thread: the one picked with
+  RTOSTmrShardSelect(), or else the shard of the CPU the thread first created
+  a timer on, so threads spread over the shards like they spread over the CPUs.
+*/
+static INT32U select_timer_shard(void) {
+  if (tmr_shard_select < 0) {
+    INT32 cpu = sched_getcpu();
+    tmr_shard_select = (cpu < 0 ? 0 : cpu) % TmrShardCount;
   }
-  RTOS_TMR *timer_obj = NULL;
-  // Check the input arguments for ERROR.
-  if (option == RTOS_TMR_PERIODIC || option == RTOS_TMR_ONE_SHOT) {
-    if (option == RTOS_TMR_ONE_SHOT && delay == 0) {
-      *err = RTOS_ERR_TMR_INVALID_DLY;
-      return NULL;
+  return tmr_shard_select;
+}
+
+/*
+  @ check_timer_args().
+  Check the arguments of a new timer, RTOS_SUCCESS or the error code. The
+  option may carry a priority class, see RTOS_TMR_OPT_PRIO().
+*/
+static INT8U check_timer_args(INT32U delay, INT32U period, INT8U option) {
+  if ((option >> RTOS_TMR_OPT_PRIO_SHIFT) >= RTOS_TMR_PRIO_CLASSES) {
+    return RTOS_ERR_TMR_INVALID_PRIO;
+  }
+  option &= RTOS_TMR_OPT_TYPE_MASK;
+  if (option != RTOS_TMR_PERIODIC && option != RTOS_TMR_ONE_SHOT) {
+    return RTOS_ERR_TMR_INVALID_OPT;
+  }
+  if (option == RTOS_TMR_ONE_SHOT && delay == 0) {
+    return RTOS_ERR_TMR_INVALID_DLY;
+  }
+  if (option == RTOS_TMR_PERIODIC && period == 0) {
+    return RTOS_ERR_TMR_INVALID_PERIOD;
+  }
+  if (delay > RTOS_TMR_MAX_TICKS) {
+    return RTOS_ERR_TMR_INVALID_DLY;
+  }
+  if (period > RTOS_TMR_MAX_TICKS) {
+    return RTOS_ERR_TMR_INVALID_PERIOD;
+  }
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ fill_timer_obj().
+  Fill up a timer object fresh from the pool, on the shard of the calling
+  thread. A payload_size up to RTOS_CFG_TMR_PAYLOAD_SIZE copies the bytes at
+  callback_arg into the timer, which passes its copy to the callback.
+*/
+static void fill_timer_obj(RTOS_TMR *timer_obj, INT32U delay, INT32U period,
+                           INT8U option, RTOS_TMR_CALLBACK callback,
+                           void *callback_arg, INT32U payload_size,
+                           INT8 *name) {
+  RTOS_TMR_COLD *cold = get_timer_cold(timer_obj);
+
+  cold->RTOSTmrCallback = callback;
+#if RTOS_CFG_TMR_PAYLOAD_SIZE
+  if (callback_arg != NULL && payload_size != 0 &&
+      payload_size <= RTOS_CFG_TMR_PAYLOAD_SIZE) {
+    memcpy(cold->RTOSTmrPayload, callback_arg, payload_size);
+    callback_arg = cold->RTOSTmrPayload;
+  }
+#else
+  (void)payload_size;
+#endif
+  cold->RTOSTmrCallbackArg = callback_arg;
+  cold->RTOSTmrName = name;
+  timer_obj->RTOSTmrNext = RTOS_TMR_NO_ID;
+  timer_obj->RTOSTmrPrev = RTOS_TMR_NO_ID;
+  timer_obj->RTOSTmrMatch = 0;
+  timer_obj->RTOSTmrDelay = delay;
+  timer_obj->RTOSTmrPeriod = period;
+  timer_obj->RTOSTmrOpt = option & RTOS_TMR_OPT_TYPE_MASK;
+  timer_obj->RTOSTmrPrio = option >> RTOS_TMR_OPT_PRIO_SHIFT;
+  timer_obj->RTOSTmrState = RTOS_TMR_STATE_STOPPED;
+  timer_obj->RTOSTmrFlags = RTOS_CFG_TMR_EXEC_THREADS ? RTOS_TMR_FLAG_POOL : 0;
+  timer_obj->RTOSTmrShard = select_timer_shard();
+  timer_obj->RTOSTmrSlack = 0;
+  timer_obj->RTOSTmrSlot = RTOS_TMR_WHEEL_NO_SLOT;
+}
+
+/*
+  @ timer_deleted().
+  RTOS_TRUE if the timer is back in the pool or being deleted.
+*/
+static inline INT8U timer_deleted(RTOS_TMR *timer) {
+  INT8U state = __atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE);
+  return state == RTOS_TMR_STATE_UNUSED || state == RTOS_TMR_STATE_DELETING;
+}
+
+/*
+  @ set_timer_state().
+  Move the timer to state to, unless it is back in the pool or being deleted,
+  so a start or stop racing with a delete never revives the timer. Returns
+  RTOS_FALSE if it was.
+*/
+static INT8U set_timer_state(RTOS_TMR *timer, INT8U to) {
+  INT8U state = __atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE);
+  do {
+    if (state == RTOS_TMR_STATE_UNUSED || state == RTOS_TMR_STATE_DELETING) {
+      return RTOS_FALSE;
     }
-    if (option == RTOS_TMR_PERIODIC && period == 0) {
-      *err = RTOS_ERR_TMR_INVALID_PERIOD;
-      return NULL;
+  } while (!__atomic_compare_exchange_n(&timer->RTOSTmrState, &state, to, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  return RTOS_TRUE;
+}
+
+/*
+  @ claim_timer_delete().
+  - Mark the timer of handle DELETING, so of racing deletes exactly one wins
+  it and frees it, and starts and stops leave it alone. *state gets the state
+  it had.
+  - The handle is checked under the shard mutex, under which timers go back
+  to the pool: a timer that went back and runs again for another handle is
+  left alone.
+  - Returns RTOS_FALSE if the timer is deleted already. Caller holds the shard
+  mutex.
+*/
+static INT8U claim_timer_delete(RTOS_TMR *timer, RTOS_TMR_HANDLE handle,
+                                INT8U *state) {
+  if (__atomic_load_n(&timer->RTOSTmrHandle, __ATOMIC_ACQUIRE) != handle) {
+    return RTOS_FALSE;
+  }
+  *state = __atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE);
+  do {
+    if (*state == RTOS_TMR_STATE_UNUSED ||
+        *state == RTOS_TMR_STATE_DELETING) {
+      return RTOS_FALSE;
     }
-    // Allocate timer obj.
-    timer_obj = alloc_timer_obj();
-    if (timer_obj == NULL) {
-      *err = RTOS_ERR_TMR_NON_AVAIL;
-      return NULL;
+  } while (!__atomic_compare_exchange_n(&timer->RTOSTmrState, state,
+                                        RTOS_TMR_STATE_DELETING, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  return RTOS_TRUE;
+}
+
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+/*
+  @ cancel_timer_obj().
+  - Stop a running timer in O(1) without the shard mutex: mark it STOPPED, so
+  it no longer fires, and leave it linked in the store as a tombstone.
+  - The timer task unlinks the tombstone when it reaches its slot or compacts
+  the store, see process_timer_tick(). A timer stopped while its callback
+  runs is not linked, so it leaves no tombstone.
+  - Returns RTOS_SUCCESS, RTOS_ERR_TMR_STOPPED if the timer was stopped
+  already, or RTOS_ERR_TMR_INACTIVE if it is being deleted or was.
+*/
+static INT8U cancel_timer_obj(RTOS_TMR *timer) {
+  INT8U state = __atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE);
+  do {
+    if (state == RTOS_TMR_STATE_STOPPED) {
+      return RTOS_ERR_TMR_STOPPED;
     }
+    if (state != RTOS_TMR_STATE_RUNNING &&
+        state != RTOS_TMR_STATE_COMPLETED) {
+      return RTOS_ERR_TMR_INACTIVE;
+    }
+  } while (!__atomic_compare_exchange_n(&timer->RTOSTmrState, &state,
+                                        RTOS_TMR_STATE_STOPPED, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  if (state == RTOS_TMR_STATE_RUNNING) {
+    __atomic_add_fetch(&timer_shard(timer)->tombstones, 1, __ATOMIC_RELAXED);
+  }
+  return RTOS_SUCCESS;
+}
+#endif
 
-    // Fill up the timer object.
-    timer_obj->RTOSTmrCallback = callback;
-    timer_obj->RTOSTmrCallbackArg = callback_arg;
-    timer_obj->RTOSTmrNext = NULL;
-    timer_obj->RTOSTmrPrev = NULL;
-    timer_obj->RTOSTmrMatch = 0;
-    timer_obj->RTOSTmrDelay = delay;
-    timer_obj->RTOSTmrPeriod = period;
-    timer_obj->RTOSTmrName = name;
-    timer_obj->RTOSTmrOpt = option;
-    timer_obj->RTOSTmrState = RTOS_TMR_STATE_STOPPED;
-    *err = RTOS_SUCCESS;
-  } else {
-    *err = RTOS_ERR_TMR_INVALID_OPT;
+/*
+  @ resolve_timer().
+  Timer object of a handle, or NULL with *perr set: RTOS_ERR_TMR_INVALID if
+  the handle names no timer of the pool, RTOS_ERR_TMR_INACTIVE if the timer
+  went back to the pool since the handle was made. Prints nothing.
+*/
+static inline RTOS_TMR *resolve_timer(RTOS_TMR_HANDLE handle, INT8U *perr) {
+  RTOS_TMR *timer = get_timer_obj(RTOS_TMR_HANDLE_ID(handle));
+
+  if (handle == RTOS_TMR_NO_HANDLE || timer == NULL) {
+    *perr = RTOS_ERR_TMR_INVALID;
+    return NULL;
+  }
+  if (__atomic_load_n(&timer->RTOSTmrHandle, __ATOMIC_ACQUIRE) != handle) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
+    return NULL;
+  }
+  return timer;
+}
+
+/*
+  @ lookup_timer().
+  resolve_timer() for the single timer APIs, which report a handle that names
+  no timer at all.
+*/
+static RTOS_TMR *lookup_timer(RTOS_TMR_HANDLE handle, INT8U *perr) {
+  RTOS_TMR *timer = resolve_timer(handle, perr);
+
+  if (timer == NULL && *perr == RTOS_ERR_TMR_INVALID) {
+    RTOS_TMR_ERR("\nTimer handle %#x is not valid\n", (unsigned)handle);
+  }
+  return timer;
+}
+
+/*
+  @RTOSTmrCreate().
+  Create timer and fill the timer object. Returns the handle of the timer,
+  RTOS_TMR_NO_HANDLE on error.
+*/
+RTOS_TMR_HANDLE RTOSTmrCreate(INT32U delay, INT32U period, INT8U option,
+                              RTOS_TMR_CALLBACK callback, void *callback_arg,
+                              INT8 *name, INT8U *err) {
+  return RTOSTmrCreatePayload(delay, period, option, callback, callback_arg, 0,
+                              name, err);
+}
+
+/*
+  @ RTOSTmrCreatePayload().
+  - RTOSTmrCreate() with the callback argument copied into the timer: the
+  payload_size bytes at payload go to a buffer of the timer and the callback
+  gets a pointer to that buffer, valid until the timer is deleted, so the
+  caller need not keep the payload alive.
+  - A payload larger than RTOS_CFG_TMR_PAYLOAD_SIZE does not fit and is passed
+  as is, as with RTOSTmrCreate(), as is any payload with payload_size 0.
+*/
+RTOS_TMR_HANDLE RTOSTmrCreatePayload(INT32U delay, INT32U period, INT8U option,
+                                     RTOS_TMR_CALLBACK callback,
+                                     const void *payload, INT32U payload_size,
+                                     INT8 *name, INT8U *err) {
+
+  RTOS_TMR *timer_obj = NULL;
+  // Check the input arguments for ERROR.
+  *err = check_timer_args(delay, period, option);
+  if (*err != RTOS_SUCCESS) {
+    return RTOS_TMR_NO_HANDLE;
+  }
+  // Allocate timer obj.
+  timer_obj = alloc_timer_obj();
+  if (timer_obj == NULL) {
+    *err = RTOS_ERR_TMR_NON_AVAIL;
+    return RTOS_TMR_NO_HANDLE;
   }
 
-  return timer_obj;
+  // Fill up the timer object.
+  fill_timer_obj(timer_obj, delay, period, option, callback, (void *)payload,
+                 payload_size, name);
+#if RTOS_CFG_TMR_TRACE_EN
+  trace_timer_event(RTOS_TMR_TRACE_CREATE, timer_obj, delay);
+#endif
+  return timer_obj->RTOSTmrHandle;
 }
 
 /*
   @ RTOSTmrDel().
-  Free timer object according to its state.
+  Free timer object according to its state. A timer deleted already is no
+  error.
 */
-INT8U RTOSTmrDel(RTOS_TMR *ptmr, INT8U *perr) {
+INT8U RTOSTmrDel(RTOS_TMR_HANDLE timer, INT8U *perr) {
   // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
   if (ptmr == NULL) {
-    fprintf(stdout, "\nTimer pointer is NULL\n");
-    *perr = RTOS_ERR_TMR_INVALID;
-    return RTOS_FALSE;
-  }
-  if (ptmr->RTOSTmrType != RTOS_TMR_TYPE) {
-    fprintf(stdout, "\nTimer type is not RTOS_TMR_TYPE\n");
-    *perr = RTOS_ERR_TMR_INVALID_TYPE;
-    return RTOS_FALSE;
+    if (*perr != RTOS_ERR_TMR_INACTIVE) {
+      return RTOS_FALSE;
+    }
+    *perr = RTOS_SUCCESS;
+    return RTOS_TRUE;
   }
-  if (ptmr->RTOSTmrState == RTOS_TMR_STATE_UNUSED) {
+  if (timer_deleted(ptmr)) {
     *perr = RTOS_SUCCESS;
     return RTOS_TRUE;
   }
+#if RTOS_CFG_TMR_TRACE_EN
+  trace_timer_event(RTOS_TMR_TRACE_DEL, ptmr, 0);
+#endif
 
-  if (ptmr->RTOSTmrState == RTOS_TMR_STATE_COMPLETED ||
-      ptmr->RTOSTmrState == RTOS_TMR_STATE_RUNNING ||
-      ptmr->RTOSTmrState == RTOS_TMR_STATE_STOPPED) {
-    remove_hash_entry(ptmr);
-    free_timer_obj(ptmr);
-  } else {
-    *perr = RTOS_ERR_TMR_INVALID_STATE;
-    fprintf(stdout, "\n %s is not deleted with state = %d\n",
-            RTOSTmrNameGet(ptmr, perr), ptmr->RTOSTmrState);
-    return RTOS_FALSE;
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  // Mark it DELETING right away so it no longer fires, the timer task unlinks
+  // and frees it. Only the first of racing deletes queues the command, and a
+  // one shot timer the timer task just freed is left alone.
+  TMR_SHARD *shard = timer_shard(ptmr);
+  INT8U state;
+  pthread_mutex_lock(&shard->mutex);
+  INT8U claimed = claim_timer_delete(ptmr, timer, &state);
+  pthread_mutex_unlock(&shard->mutex);
+  if (claimed) {
+    send_timer_cmd(RTOS_TMR_CMD_DEL, ptmr, timer, 0);
   }
-
+#else
+  // Only the first of racing deletes, and of a delete and the expiry that
+  // frees a one shot timer, frees it.
+  delete_timer_entry(ptmr, timer);
+#endif
   *perr = RTOS_SUCCESS;
   return RTOS_TRUE;
 }
@@ -130,22 +387,17 @@ INT8U RTOSTmrDel(RTOS_TMR *ptmr, INT8U *perr) {
   @ RTOSTmrNameGet().
   Get the name of timer.
 */
-INT8 *RTOSTmrNameGet(RTOS_TMR *ptmr, INT8U *perr) {
+INT8 *RTOSTmrNameGet(RTOS_TMR_HANDLE timer, INT8U *perr) {
   // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
   if (ptmr == NULL) {
-    fprintf(stdout, "\nTimer pointer is NULL\n");
-    *perr = RTOS_ERR_TMR_INVALID;
     return NULL;
-  } else if (ptmr->RTOSTmrType != RTOS_TMR_TYPE) {
-    fprintf(stdout, "\nTimer type is not RTOS_TMR_TYPE\n");
-    *perr = RTOS_ERR_TMR_INVALID_TYPE;
-    return RTOS_FALSE;
-  } else if (ptmr->RTOSTmrState == RTOS_TMR_STATE_UNUSED) {
+  } else if (timer_deleted(ptmr)) {
     *perr = RTOS_ERR_TMR_INACTIVE;
     return NULL;
   } else {
     // Return the pointer to the timer string.
-    return ptmr->RTOSTmrName;
+    return get_timer_cold(ptmr)->RTOSTmrName;
   }
 }
 
@@ -153,406 +405,2531 @@ INT8 *RTOSTmrNameGet(RTOS_TMR *ptmr, INT8U *perr) {
   @ RTOSTmrRemainGet
   Get the number of ticks remaining in time out.
 */
-INT32U RTOSTmrRemainGet(RTOS_TMR *ptmr, INT8U *perr) {
+INT32U RTOSTmrRemainGet(RTOS_TMR_HANDLE timer, INT8U *perr) {
   // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
   if (ptmr == NULL) {
-    fprintf(stdout, "\nTimer pointer is NULL\n");
-    *perr = RTOS_ERR_TMR_INVALID;
-    return RTOS_FALSE;
-  } else if (ptmr->RTOSTmrType != RTOS_TMR_TYPE) {
-    fprintf(stdout, "\nTimer type is not RTOS_TMR_TYPE\n");
-    *perr = RTOS_ERR_TMR_INVALID_TYPE;
     return RTOS_FALSE;
-  } else if (ptmr->RTOSTmrState == RTOS_TMR_STATE_UNUSED) {
+  } else if (timer_deleted(ptmr)) {
     *perr = RTOS_ERR_TMR_INACTIVE;
     return RTOS_FALSE;
   } else {
     // Return the remaining ticks.
-    fprintf(stdout, "\nTimer remaining ticks = %d\n",
-            (ptmr->RTOSTmrMatch - RTOSTmrTickCtr));
-    return (ptmr->RTOSTmrMatch - RTOSTmrTickCtr);
+    RTOS_TMR_DEBUG(
+        "\nTimer remaining ticks = %d\n",
+        (ptmr->RTOSTmrMatch - current_timer_tick(timer_shard(ptmr))));
+    return (ptmr->RTOSTmrMatch - current_timer_tick(timer_shard(ptmr)));
   }
 }
 
 /*
   @ RTOSTmrStateGet().
-  Get the state of the timer.
+  Get the state of the timer, RTOS_TMR_STATE_UNUSED once it is deleted or
+  went back to the pool.
 */
-INT8U RTOSTmrStateGet(RTOS_TMR *ptmr, INT8U *perr) {
+INT8U RTOSTmrStateGet(RTOS_TMR_HANDLE timer, INT8U *perr) {
   // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
   if (ptmr == NULL) {
-    fprintf(stdout, "\nTimer pointer is NULL\n");
-    *perr = RTOS_ERR_TMR_INVALID;
-    return RTOS_FALSE;
-  } else if (ptmr->RTOSTmrType != RTOS_TMR_TYPE) {
-    fprintf(stdout, "\nTimer type is not RTOS_TMR_TYPE\n");
-    *perr = RTOS_ERR_TMR_INVALID_TYPE;
-    return RTOS_FALSE;
+    if (*perr != RTOS_ERR_TMR_INACTIVE) {
+      return RTOS_FALSE;
+    }
+    *perr = RTOS_SUCCESS;
+    return RTOS_TMR_STATE_UNUSED;
+  } else if (timer_deleted(ptmr)) {
+    return RTOS_TMR_STATE_UNUSED;
   } else {
     // Return timer state.
     return ptmr->RTOSTmrState;
   }
 }
 
+/*
+  @ start_timer_delay().
+  - Ticks from the start to the first expiry of the timer, RTOSTmrDelay.
+  - With phase spreading on, a Periodic timer of delay 0 gets a phase in
+  [0, period) instead, so timers started together expire on different ticks.
+  RTOS_TMR_SPREAD_HASH scales the Fibonacci hash of the pool id: consecutive
+  ids land evenly over the period, and a timer started again keeps its phase.
+*/
+static INT32U start_timer_delay(RTOS_TMR *timer) {
+  INT32U period = timer->RTOSTmrPeriod;
+  INT32U hash;
+
+  if (timer->RTOSTmrDelay != 0 || period < 2 ||
+      (timer->RTOSTmrOpt & RTOS_TMR_OPT_TYPE_MASK) != RTOS_TMR_PERIODIC) {
+    return timer->RTOSTmrDelay;
+  }
+  switch (__atomic_load_n(&tmr_spread_mode, __ATOMIC_RELAXED)) {
+  case RTOS_TMR_SPREAD_HASH:
+    hash = RTOS_TMR_HANDLE_ID(timer->RTOSTmrHandle) * 0x9E3779B9U;
+    break;
+  case RTOS_TMR_SPREAD_RANDOM:
+    if (tmr_spread_seed == 0) {
+      tmr_spread_seed = (INT32U)timer_clock_ns() | 1;
+    }
+    tmr_spread_seed ^= tmr_spread_seed << 13;
+    tmr_spread_seed ^= tmr_spread_seed >> 17;
+    tmr_spread_seed ^= tmr_spread_seed << 5;
+    hash = tmr_spread_seed;
+    break;
+  default:
+    return 0;
+  }
+  return (INT32U)(((INT64U)hash * period) >> 32);
+}
+
 /*
   @ RTOSTmrStart().
-  Based on the timer state, update the RTOSTmrMatch using RTOSTmrTickCtr,
+  Based on the timer state, update the RTOSTmrMatch using the shard tick,
   RTOSTmrDelay and RTOSTmrPeriod.
 */
-INT8U RTOSTmrStart(RTOS_TMR *timer, INT8U *perr) {
+INT8U RTOSTmrStart(RTOS_TMR_HANDLE handle, INT8U *perr) {
   // ERROR checking.
+  RTOS_TMR *timer = lookup_timer(handle, perr);
   if (timer == NULL) {
-    fprintf(stdout, "\nTimer pointer is NULL\n");
-    *perr = RTOS_ERR_TMR_INVALID;
-    return RTOS_FALSE;
-  } else if (timer->RTOSTmrType != RTOS_TMR_TYPE) {
-    fprintf(stdout, "\nTimer type is not RTOS_TMR_TYPE\n");
-    *perr = RTOS_ERR_TMR_INVALID_TYPE;
     return RTOS_FALSE;
   } else {
-    // .
-    timer->RTOSTmrState = RTOS_TMR_STATE_RUNNING;
-    printf("\nnadaf RTOSTmrTickCtr = %d timer->RTOSTmrDelay = %d\n",
-           RTOSTmrTickCtr, timer->RTOSTmrDelay);
-    timer->RTOSTmrMatch = RTOSTmrTickCtr + timer->RTOSTmrDelay;
-    // You may use the Hash table to insert the running timer obj.
-    insert_hash_entry(timer);
+    RTOS_TMR_DEBUG("\nStarting timer %#x at tick %u, delay %u\n", handle,
+                   current_timer_tick(timer_shard(timer)), timer->RTOSTmrDelay);
+    INT32U delay = start_timer_delay(timer);
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+    INT32U tick = current_timer_tick(timer_shard(timer));
+    if (!set_timer_state(timer, RTOS_TMR_STATE_RUNNING)) {
+      *perr = RTOS_ERR_TMR_INACTIVE;
+      return RTOS_FALSE;
+    }
+#if RTOS_CFG_TMR_TRACE_EN
+    trace_timer_event(RTOS_TMR_TRACE_START, timer, delay);
+#endif
+    // The timer task inserts it at the start of its next tick.
+    send_timer_cmd(RTOS_TMR_CMD_START, timer, handle, tick + delay);
+    *perr = RTOS_SUCCESS;
+#else
+    // Insert the timer obj in the timer store, which marks it running.
+    *perr = insert_timer_entry(timer, delay);
+    if (*perr != RTOS_SUCCESS) {
+      return RTOS_FALSE;
+    }
+#if RTOS_CFG_TMR_TRACE_EN
+    trace_timer_event(RTOS_TMR_TRACE_START, timer, delay);
+#endif
+#endif
     return RTOS_TRUE;
   }
 }
 
 /*
   @ RTOSTmrStop().
-  Function to stop the timer, and remove the timer from the Hash table list.
+  Function to stop the timer, and remove the timer from the timer store.
 */
-INT8U RTOSTmrStop(RTOS_TMR *ptmr, INT8U opt, void *callback_arg, INT8U *perr) {
+INT8U RTOSTmrStop(RTOS_TMR_HANDLE timer, INT8U opt, void *callback_arg,
+                  INT8U *perr) {
   // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
   if (ptmr == NULL) {
-    fprintf(stdout, "\nTimer pointer is NULL\n");
-    *perr = RTOS_ERR_TMR_INVALID;
     return RTOS_FALSE;
   }
-  if (ptmr->RTOSTmrType != RTOS_TMR_TYPE) {
-    fprintf(stdout, "\nTimer type is not RTOS_TMR_TYPE\n");
-    *perr = RTOS_ERR_TMR_INVALID_TYPE;
+  if (timer_deleted(ptmr)) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
     return RTOS_FALSE;
   }
   if (ptmr->RTOSTmrState == RTOS_TMR_STATE_STOPPED) {
-    fprintf(stdout, "\nTimer state is STOPPED\n");
+    RTOS_TMR_ERR("\nTimer state is STOPPED\n");
     *perr = RTOS_ERR_TMR_STOPPED;
     return RTOS_FALSE;
   }
 
-  remove_hash_entry(ptmr);
-
-  // Change timer state to STOPPED.
-  ptmr->RTOSTmrState = RTOS_TMR_STATE_STOPPED;
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  // Change timer state to STOPPED, so it no longer fires, the timer task
+  // unlinks it.
+  if (!set_timer_state(ptmr, RTOS_TMR_STATE_STOPPED)) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
+    return RTOS_FALSE;
+  }
+  send_timer_cmd(RTOS_TMR_CMD_STOP, ptmr, timer, 0);
+#elif RTOS_CFG_TMR_LAZY_CANCEL_EN
+  // Leave a tombstone, the timer task unlinks it.
+  *perr = cancel_timer_obj(ptmr);
+  if (*perr != RTOS_SUCCESS) {
+    return RTOS_FALSE;
+  }
+#else
+  // Change timer state to STOPPED and unlink it.
+  if (!stop_timer_entry(ptmr)) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
+    return RTOS_FALSE;
+  }
+#endif
+#if RTOS_CFG_TMR_TRACE_EN
+  trace_timer_event(RTOS_TMR_TRACE_STOP, ptmr, 0);
+#endif
 
   // Call callback function if required.
-  if (ptmr->RTOSTmrCallback != NULL) {
+  RTOS_TMR_COLD *cold = get_timer_cold(ptmr);
+  if (cold->RTOSTmrCallback != NULL) {
     if (opt == RTOS_TMR_OPT_NONE) {
-      fprintf(stdout, "\nTimer callback option = %d\n", opt);
+      RTOS_TMR_DEBUG("\nTimer callback option = %d\n", opt);
     } else if (opt == RTOS_TMR_OPT_CALLBACK) {
-      fprintf(stdout, "\nTimer callback option = %d\n", opt);
-      ptmr->RTOSTmrCallback(ptmr->RTOSTmrCallbackArg);
+      RTOS_TMR_DEBUG("\nTimer callback option = %d\n", opt);
+      run_timer_callback(ptmr, cold->RTOSTmrCallbackArg, RTOS_TMR_NO_RUNNER);
     } else if (opt == RTOS_TMR_OPT_CALLBACK_ARG) {
-      fprintf(stdout, "\nTimer callback option = %d\n", opt);
-      ptmr->RTOSTmrCallback(callback_arg);
+      RTOS_TMR_DEBUG("\nTimer callback option = %d\n", opt);
+      run_timer_callback(ptmr, callback_arg, RTOS_TMR_NO_RUNNER);
     } else {
-      fprintf(stdout, "\nTimer callback option = %d\n", opt);
+      RTOS_TMR_DEBUG("\nTimer callback option = %d\n", opt);
     }
   } else {
-    if (ptmr->RTOSTmrCallback == NULL) {
+    if (cold->RTOSTmrCallback == NULL) {
       *perr = RTOS_ERR_TMR_NO_CALLBACK;
       return RTOS_FALSE;
     } else {
       return RTOS_FALSE;
     }
   }
+  *perr = RTOS_SUCCESS;
   return RTOS_TRUE;
 }
 
 /*
-  @ RTOSTmrSignal().
-  Function called when OS tick Interrupt occurs which will signal the
-  RTOSTmrTask() to update the timers.
-*/
-void RTOSTmrSignal(int signum) {
-  // Send the signal to timer task using Semaphore.
-  sem_post(&timer_task_sem);
-}
-
-/*
-  @ GetRTOSTimer().
-  Create RTOS timer, and return its pointer.
+  @ check_restart_args().
+  Check a timer and the new delay of a restart, RTOS_SUCCESS or the error
+  code. Prints nothing.
 */
-RTOS_TMR *GetRTOSTimer() {
-  RTOS_TMR *ptr;
-  ptr = (RTOS_TMR *)malloc(sizeof(RTOS_TMR));
-  ptr->RTOSTmrPrev = NULL;
-  ptr->RTOSTmrNext = NULL;
-  ptr->RTOSTmrType = RTOS_TMR_TYPE;
-  ptr->RTOSTmrState = RTOS_TMR_STATE_UNUSED;
-  return ptr;
+static INT8U check_restart_args(RTOS_TMR *ptmr, INT32U delay) {
+  if (timer_deleted(ptmr)) {
+    return RTOS_ERR_TMR_INACTIVE;
+  }
+  if (delay > RTOS_TMR_MAX_TICKS ||
+      (ptmr->RTOSTmrOpt == RTOS_TMR_ONE_SHOT && delay == 0)) {
+    return RTOS_ERR_TMR_INVALID_DLY;
+  }
+  return RTOS_SUCCESS;
 }
 
-/*****************************************************
- * Internal Functions
- *****************************************************
- */
 /*
-  @ Create_Timer_Pool().
-  - Create pool of timers.
-  - Create the timer pool using dynamic memory allocation.
-  - We can magine of linkedList creation for timer obj.
+  @ restart_timer_obj().
+  Re-arm the timer to expire delay ticks from now, see RTOSTmrRestart().
 */
-INT8U Create_Timer_Pool(INT32U timer_count) {
-  printf("nadaf Create_Timer_Pool start\n");
-  printf("nadaf Create_Timer_Pool timer_count = %d FreeTmrCount = %d\n",
-         timer_count, FreeTmrCount);
-  if (timer_count == 0) {
-    fprintf(stdout, "\nTimer count is zero\n");
-    return RTOS_MALLOC_ERR;
-  }
-  FreeTmrCount = timer_count;
-  FreeTmrListPtr = GetRTOSTimer();
-  RTOS_TMR *tempptr = FreeTmrListPtr;
-  for (int i = 1; i < timer_count; i++) {
-    tempptr->RTOSTmrNext = GetRTOSTimer();
-    tempptr->RTOSTmrNext->RTOSTmrPrev = tempptr;
-    tempptr = tempptr->RTOSTmrNext;
+static INT8U restart_timer_obj(RTOS_TMR *ptmr, RTOS_TMR_HANDLE handle,
+                               INT32U delay) {
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  INT32U tick = current_timer_tick(timer_shard(ptmr));
+  if (!set_timer_state(ptmr, RTOS_TMR_STATE_RUNNING)) {
+    return RTOS_ERR_TMR_INACTIVE;
   }
-  tempptr->RTOSTmrNext = NULL;
-  printf("nadaf Create_Timer_Pool end\n");
+#if RTOS_CFG_TMR_TRACE_EN
+  trace_timer_event(RTOS_TMR_TRACE_START, ptmr, delay);
+#endif
+  // The timer task moves it at the start of its next tick.
+  send_timer_cmd(RTOS_TMR_CMD_START, ptmr, handle, tick + delay);
   return RTOS_SUCCESS;
+#else
+  (void)handle;
+  INT8U err = insert_timer_entry(ptmr, delay);
+#if RTOS_CFG_TMR_TRACE_EN
+  if (err == RTOS_SUCCESS) {
+    trace_timer_event(RTOS_TMR_TRACE_START, ptmr, delay);
+  }
+#endif
+  return err;
+#endif
 }
 
 /*
-   @ init_hash_table().
-   Initialize the Hash table.
+  @ RTOSTmrRestart().
+  - Re-arm the timer to expire delay ticks from now, in place: running,
+  stopped or completed, it is moved in the timer store under one acquisition
+  of the shard mutex, with no stop callback and nothing printed. Meant for
+  timeouts that are pushed back on every event.
+  - RTOSTmrDelay and RTOSTmrPeriod stay as they are, see RTOSTmrModify(). A
+  Periodic timer continues with its period after the new expiry.
 */
-void init_hash_table(void) {
-  printf("nadaf init_hash_table start\n");
-  printf("nadaf init_hash_table HASH_TABLE_SIZE = %d\n", HASH_TABLE_SIZE);
-  for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-    hash_table[i].timer_count = 0;
-    hash_table[i].list_ptr = NULL;
+INT8U RTOSTmrRestart(RTOS_TMR_HANDLE timer, INT32U delay, INT8U *perr) {
+  RTOS_TMR *ptmr = resolve_timer(timer, perr);
+  INT8U err = ptmr == NULL ? *perr : check_restart_args(ptmr, delay);
+
+  if (err == RTOS_SUCCESS) {
+    err = restart_timer_obj(ptmr, timer, delay);
   }
-  printf("nadaf init_hash_table end\n");
+  *perr = err;
+  return err == RTOS_SUCCESS;
 }
 
 /*
-  @ insert_hash_entry().
-  Insert timer object in the Hash table.
+  @ RTOSTmrRestartLazy().
+  - Like RTOSTmrRestart(), but a running timer whose expiry only moves later
+  just gets its new RTOSTmrMatch, one atomic store without the shard mutex.
+  The timing wheel finds the timer not yet due when the tick reaches its old
+  slot (or cascades it) and moves it on then.
+  - Falls back to RTOSTmrRestart() for a timer that is not running, an
+  earlier expiry, the command queue, or a timer store that cannot move a
+  timer by itself (the heap).
+  - Like a stop, a restart that races with the expiry at the old deadline may
+  come too late, the callback then runs once.
 */
-void insert_hash_entry(RTOS_TMR *timer_obj) {
-  // Calculate the index using Hash function.
-  int index = timer_obj->RTOSTmrMatch % 10;
-
-  // Lock the resources.
-  pthread_mutex_lock(&hash_table_mutex);
+INT8U RTOSTmrRestartLazy(RTOS_TMR_HANDLE timer, INT32U delay, INT8U *perr) {
+  RTOS_TMR *ptmr = resolve_timer(timer, perr);
+  INT8U err = ptmr == NULL ? *perr : check_restart_args(ptmr, delay);
 
-  // Add the entry.
-  if (hash_table[index].timer_count == 0) {
-    hash_table[index].list_ptr = timer_obj;
-    timer_obj->RTOSTmrNext = NULL;
-  } else {
-    if ((hash_table[index].list_ptr->RTOSTmrMatch >= timer_obj->RTOSTmrMatch)) {
-      hash_table[index].list_ptr->RTOSTmrPrev = timer_obj;
-      timer_obj->RTOSTmrNext = hash_table[index].list_ptr;
-      hash_table[index].list_ptr = timer_obj;
-    } else {
-      RTOS_TMR *tempTmr = hash_table[index].list_ptr;
-      while (tempTmr->RTOSTmrNext != NULL &&
-             tempTmr->RTOSTmrNext->RTOSTmrMatch < timer_obj->RTOSTmrMatch)
-        tempTmr = tempTmr->RTOSTmrNext;
-      if (tempTmr->RTOSTmrNext != NULL)
-        tempTmr->RTOSTmrNext->RTOSTmrPrev = timer_obj;
-      timer_obj->RTOSTmrNext = tempTmr->RTOSTmrNext;
-      timer_obj->RTOSTmrPrev = tempTmr;
-      tempTmr->RTOSTmrNext = timer_obj;
+  if (err != RTOS_SUCCESS) {
+    *perr = err;
+    return RTOS_FALSE;
+  }
+#if !RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  TMR_SHARD *shard = timer_shard(ptmr);
+  if (shard->store->lazy_rearm &&
+      __atomic_load_n(&ptmr->RTOSTmrState, __ATOMIC_ACQUIRE) ==
+          RTOS_TMR_STATE_RUNNING) {
+    INT32U match = current_timer_tick(shard) + delay;
+    INT32U old = __atomic_load_n(&ptmr->RTOSTmrMatch, __ATOMIC_RELAXED);
+    if ((INT32)(match - old) >= 0) {
+      if (ptmr->RTOSTmrFlags & RTOS_TMR_FLAG_SLACK) {
+        __atomic_and_fetch(&ptmr->RTOSTmrFlags, ~RTOS_TMR_FLAG_SLACK,
+                           __ATOMIC_RELAXED);
+      }
+      __atomic_store_n(&ptmr->RTOSTmrMatch, match, __ATOMIC_RELEASE);
+#if RTOS_CFG_TMR_TRACE_EN
+      trace_timer_event(RTOS_TMR_TRACE_START, ptmr, delay);
+#endif
+      *perr = RTOS_SUCCESS;
+      return RTOS_TRUE;
     }
   }
-
-  hash_table[index].timer_count++;
-  // Unlock resources.
-  pthread_mutex_unlock(&hash_table_mutex);
+#endif
+  *perr = restart_timer_obj(ptmr, timer, delay);
+  return *perr == RTOS_SUCCESS;
 }
 
 /*
-  @ remove_hash_entry().
-  Remove the timer object entry from the Hash table.
+  @ RTOSTmrModify().
+  - Change the Delay and Period of a timer, checked as for RTOSTmrCreate().
+  - A running timer is re-armed in place to expire delay ticks from now, see
+  RTOSTmrRestart(). Any other uses them from its next start.
 */
-void remove_hash_entry(RTOS_TMR *timer_obj) {
-  // Calculate the index using Hash function.
-  int index = timer_obj->RTOSTmrMatch % 10;
-  if (hash_table[index].timer_count == 0) {
-    fprintf(stdout, "\nNo timers in hash table at index = %d\n", index);
-    return;
+INT8U RTOSTmrModify(RTOS_TMR_HANDLE timer, INT32U delay, INT32U period,
+                    INT8U *perr) {
+  // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
+  if (ptmr == NULL) {
+    return RTOS_FALSE;
   }
-  // Lock resources.
-  pthread_mutex_lock(&hash_table_mutex);
-  // Remove the timer obj.
-  RTOS_TMR *tempTmr = hash_table[index].list_ptr;
-  while (tempTmr != timer_obj && tempTmr != NULL) {
-    tempTmr = tempTmr->RTOSTmrNext;
-  }
-  // remove first obj.
-  if (tempTmr->RTOSTmrPrev == NULL) {
-    hash_table[index].list_ptr = tempTmr->RTOSTmrNext;
-    if (tempTmr->RTOSTmrNext) { // it is not last obj.
-      tempTmr->RTOSTmrNext->RTOSTmrPrev = tempTmr->RTOSTmrPrev;
-    }
-  } else {
-    if (tempTmr->RTOSTmrNext) { // it is the middle obj.
-      tempTmr->RTOSTmrNext->RTOSTmrPrev = tempTmr->RTOSTmrPrev;
-    }
-    tempTmr->RTOSTmrPrev->RTOSTmrNext = tempTmr->RTOSTmrNext;
+  if (timer_deleted(ptmr)) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
+    return RTOS_FALSE;
+  }
+  *perr = check_timer_args(delay, period, ptmr->RTOSTmrOpt);
+  if (*perr != RTOS_SUCCESS) {
+    return RTOS_FALSE;
   }
-  timer_obj->RTOSTmrNext = NULL;
-  timer_obj->RTOSTmrPrev = NULL;
 
-  hash_table[index].timer_count--;
-  // Unlock resources.
-  pthread_mutex_unlock(&hash_table_mutex);
+  __atomic_store_n(&ptmr->RTOSTmrDelay, delay, __ATOMIC_RELAXED);
+  __atomic_store_n(&ptmr->RTOSTmrPeriod, period, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&ptmr->RTOSTmrState, __ATOMIC_ACQUIRE) ==
+      RTOS_TMR_STATE_RUNNING) {
+    *perr = restart_timer_obj(ptmr, timer, delay);
+  }
+  return *perr == RTOS_SUCCESS;
 }
 
 /*
-  @ RTOSTmrTask().
-  - Timer task to manage the running timers.
-  - If the Timer is completed, call its Callback Function, remove the entry from
-  Hash table.
-  - If the Timer is Periodic then again insert it in the hash table change the
-  state.
+  @ RTOSTmrExecSet().
+  Choose where the callback of the timer runs: RTOS_TMR_EXEC_INLINE in the
+  timer task, RTOS_TMR_EXEC_POOL on the callback executor threads.
 */
-void *RTOSTmrTask(void *temp) {
+INT8U RTOSTmrExecSet(RTOS_TMR_HANDLE timer, INT8U exec, INT8U *perr) {
+  // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
+  if (ptmr == NULL) {
+    return RTOS_FALSE;
+  }
+  if (timer_deleted(ptmr)) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
+    return RTOS_FALSE;
+  }
 
-  while (1) {
-    // Wait for signal from RTOSTmrSignal(), Once get the signal, increment the
-    // timer tick counter.
-    sem_wait(&timer_task_sem);
-
-    // Check the whole list associated with the index of the Hash table.
-    int index = RTOSTmrTickCtr % 10;
-    // Compare each obj of linked list for timer completion.
-    RTOS_TMR *tempTmr = hash_table[index].list_ptr;
-    while (tempTmr != NULL) {
-      RTOS_TMR *timer = tempTmr;
-      tempTmr = tempTmr->RTOSTmrNext;
-      if (timer->RTOSTmrMatch == RTOSTmrTickCtr) {
-        timer->RTOSTmrCallback(timer->RTOSTmrCallbackArg);
-        timer->RTOSTmrState = RTOS_TMR_STATE_COMPLETED;
-        remove_hash_entry(timer);
-        if (timer->RTOSTmrOpt == RTOS_TMR_ONE_SHOT) {
-          free_timer_obj(timer);
-        } else {
-          timer->RTOSTmrMatch = RTOSTmrTickCtr + timer->RTOSTmrPeriod;
-          timer->RTOSTmrState = RTOS_TMR_STATE_RUNNING;
-          insert_hash_entry(timer);
-        }
-        continue;
-      } else {
-        break;
-      }
-    }
-    RTOSTmrTickCtr++;
+  if (exec == RTOS_TMR_EXEC_INLINE) {
+    __atomic_and_fetch(&ptmr->RTOSTmrFlags, ~RTOS_TMR_FLAG_POOL,
+                       __ATOMIC_RELAXED);
+  } else if (exec == RTOS_TMR_EXEC_POOL && RTOS_CFG_TMR_EXEC_THREADS) {
+    __atomic_or_fetch(&ptmr->RTOSTmrFlags, RTOS_TMR_FLAG_POOL,
+                      __ATOMIC_RELAXED);
+  } else {
+    *perr = RTOS_ERR_TMR_INVALID_OPT;
+    return RTOS_FALSE;
   }
-  return temp;
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
 }
 
 /*
-  @ RTOSTmrInit().
-  Initialize the all timer attributes.
+  @ RTOSTmrSlackSet().
+  - Let the timer expire up to slack ticks (at most RTOS_TMR_MAX_SLACK) after
+  its deadline, so the manager can move the expiry onto a tick that already
+  has other expiries and the timer task wakes up less often.
+  - Applies from the next start or Periodic re-insert on, 0 for exact expiry.
 */
-void RTOSTmrInit(void) {
-  INT8U retVal;
-  INT32U timer_count = 0;
-  pthread_attr_t attr;
-
-  fprintf(
-      stdout,
-      "\n\nPlease Enter the number of Timers required in the Pool for the OS ");
-  scanf("%d", &timer_count);
+INT8U RTOSTmrSlackSet(RTOS_TMR_HANDLE timer, INT32U slack, INT8U *perr) {
+  // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
+  if (ptmr == NULL) {
+    return RTOS_FALSE;
+  }
+  if (timer_deleted(ptmr)) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
+    return RTOS_FALSE;
+  }
+  if (slack > RTOS_TMR_MAX_SLACK) {
+    *perr = RTOS_ERR_TMR_INVALID_SLACK;
+    return RTOS_FALSE;
+  }
 
-  // Create timer pool.
-  retVal = Create_Timer_Pool(timer_count);
+  __atomic_store_n(&ptmr->RTOSTmrSlack, slack, __ATOMIC_RELAXED);
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
+}
 
-  // Check the return value.
-  if (retVal != RTOS_SUCCESS) {
-    fprintf(stdout, "\nTimer Creation failed Error = %d\n", retVal);
-    return;
+/*
+  @ RTOSTmrPrioSet().
+  - Move the timer to priority class prio (RTOS_TMR_PRIO_*): of the timers
+  expiring on the same tick, the higher classes are dispatched first, and the
+  tick budget never defers a class from RTOS_CFG_TMR_BUDGET_PRIO up.
+  - Applies from the next expiry on, an expiry waiting for dispatch keeps its
+  class.
+*/
+INT8U RTOSTmrPrioSet(RTOS_TMR_HANDLE timer, INT8U prio, INT8U *perr) {
+  // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
+  if (ptmr == NULL) {
+    return RTOS_FALSE;
+  }
+  if (timer_deleted(ptmr)) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
+    return RTOS_FALSE;
+  }
+  if (prio >= RTOS_TMR_PRIO_CLASSES) {
+    *perr = RTOS_ERR_TMR_INVALID_PRIO;
+    return RTOS_FALSE;
   }
-  // Initialize Hash table.
-  init_hash_table();
-  fprintf(stdout, "\n\nHash Table Initialized Successfully\n");
 
-  // Initialize Semaphore for timer task.
-  sem_init(&timer_task_sem, 0, 0);
+  __atomic_store_n(&ptmr->RTOSTmrPrio, prio, __ATOMIC_RELAXED);
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
+}
 
-  // Initialize Mutex if any
-  pthread_mutex_init(&timer_pool_mutex, NULL);
+/*
+  @ RTOSTmrBudgetSet().
+  Let the callbacks of a tick run for ns before the expiries left below class
+  RTOS_CFG_TMR_BUDGET_PRIO wait for the next tick, 0 for no budget. Starts at
+  RTOS_CFG_TMR_TICK_BUDGET_NS.
+*/
+void RTOSTmrBudgetSet(INT64U ns) {
+  __atomic_store_n(&tick_budget_ns, ns, __ATOMIC_RELAXED);
+}
 
-  // Create any thread if required for timer task.
-  pthread_create(&thread, NULL, RTOSTmrTask, NULL);
-  fprintf(stdout, "\nRTOS Initialization Done...\n");
+/*
+  @ RTOSTmrSpreadSet().
+  - Set how the Periodic timers started with delay 0 from now on pick the
+  tick of their first expiry, RTOS_TMR_SPREAD_*. Starts at
+  RTOS_CFG_TMR_SPREAD_MODE.
+  - RTOS_TMR_SPREAD_OFF expires them on the start tick, so timers started
+  together expire together on every period. The other modes spread them over
+  their period, see start_timer_delay().
+*/
+INT8U RTOSTmrSpreadSet(INT8U mode, INT8U *perr) {
+  if (mode > RTOS_TMR_SPREAD_RANDOM) {
+    *perr = RTOS_ERR_TMR_INVALID_SPREAD;
+    return RTOS_FALSE;
+  }
+  __atomic_store_n(&tmr_spread_mode, mode, __ATOMIC_RELAXED);
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
 }
 
 /*
-  @ alloc_timer_obj().
-  Allocate a timer object from free timer pool.
+  @ RTOSTmrShardSelect().
+  Make the calling thread create its timers on the given shard, for example
+  the shard whose timer task is pinned next to the thread's own CPU.
+*/
+INT8U RTOSTmrShardSelect(INT32U shard, INT8U *perr) {
+  if (shard >= TmrShardCount) {
+    *perr = RTOS_ERR_TMR_INVALID_SHARD;
+    return RTOS_FALSE;
+  }
+  tmr_shard_select = shard;
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
+}
+
+/*
+  @ RTOSTmrShardGet().
+  Get the shard the timer runs on.
+*/
+INT32U RTOSTmrShardGet(RTOS_TMR_HANDLE timer, INT8U *perr) {
+  // ERROR checking.
+  RTOS_TMR *ptmr = lookup_timer(timer, perr);
+  if (ptmr == NULL) {
+    return 0;
+  } else if (timer_deleted(ptmr)) {
+    *perr = RTOS_ERR_TMR_INACTIVE;
+    return 0;
+  }
+  *perr = RTOS_SUCCESS;
+  return ptmr->RTOSTmrShard;
+}
+
+/*
+  @ RTOSTmrShardCount().
+  Get the number of shards.
+*/
+INT32U RTOSTmrShardCount(void) { return TmrShardCount; }
+
+/*
+  @ RTOSTmrSignal().
+  Function called when OS tick Interrupt occurs which will signal the
+  RTOSTmrTask() to update the timers.
+*/
+void RTOSTmrSignal(int signum) {
+  // Send the signal to the timer task of every shard using Semaphore.
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    sem_post(&TmrShard[i].task_sem);
+  }
+}
+
+/*
+  @ RTOSTmrPoolInfoGet().
+  Get the size and the memory footprint of the timer pool.
+*/
+void RTOSTmrPoolInfoGet(RTOS_TMR_POOL_INFO *info) {
+  pthread_mutex_lock(&timer_pool_mutex);
+  info->pool_size = TmrPoolChunkCount * RTOS_CFG_TMR_POOL_CHUNK_SIZE;
+  info->free_count = FreeTmrCount;
+  info->chunk_count = TmrPoolChunkCount;
+  info->pool_bytes =
+      (INT64U)TmrPoolChunkCount *
+          (RTOS_TMR_CHUNK_BYTES + RTOS_TMR_COLD_CHUNK_BYTES) +
+      (INT64U)FreeTmrStackSize * sizeof(INT32U);
+  info->bytes_per_timer =
+      info->pool_size ? (INT32U)(info->pool_bytes / info->pool_size) : 0;
+  pthread_mutex_unlock(&timer_pool_mutex);
+}
+
+/*****************************************************
+ * Internal Functions
+ *****************************************************
+ */
+/*
+  @ Create_Timer_Pool().
+  - Create pool of timers.
+  - Grow the timer pool chunk by chunk until it holds at least timer_count
+  timers. More chunks are added on demand by alloc_timer_obj().
+*/
+INT8U Create_Timer_Pool(INT32U timer_count) {
+  INT8U retVal = RTOS_SUCCESS;
+
+  RTOS_TMR_DEBUG("Create_Timer_Pool start\n");
+  RTOS_TMR_DEBUG("Create_Timer_Pool timer_count = %d FreeTmrCount = %d\n",
+                 timer_count, FreeTmrCount);
+  if (timer_count == 0) {
+    RTOS_TMR_ERR("\nTimer count is zero\n");
+    return RTOS_MALLOC_ERR;
+  }
+  pthread_mutex_lock(&timer_pool_mutex);
+  while (retVal == RTOS_SUCCESS &&
+         TmrPoolChunkCount * RTOS_CFG_TMR_POOL_CHUNK_SIZE < timer_count) {
+    retVal = grow_timer_pool();
+  }
+  pthread_mutex_unlock(&timer_pool_mutex);
+  RTOS_TMR_DEBUG("Create_Timer_Pool end\n");
+  return retVal;
+}
+
+/*
+  @ grow_timer_pool().
+  - Add one cache line aligned chunk of RTOS_CFG_TMR_POOL_CHUNK_SIZE timers,
+  and one of their cold fields, to the pool and push their ids on the free
+  stack. Every timer starts at generation 1.
+  - Caller holds timer_pool_mutex.
+*/
+INT8U grow_timer_pool(void) {
+  INT32U base = TmrPoolChunkCount * RTOS_CFG_TMR_POOL_CHUNK_SIZE;
+  RTOS_TMR *chunk;
+  RTOS_TMR_COLD *cold;
+
+  if (TmrPoolChunkCount == RTOS_CFG_TMR_POOL_MAX_CHUNKS) {
+    return RTOS_ERR_TMR_NON_AVAIL;
+  }
+  // Every timer id of the pool must fit on the free stack.
+  if (FreeTmrStackSize < base + RTOS_CFG_TMR_POOL_CHUNK_SIZE) {
+    INT32U size = FreeTmrStackSize ? FreeTmrStackSize * 2
+                                   : RTOS_CFG_TMR_POOL_CHUNK_SIZE;
+    INT32U *stack = realloc(FreeTmrStack, size * sizeof(INT32U));
+    if (stack == NULL) {
+      return RTOS_MALLOC_ERR;
+    }
+    FreeTmrStack = stack;
+    FreeTmrStackSize = size;
+  }
+  // From the pool file if there is one, see RTOSTmrPersistOpen().
+  if (map_persist_chunk(TmrPoolChunkCount, &chunk, &cold) != RTOS_SUCCESS) {
+    return RTOS_MALLOC_ERR;
+  }
+  if (chunk == NULL) {
+    chunk = aligned_alloc(RTOS_CACHE_LINE_SIZE, RTOS_TMR_CHUNK_BYTES);
+    cold = aligned_alloc(RTOS_CACHE_LINE_SIZE, RTOS_TMR_COLD_CHUNK_BYTES);
+  }
+  if (chunk == NULL || cold == NULL) {
+    free(chunk);
+    free(cold);
+    return RTOS_MALLOC_ERR;
+  }
+  memset(chunk, 0, RTOS_TMR_CHUNK_BYTES);
+  memset(cold, 0, RTOS_TMR_COLD_CHUNK_BYTES);
+  for (INT32U i = 0; i < RTOS_CFG_TMR_POOL_CHUNK_SIZE; i++) {
+    chunk[i].RTOSTmrHandle = RTOS_TMR_HANDLE_GEN_ONE | (base + i);
+    chunk[i].RTOSTmrState = RTOS_TMR_STATE_UNUSED;
+    chunk[i].RTOSTmrSlot = RTOS_TMR_WHEEL_NO_SLOT;
+  }
+  TmrPoolChunk[TmrPoolChunkCount] = chunk;
+  TmrPoolCold[TmrPoolChunkCount] = cold;
+  // Published last, handles are resolved without timer_pool_mutex.
+  __atomic_store_n(&TmrPoolChunkCount, TmrPoolChunkCount + 1,
+                   __ATOMIC_RELEASE);
+  persist_timer_chunks(TmrPoolChunkCount);
+  // Lowest ids on top, so they are handed out first.
+  for (INT32U i = RTOS_CFG_TMR_POOL_CHUNK_SIZE; i > 0; i--) {
+    FreeTmrStack[FreeTmrCount++] = base + i - 1;
+  }
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ get_timer_obj().
+  Get the timer object of a pool id, NULL if the id is out of the pool.
+*/
+RTOS_TMR *get_timer_obj(INT32U id) {
+  if ((id >> RTOS_CFG_TMR_POOL_CHUNK_BITS) >=
+      __atomic_load_n(&TmrPoolChunkCount, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &TmrPoolChunk[id >> RTOS_CFG_TMR_POOL_CHUNK_BITS]
+                      [id & (RTOS_CFG_TMR_POOL_CHUNK_SIZE - 1)];
+}
+
+/*
+  @ get_timer_cold().
+  Get the cold fields of a timer, at its pool id in TmrPoolCold.
+*/
+RTOS_TMR_COLD *get_timer_cold(RTOS_TMR *timer) {
+  INT32U id = RTOS_TMR_HANDLE_ID(
+      __atomic_load_n(&timer->RTOSTmrHandle, __ATOMIC_RELAXED));
+  return &TmrPoolCold[id >> RTOS_CFG_TMR_POOL_CHUNK_BITS]
+                     [id & (RTOS_CFG_TMR_POOL_CHUNK_SIZE - 1)];
+}
+
+/*
+  @ store_link().
+  Link the timer in the timer store of its shard at RTOSTmrMatch. A timer the
+  store has no room for is stopped. Caller holds the shard mutex.
+*/
+static INT8U store_link(TMR_SHARD *shard, RTOS_TMR *timer_obj) {
+  if (shard->store->insert(shard, timer_obj) != RTOS_SUCCESS) {
+    RTOS_TMR_ERR("Timer store of shard %u is full\n",
+                 (unsigned)(shard - TmrShard));
+    timer_obj->RTOSTmrState = RTOS_TMR_STATE_STOPPED;
+    return RTOS_MALLOC_ERR;
+  }
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+  shard->timer_count++;
+#endif
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ store_unlink().
+  Unlink the timer from the timer store of its shard, if it is linked.
+  Returns RTOS_TRUE if the timer was a tombstone (see cancel_timer_obj()).
+  Caller holds the shard mutex.
+*/
+static INT8U store_unlink(TMR_SHARD *shard, RTOS_TMR *timer_obj) {
+  INT8U tombstone = RTOS_FALSE;
+
+  if (timer_obj->RTOSTmrSlot == RTOS_TMR_WHEEL_NO_SLOT) {
+    return RTOS_FALSE;
+  }
+  shard->store->remove(shard, timer_obj);
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+  shard->timer_count--;
+  if (__atomic_load_n(&timer_obj->RTOSTmrState, __ATOMIC_ACQUIRE) ==
+      RTOS_TMR_STATE_STOPPED) {
+    __atomic_sub_fetch(&shard->tombstones, 1, __ATOMIC_RELAXED);
+    tombstone = RTOS_TRUE;
+  }
+#endif
+  return tombstone;
+}
+
+/*
+  @ store_dropped().
+  Account for tombstones the timer store unlinked by itself.
+  Caller holds the shard mutex.
+*/
+static inline void store_dropped(TMR_SHARD *shard, INT32U dropped) {
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+  shard->timer_count -= dropped;
+  __atomic_sub_fetch(&shard->tombstones, dropped, __ATOMIC_RELAXED);
+#else
+  (void)shard;
+  (void)dropped;
+#endif
+}
+
+/*
+  @ next_timer_deadline().
+  - Find the next tick at which the shard has work: the current tick while
+  the tick budget holds back expiries in the dispatch array, otherwise the
+  next deadline in the timer store.
+  - Returns RTOS_FALSE if both are empty. Caller holds the shard mutex.
+*/
+INT8U next_timer_deadline(TMR_SHARD *shard, INT32U *deadline) {
+  if (shard->due_count != 0) {
+    *deadline = shard->tick;
+    return RTOS_TRUE;
+  }
+  return shard->store->next_deadline(shard, deadline);
+}
+
+/*
+  @ apply_timer_slack().
+  - Move RTOSTmrMatch of a timer with slack within [match, match + slack] onto
+  a tick that already has expiries, if the timer store can find one (the
+  wheel looks up its level 0 occupancy bitmap).
+  - If there is none, round match up to the coarsest multiple of a power of 2
+  in the range instead, where timers with similar slack meet.
+  - A moved timer keeps its deadline in RTOSTmrDeadline, which the next period
+  counts from, see next_timer_period().
+  - Caller holds the shard mutex.
+*/
+static void apply_timer_slack(TMR_SHARD *shard, RTOS_TMR *timer) {
+  INT32U slack = __atomic_load_n(&timer->RTOSTmrSlack, __ATOMIC_RELAXED);
+  INT32U match = timer->RTOSTmrMatch;
+  INT32U delta = match - shard->tick;
+  INT8U coalesced = RTOS_FALSE;
+
+  if (timer->RTOSTmrFlags & RTOS_TMR_FLAG_SLACK) {
+    __atomic_and_fetch(&timer->RTOSTmrFlags, ~RTOS_TMR_FLAG_SLACK,
+                       __ATOMIC_RELAXED);
+  }
+  if (slack == 0 || (INT32)delta < 0) {
+    return;
+  }
+  if (shard->store->busy_tick != NULL &&
+      shard->store->busy_tick(shard, match, slack, &match)) {
+    coalesced = RTOS_TRUE;
+  }
+  if (!coalesced) {
+    INT32U step = 1U << (31 - __builtin_clz(slack + 1));
+    match = (match + step - 1) & ~(step - 1);
+  }
+  if (match != timer->RTOSTmrMatch) {
+    get_timer_cold(timer)->RTOSTmrDeadline = timer->RTOSTmrMatch;
+    __atomic_or_fetch(&timer->RTOSTmrFlags, RTOS_TMR_FLAG_SLACK,
+                      __ATOMIC_RELAXED);
+  }
+  timer->RTOSTmrMatch = match;
+#if RTOS_CFG_TMR_STATS_EN
+  shard->slack_placed++;
+  shard->slack_coalesced += coalesced;
+#endif
+}
+
+/*
+  @ next_timer_period().
+  - Deadline of the next expiry of a Periodic timer that expired at match:
+  one period on from the deadline before the slack moved it, so neither the
+  slack nor an expiry the tick budget held back shift the phase of the timer,
+  the lateness only shows in the statistics.
+  - Periods that passed in full by tick, the tick being processed, are
+  skipped.
+*/
+static INT32U next_timer_period(RTOS_TMR *timer, INT32U match, INT32U tick) {
+  INT32U period = timer->RTOSTmrPeriod;
+
+  if (timer->RTOSTmrFlags & RTOS_TMR_FLAG_SLACK) {
+    match = get_timer_cold(timer)->RTOSTmrDeadline;
+  }
+  match += period;
+  if ((INT32)(match - tick) <= 0) {
+    match += ((tick - match) / period + 1) * period;
+  }
+  return match;
+}
+
+#if RTOS_CFG_TMR_TICKLESS_EN
+/*
+  @ elapsed_ticks().
+  Number of the last tick that is due by the clock.
+*/
+static INT32U elapsed_ticks(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  INT64 ns = (INT64)(now.tv_sec - tick_epoch.tv_sec) * 1000000000LL +
+             (now.tv_nsec - tick_epoch.tv_nsec);
+  return (INT32U)(ns / RTOS_CFG_TMR_TASK_RATE);
+}
+
+/*
+  @ arm_tick_timer().
+  Arm the one shot OS timer for the time of the given tick.
+  Caller holds the shard mutex.
+*/
+static void arm_tick_timer(TMR_SHARD *shard, INT32U tick) {
+  struct itimerspec time_value = {{0, 0}, {0, 0}};
+  INT64U ns = (INT64U)tick * RTOS_CFG_TMR_TASK_RATE + tick_epoch.tv_nsec;
+
+  if (!shard->tick_timer_ready) {
+    return;
+  }
+  time_value.it_value.tv_sec = tick_epoch.tv_sec + ns / 1000000000ULL;
+  time_value.it_value.tv_nsec = ns % 1000000000ULL;
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  timerfd_settime(shard->tick_timer_id, TFD_TIMER_ABSTIME, &time_value, NULL);
+#else
+  timer_settime(shard->tick_timer_id, TIMER_ABSTIME, &time_value, NULL);
+#endif
+  shard->tick_timer_match = tick;
+  shard->tick_timer_armed = RTOS_TRUE;
+}
+
+/*
+  @ rearm_tick_timer().
+  Arm the OS timer for the next deadline in the timer store, or disarm it when
+  no timer is running. Caller holds the shard mutex.
+*/
+static void rearm_tick_timer(TMR_SHARD *shard) {
+  struct itimerspec time_value = {{0, 0}, {0, 0}};
+  INT32U deadline;
+
+  if (next_timer_deadline(shard, &deadline)) {
+    arm_tick_timer(shard, deadline);
+  } else if (shard->tick_timer_ready) {
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+    timerfd_settime(shard->tick_timer_id, 0, &time_value, NULL);
+#else
+    timer_settime(shard->tick_timer_id, 0, &time_value, NULL);
+#endif
+    shard->tick_timer_armed = RTOS_FALSE;
+  }
+}
+
+/*
+  @ create_tick_timer().
+  - Create the one shot OS timer of a shard. It signals SIGALRM with the shard
+  as value, so only that shard's timer task is woken.
+  - In event loop mode it is a timerfd in the epoll set of RTOSTmrFdGet().
+*/
+static void create_tick_timer(TMR_SHARD *shard) {
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = shard;
+  pthread_mutex_lock(&shard->mutex);
+  shard->tick_timer_id =
+      timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (shard->tick_timer_id < 0 ||
+      epoll_ctl(tmr_epoll_fd, EPOLL_CTL_ADD, shard->tick_timer_id, &event) <
+          0) {
+    RTOS_TMR_ERR("\nTick timerfd creation failed\n");
+    pthread_mutex_unlock(&shard->mutex);
+    return;
+  }
+#else
+  struct sigevent event;
+
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_SIGNAL;
+  event.sigev_signo = SIGALRM;
+  event.sigev_value.sival_ptr = shard;
+  pthread_mutex_lock(&shard->mutex);
+  timer_create(CLOCK_MONOTONIC, &event, &shard->tick_timer_id);
+#endif
+  shard->tick_timer_ready = RTOS_TRUE;
+  rearm_tick_timer(shard);
+  pthread_mutex_unlock(&shard->mutex);
+}
+
+#if !RTOS_CFG_TMR_EVENT_LOOP_EN
+/*
+  @ tick_timer_signal().
+  SIGALRM handler in tickless mode: wake the shard whose OS timer expired.
+*/
+static void tick_timer_signal(int signum, siginfo_t *info, void *context) {
+  TMR_SHARD *shard = info->si_value.sival_ptr;
+
+  if (info->si_code == SI_TIMER && shard != NULL) {
+    sem_post(&shard->task_sem);
+  } else {
+    RTOSTmrSignal(signum);
+  }
+}
+#endif
+#endif
+
+#if RTOS_CFG_TMR_TICKLESS_EN && RTOS_CFG_TMR_CMD_QUEUE_SIZE
+/*
+  @ wake_timer_task().
+  Wake the timer task of a shard, in event loop mode the application through
+  the wakeup eventfd.
+*/
+static void wake_timer_task(TMR_SHARD *shard) {
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  INT64U one = 1;
+  ssize_t n = write(tmr_wake_fd, &one, sizeof(one));
+
+  // Fails only if the counter is saturated, which is still readable.
+  (void)n;
+  (void)shard;
+#else
+  sem_post(&shard->task_sem);
+#endif
+}
+#endif
+
+/*
+  @ current_timer_tick().
+  Tick a timer started now counts its Delay from. In tickless mode
+  shard->tick only catches up when the timer task wakes, so the tick is
+  taken from the clock when that is ahead.
+*/
+INT32U current_timer_tick(TMR_SHARD *shard) {
+#if RTOS_CFG_TMR_TICKLESS_EN
+  if (shard->tick_timer_ready) {
+    INT32U tick = elapsed_ticks();
+    if ((INT32)(tick - shard->tick) > 0)
+      return tick;
+  }
+#endif
+  return shard->tick;
+}
+
+/*
+  @ insert_timer_entry().
+  Mark the timer object running and insert it in the timer store to expire
+  delay ticks from now. A timer that is already linked (or a tombstone) is
+  moved, under one acquisition of the shard mutex. RTOSTmrMatch only changes
+  once the timer is unlinked, the heap orders on it.
+  Returns RTOS_SUCCESS, RTOS_MALLOC_ERR if the store is full, or
+  RTOS_ERR_TMR_INACTIVE if the timer is being deleted.
+*/
+INT8U insert_timer_entry(RTOS_TMR *timer_obj, INT32U delay) {
+  TMR_SHARD *shard = timer_shard(timer_obj);
+  INT8U err;
+
+  // Lock the resources.
+  pthread_mutex_lock(&shard->mutex);
+  store_unlink(shard, timer_obj);
+  if (!set_timer_state(timer_obj, RTOS_TMR_STATE_RUNNING)) {
+    pthread_mutex_unlock(&shard->mutex);
+    return RTOS_ERR_TMR_INACTIVE;
+  }
+  timer_obj->RTOSTmrMatch = current_timer_tick(shard) + delay;
+  apply_timer_slack(shard, timer_obj);
+  err = store_link(shard, timer_obj);
+#if RTOS_CFG_TMR_TICKLESS_EN
+  // Bring the OS timer forward if this is the earliest deadline now.
+  if (err == RTOS_SUCCESS &&
+      (!shard->tick_timer_armed ||
+       (INT32)(timer_obj->RTOSTmrMatch - shard->tick_timer_match) < 0)) {
+    arm_tick_timer(shard, timer_obj->RTOSTmrMatch);
+  }
+#endif
+  // Unlock resources.
+  pthread_mutex_unlock(&shard->mutex);
+  return err;
+}
+
+/*
+  @ unlink_timer_entry().
+  Unlink the timer object from the timer store. Caller holds the shard mutex.
+*/
+static void unlink_timer_entry(TMR_SHARD *shard, RTOS_TMR *timer_obj) {
+#if RTOS_CFG_TMR_TICKLESS_EN
+  // Re-arm the OS timer if the earliest deadline went away.
+  if (timer_obj->RTOSTmrSlot != RTOS_TMR_WHEEL_NO_SLOT) {
+    store_unlink(shard, timer_obj);
+    if (shard->tick_timer_armed &&
+        timer_obj->RTOSTmrMatch == shard->tick_timer_match) {
+      rearm_tick_timer(shard);
+    }
+  }
+#else
+  store_unlink(shard, timer_obj);
+#endif
+}
+
+#if !RTOS_CFG_TMR_CMD_QUEUE_SIZE
+/*
+  @ unlink_deleted_timer().
+  Claim the timer of handle for a delete, see claim_timer_delete(), and unlink
+  it from the timer store. Returns RTOS_FALSE if the timer was deleted
+  already. Caller holds the shard mutex.
+*/
+static INT8U unlink_deleted_timer(TMR_SHARD *shard, RTOS_TMR *timer,
+                                  RTOS_TMR_HANDLE handle) {
+  INT8U state;
+
+  if (!claim_timer_delete(timer, handle, &state)) {
+    return RTOS_FALSE;
+  }
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+  // No longer STOPPED, so store_unlink() cannot tell a tombstone.
+  if (state == RTOS_TMR_STATE_STOPPED &&
+      timer->RTOSTmrSlot != RTOS_TMR_WHEEL_NO_SLOT) {
+    __atomic_sub_fetch(&shard->tombstones, 1, __ATOMIC_RELAXED);
+  }
+#endif
+  store_unlink(shard, timer);
+  return RTOS_TRUE;
+}
+
+/*
+  @ delete_timer_entry().
+  - Claim the timer of handle for a delete, unlink it from the timer store and
+  free it, all under one acquisition of the shard mutex. Of racing deletes,
+  and of a delete and the expiry freeing a One Shot timer, only one frees it.
+  - Returns RTOS_FALSE if the timer was deleted already.
+*/
+INT8U delete_timer_entry(RTOS_TMR *timer_obj, RTOS_TMR_HANDLE handle) {
+  TMR_SHARD *shard = timer_shard(timer_obj);
+  INT8U deleted;
+
+  pthread_mutex_lock(&shard->mutex);
+#if RTOS_CFG_TMR_TICKLESS_EN
+  // Re-arm the OS timer if the earliest deadline goes away.
+  INT8U rearm = shard->tick_timer_armed &&
+                timer_obj->RTOSTmrSlot != RTOS_TMR_WHEEL_NO_SLOT &&
+                timer_obj->RTOSTmrMatch == shard->tick_timer_match;
+#endif
+  deleted = unlink_deleted_timer(shard, timer_obj, handle);
+  if (deleted) {
+#if RTOS_CFG_TMR_TICKLESS_EN
+    if (rearm) {
+      rearm_tick_timer(shard);
+    }
+#endif
+    // Freed under the mutex, see claim_timer_delete().
+    release_timer_obj(timer_obj);
+  }
+  pthread_mutex_unlock(&shard->mutex);
+  return deleted;
+}
+#endif
+
+/*
+  @ stop_timer_entry().
+  Mark the timer STOPPED and unlink it from the timer store, under one
+  acquisition of the shard mutex. Returns RTOS_FALSE, leaving the timer alone,
+  if it is being deleted.
+*/
+INT8U stop_timer_entry(RTOS_TMR *timer_obj) {
+  TMR_SHARD *shard = timer_shard(timer_obj);
+  INT8U stopped;
+
+  pthread_mutex_lock(&shard->mutex);
+  stopped = set_timer_state(timer_obj, RTOS_TMR_STATE_STOPPED);
+  if (stopped) {
+    unlink_timer_entry(shard, timer_obj);
+  }
+  pthread_mutex_unlock(&shard->mutex);
+  return stopped;
+}
+
+/*
+  @ cancel_running_timer().
+  - Stop the timer of handle if it is RUNNING, in the same state change the
+  expiry makes to COMPLETED, so exactly one of the two wins.
+  - The handle is checked under the shard mutex, which the expiry holds to
+  free a One Shot timer (see free_expired_timer()): a timer that expired, went
+  back to the pool and runs again for another handle is left alone.
+  - Returns RTOS_SUCCESS, RTOS_ERR_TMR_INACTIVE for a stale handle, or
+  RTOS_ERR_TMR_INVALID_STATE if the timer was not running.
+*/
+static INT8U cancel_running_timer(RTOS_TMR *timer, RTOS_TMR_HANDLE handle) {
+  TMR_SHARD *shard = timer_shard(timer);
+  INT8U state = RTOS_TMR_STATE_RUNNING;
+  INT8U err = RTOS_SUCCESS;
+
+  pthread_mutex_lock(&shard->mutex);
+  if (__atomic_load_n(&timer->RTOSTmrHandle, __ATOMIC_ACQUIRE) != handle) {
+    err = RTOS_ERR_TMR_INACTIVE;
+  } else if (!__atomic_compare_exchange_n(&timer->RTOSTmrState, &state,
+                                          RTOS_TMR_STATE_STOPPED, 0,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE)) {
+    err = RTOS_ERR_TMR_INVALID_STATE;
+  } else {
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN && !RTOS_CFG_TMR_CMD_QUEUE_SIZE
+    // Leave a tombstone, the timer task unlinks it.
+    __atomic_add_fetch(&shard->tombstones, 1, __ATOMIC_RELAXED);
+#elif !RTOS_CFG_TMR_CMD_QUEUE_SIZE
+    // A RUNNING timer is linked in the store.
+    unlink_timer_entry(shard, timer);
+#endif
+  }
+  pthread_mutex_unlock(&shard->mutex);
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  // The timer task unlinks it.
+  if (err == RTOS_SUCCESS) {
+    send_timer_cmd(RTOS_TMR_CMD_STOP, timer, handle, 0);
+  }
+#endif
+  return err;
+}
+
+/*
+  @ RTOSTmrCancel().
+  - Stop a running timer only if its expiry has not begun: on RTOS_TRUE its
+  callback does not run for that expiry, whatever the tick is doing. Fails
+  with RTOS_ERR_TMR_INVALID_STATE if the timer is not running, e.g. it
+  expired and its callback runs or ran, and with RTOS_ERR_TMR_INACTIVE for a
+  stale handle, also when a One Shot timer expires and goes back to the pool
+  during the call.
+  - No stop callback, nothing printed. Where RTOSTmrStop() may come too late
+  for an expiry under way, this tells the caller who won.
+*/
+INT8U RTOSTmrCancel(RTOS_TMR_HANDLE timer, INT8U *perr) {
+  RTOS_TMR *ptmr = resolve_timer(timer, perr);
+
+  if (ptmr == NULL) {
+    return RTOS_FALSE;
+  }
+  *perr = cancel_running_timer(ptmr, timer);
+  if (*perr != RTOS_SUCCESS) {
+    return RTOS_FALSE;
+  }
+#if RTOS_CFG_TMR_TRACE_EN
+  trace_timer_event(RTOS_TMR_TRACE_STOP, ptmr, 0);
+#endif
+  return RTOS_TRUE;
+}
+
+#if !RTOS_CFG_TMR_CMD_QUEUE_SIZE
+/*
+  @ compare_batch_dist().
+  qsort() order of batch entries: by ticks until expiry.
+*/
+static int compare_batch_dist(const void *a, const void *b) {
+  INT32U dist_a = ((const TMR_BATCH_ENTRY *)a)->dist;
+  INT32U dist_b = ((const TMR_BATCH_ENTRY *)b)->dist;
+  return (dist_a > dist_b) - (dist_a < dist_b);
+}
+
+/*
+  @ apply_timer_batch().
+  - Start, stop or unlink for delete (op is a RTOS_TMR_CMD_*) n timers of one
+  shard under a single acquisition of the shard mutex.
+  - Started timers are sorted by expiry before they are linked, so the wheel
+  touches every slot list once in a row and the heap mostly appends, and the
+  tickless OS timer is armed once for the whole batch.
+*/
+static void apply_timer_batch(TMR_SHARD *shard, TMR_BATCH_ENTRY *entry,
+                              INT32U n, INT8U op) {
+  pthread_mutex_lock(&shard->mutex);
+  INT32U tick = current_timer_tick(shard);
+  INT32U first = 0;
+  INT32U started = 0;
+  INT8U rearm = RTOS_FALSE;
+
+  for (INT32U i = 0; i < n; i++) {
+    RTOS_TMR *timer = entry[i].timer;
+#if RTOS_CFG_TMR_TICKLESS_EN
+    if (shard->tick_timer_armed &&
+        timer->RTOSTmrSlot != RTOS_TMR_WHEEL_NO_SLOT &&
+        timer->RTOSTmrMatch == shard->tick_timer_match) {
+      rearm = RTOS_TRUE;
+    }
+#endif
+    if (op == RTOS_TMR_CMD_DEL) {
+      // Keep the timers this delete claimed.
+      if (unlink_deleted_timer(shard, timer, entry[i].handle)) {
+        entry[started++].timer = timer;
+      }
+      continue;
+    }
+    store_unlink(shard, timer);
+    if (op == RTOS_TMR_CMD_START) {
+      // A timer being deleted stays unlinked.
+      if (!set_timer_state(timer, RTOS_TMR_STATE_RUNNING)) {
+        continue;
+      }
+      timer->RTOSTmrMatch = tick + start_timer_delay(timer);
+      apply_timer_slack(shard, timer);
+      if (started == 0 || (INT32)(timer->RTOSTmrMatch - first) < 0)
+        first = timer->RTOSTmrMatch;
+      entry[started].timer = timer;
+      entry[started++].dist = timer->RTOSTmrMatch - tick;
+    } else if (op == RTOS_TMR_CMD_STOP) {
+      set_timer_state(timer, RTOS_TMR_STATE_STOPPED);
+    }
+  }
+  if (op == RTOS_TMR_CMD_START) {
+    qsort(entry, started, sizeof(TMR_BATCH_ENTRY), compare_batch_dist);
+    for (INT32U i = 0; i < started; i++) {
+      store_link(shard, entry[i].timer);
+    }
+  }
+#if RTOS_CFG_TMR_TICKLESS_EN
+  if (rearm) {
+    rearm_tick_timer(shard);
+  } else if (started != 0 &&
+             (!shard->tick_timer_armed ||
+              (INT32)(first - shard->tick_timer_match) < 0)) {
+    arm_tick_timer(shard, first);
+  }
+#else
+  (void)first;
+  (void)rearm;
+#endif
+  if (op == RTOS_TMR_CMD_DEL) {
+    // Give the timers back to the pool in one go, under the mutex, see
+    // claim_timer_delete().
+    RTOS_TMR *dead[RTOS_TMR_BATCH_CHUNK];
+    INT32U count = 0;
+    for (INT32U i = 0; i < started; i++) {
+      if (!defer_timer_free(entry[i].timer)) {
+        dead[count++] = entry[i].timer;
+      }
+    }
+    free_timer_batch(dead, count);
+  }
+  pthread_mutex_unlock(&shard->mutex);
+}
+
+#endif
+
+/*
+  @ run_timer_batch().
+  - Apply op to every timer of the array whose errs[] entry is RTOS_SUCCESS
+  and whose handle is still current.
+  - Runs of timers on the same shard are applied in chunks of
+  RTOS_TMR_BATCH_CHUNK by apply_timer_batch(). With the command queue every
+  timer just gets its command, which needs no lock anyway.
+*/
+static void run_timer_batch(const RTOS_TMR_HANDLE *timers, INT32U count,
+                            INT8U *errs, INT8U op) {
+  INT8U err;
+
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  for (INT32U i = 0; i < count; i++) {
+    RTOS_TMR *timer;
+    if (errs[i] != RTOS_SUCCESS ||
+        (timer = resolve_timer(timers[i], &err)) == NULL) {
+      continue;
+    }
+    if (op == RTOS_TMR_CMD_START) {
+      INT32U tick = current_timer_tick(timer_shard(timer));
+      if (set_timer_state(timer, RTOS_TMR_STATE_RUNNING)) {
+        send_timer_cmd(op, timer, timers[i], tick + start_timer_delay(timer));
+      }
+    } else if (op == RTOS_TMR_CMD_STOP) {
+      // Stop it right away, see RTOSTmrStop().
+      if (set_timer_state(timer, RTOS_TMR_STATE_STOPPED)) {
+        send_timer_cmd(op, timer, timers[i], 0);
+      }
+    } else {
+      // Claim it right away, see RTOSTmrDel().
+      TMR_SHARD *shard = timer_shard(timer);
+      INT8U state, claimed;
+      pthread_mutex_lock(&shard->mutex);
+      claimed = claim_timer_delete(timer, timers[i], &state);
+      pthread_mutex_unlock(&shard->mutex);
+      if (claimed) {
+        send_timer_cmd(op, timer, timers[i], 0);
+      }
+    }
+  }
+#else
+  TMR_BATCH_ENTRY entry[RTOS_TMR_BATCH_CHUNK];
+  TMR_SHARD *shard = NULL;
+  INT32U n = 0;
+
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+  if (op == RTOS_TMR_CMD_STOP) {
+    // Leave tombstones, no lock needed.
+    for (INT32U i = 0; i < count; i++) {
+      RTOS_TMR *timer;
+      if (errs[i] == RTOS_SUCCESS &&
+          (timer = resolve_timer(timers[i], &err)) != NULL) {
+        cancel_timer_obj(timer);
+      }
+    }
+    return;
+  }
+#endif
+
+  for (INT32U i = 0; i < count; i++) {
+    RTOS_TMR *timer;
+    if (errs[i] != RTOS_SUCCESS ||
+        (timer = resolve_timer(timers[i], &err)) == NULL ||
+        timer_deleted(timer)) {
+      continue;
+    }
+    if (n == RTOS_TMR_BATCH_CHUNK ||
+        (n != 0 && timer_shard(timer) != shard)) {
+      apply_timer_batch(shard, entry, n, op);
+      n = 0;
+    }
+    shard = timer_shard(timer);
+    entry[n].handle = timers[i];
+    entry[n++].timer = timer;
+  }
+  if (n != 0) {
+    apply_timer_batch(shard, entry, n, op);
+  }
+#endif
+}
+
+/*
+  @ RTOSTmrCreateBatch().
+  - Create count timers, timers[i] from specs[i], taking them from the pool
+  with one timer_pool_mutex acquisition per RTOS_TMR_BATCH_CHUNK timers. A
+  spec with a payload_size copies its callback_arg as RTOSTmrCreatePayload().
+  - errs[i] gets the error code of every element and timers[i] is
+  RTOS_TMR_NO_HANDLE for the failed ones. Returns the number of timers
+  created. Nothing is printed.
+*/
+INT32U RTOSTmrCreateBatch(const RTOS_TMR_SPEC *specs, INT32U count,
+                          RTOS_TMR_HANDLE *timers, INT8U *errs) {
+  RTOS_TMR *chunk[RTOS_TMR_BATCH_CHUNK];
+  INT32U created = 0;
+
+  for (INT32U base = 0; base < count; base += RTOS_TMR_BATCH_CHUNK) {
+    INT32U end = count - base < RTOS_TMR_BATCH_CHUNK
+                     ? count
+                     : base + RTOS_TMR_BATCH_CHUNK;
+    INT32U wanted = 0, got, next = 0;
+
+    for (INT32U i = base; i < end; i++) {
+      timers[i] = RTOS_TMR_NO_HANDLE;
+      errs[i] =
+          check_timer_args(specs[i].delay, specs[i].period, specs[i].option);
+      if (errs[i] == RTOS_SUCCESS) {
+        wanted++;
+      }
+    }
+    got = alloc_timer_batch(chunk, wanted);
+    for (INT32U i = base; i < end; i++) {
+      if (errs[i] != RTOS_SUCCESS) {
+        continue;
+      }
+      if (next == got) {
+        errs[i] = RTOS_ERR_TMR_NON_AVAIL;
+        continue;
+      }
+      RTOS_TMR *timer = chunk[next++];
+      fill_timer_obj(timer, specs[i].delay, specs[i].period, specs[i].option,
+                     specs[i].callback, specs[i].callback_arg,
+                     specs[i].payload_size, specs[i].name);
+      timers[i] = timer->RTOSTmrHandle;
+#if RTOS_CFG_TMR_TRACE_EN
+      trace_timer_event(RTOS_TMR_TRACE_CREATE, timer, specs[i].delay);
+#endif
+    }
+    created += got;
+  }
+  return created;
+}
+
+/*
+  @ RTOSTmrStartBatch().
+  - Start count timers, taking each shard mutex once per
+  RTOS_TMR_BATCH_CHUNK timers and inserting them in expiry order.
+  - errs[i] gets the error code of every element. Returns the number of timers
+  started. Nothing is printed.
+*/
+INT32U RTOSTmrStartBatch(const RTOS_TMR_HANDLE *timers, INT32U count,
+                         INT8U *errs) {
+  INT32U started = 0;
+
+  for (INT32U i = 0; i < count; i++) {
+    RTOS_TMR *timer = resolve_timer(timers[i], &errs[i]);
+    if (timer == NULL) {
+      continue;
+    }
+    if (timer_deleted(timer)) {
+      errs[i] = RTOS_ERR_TMR_INACTIVE;
+      continue;
+    }
+    errs[i] = RTOS_SUCCESS;
+    started++;
+#if RTOS_CFG_TMR_TRACE_EN
+    trace_timer_event(RTOS_TMR_TRACE_START, timer,
+                      timer->RTOSTmrDelay);
+#endif
+  }
+  run_timer_batch(timers, count, errs, RTOS_TMR_CMD_START);
+  return started;
+}
+
+/*
+  @ RTOSTmrStopBatch().
+  - Stop count timers like RTOSTmrStop() with RTOS_TMR_OPT_NONE, taking each
+  shard mutex once per RTOS_TMR_BATCH_CHUNK timers.
+  - errs[i] gets the error code of every element. Returns the number of timers
+  stopped. Nothing is printed.
+*/
+INT32U RTOSTmrStopBatch(const RTOS_TMR_HANDLE *timers, INT32U count,
+                        INT8U *errs) {
+  INT32U stopped = 0;
+
+  for (INT32U i = 0; i < count; i++) {
+    RTOS_TMR *timer = resolve_timer(timers[i], &errs[i]);
+    if (timer == NULL) {
+      continue;
+    }
+    if (timer->RTOSTmrState == RTOS_TMR_STATE_STOPPED) {
+      errs[i] = RTOS_ERR_TMR_STOPPED;
+    } else if (timer_deleted(timer)) {
+      errs[i] = RTOS_ERR_TMR_INACTIVE;
+    } else {
+      errs[i] = RTOS_SUCCESS;
+      stopped++;
+#if RTOS_CFG_TMR_TRACE_EN
+      trace_timer_event(RTOS_TMR_TRACE_STOP, timer, 0);
+#endif
+    }
+  }
+  run_timer_batch(timers, count, errs, RTOS_TMR_CMD_STOP);
+  return stopped;
+}
+
+/*
+  @ RTOSTmrDelBatch().
+  - Delete count timers like RTOSTmrDel(), unlinking them under one
+  acquisition of each shard mutex and freeing them under one of
+  timer_pool_mutex per RTOS_TMR_BATCH_CHUNK timers.
+  - errs[i] gets the error code of every element, a timer deleted already is
+  no error. Returns the number of timers deleted. Nothing is printed.
+*/
+INT32U RTOSTmrDelBatch(const RTOS_TMR_HANDLE *timers, INT32U count,
+                       INT8U *errs) {
+  INT32U deleted = 0;
+
+  for (INT32U i = 0; i < count; i++) {
+    RTOS_TMR *timer = resolve_timer(timers[i], &errs[i]);
+    if (timer == NULL) {
+      if (errs[i] == RTOS_ERR_TMR_INACTIVE) {
+        // Deleted already, run_timer_batch() skips the stale handle.
+        errs[i] = RTOS_SUCCESS;
+        deleted++;
+      }
+      continue;
+    }
+    errs[i] = RTOS_SUCCESS;
+    deleted++;
+#if RTOS_CFG_TMR_TRACE_EN
+    trace_timer_event(RTOS_TMR_TRACE_DEL, timer, 0);
+#endif
+  }
+  run_timer_batch(timers, count, errs, RTOS_TMR_CMD_DEL);
+  return deleted;
+}
+
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+/*
+  @ drain_timer_cmds().
+  - Apply all queued start/stop/delete commands to the store in one batch.
+  The commands of a timer that went back to the pool since they were queued
+  are dropped, as is a start of a timer being deleted.
+  - Caller holds the shard mutex: the timer task at the start of a tick, or
+  a thread that found the queue full.
+*/
+void drain_timer_cmds(TMR_SHARD *shard) {
+  struct timespec t0, t1;
+  TMR_CMD cmd;
+  INT32U count = 0;
+
+  if (timer_ring_depth(&shard->cmd_ring) == 0) {
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  while (pop_timer_ring(&shard->cmd_ring, &cmd)) {
+    // Skip the commands of a timer freed since, and a start queued before a
+    // delete.
+    if (__atomic_load_n(&cmd.timer->RTOSTmrHandle, __ATOMIC_ACQUIRE) !=
+            cmd.handle ||
+        (cmd.op == RTOS_TMR_CMD_START &&
+         __atomic_load_n(&cmd.timer->RTOSTmrState, __ATOMIC_ACQUIRE) ==
+             RTOS_TMR_STATE_DELETING)) {
+      count++;
+      continue;
+    }
+    store_unlink(shard, cmd.timer);
+    if (cmd.op == RTOS_TMR_CMD_START) {
+      cmd.timer->RTOSTmrMatch = cmd.match;
+      apply_timer_slack(shard, cmd.timer);
+      store_link(shard, cmd.timer);
+    } else if (cmd.op == RTOS_TMR_CMD_DEL) {
+      release_timer_obj(cmd.timer);
+    }
+    count++;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  INT64U ns = (INT64U)(t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+              (t1.tv_nsec - t0.tv_nsec);
+  shard->cmd_stats.applied += count;
+  shard->cmd_stats.drains++;
+  shard->cmd_stats.last_drain_ns = ns;
+  shard->cmd_stats.total_drain_ns += ns;
+  if (ns > shard->cmd_stats.max_drain_ns)
+    shard->cmd_stats.max_drain_ns = ns;
+  if (count > shard->cmd_stats.max_depth)
+    shard->cmd_stats.max_depth = count;
+}
+
+/*
+  @ send_timer_cmd().
+  - Queue a command for the timer task of the timer's shard without touching
+  the timer store. handle is the one the caller resolved the timer from.
+  - If the queue is full the caller drains it under the shard mutex itself,
+  which keeps the commands of every thread in order.
+*/
+void send_timer_cmd(INT8U op, RTOS_TMR *timer, RTOS_TMR_HANDLE handle,
+                    INT32U match) {
+  TMR_SHARD *shard = timer_shard(timer);
+  TMR_CMD cmd = {timer, match, handle, op};
+
+  if (!push_timer_ring(&shard->cmd_ring, &cmd)) {
+    __atomic_add_fetch(&shard->cmd_stats.overflows, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&shard->mutex);
+    do {
+      drain_timer_cmds(shard);
+    } while (!push_timer_ring(&shard->cmd_ring, &cmd));
+    drain_timer_cmds(shard);
+#if RTOS_CFG_TMR_TICKLESS_EN
+    rearm_tick_timer(shard);
+#endif
+    pthread_mutex_unlock(&shard->mutex);
+    return;
+  }
+#if RTOS_CFG_TMR_TICKLESS_EN
+  // Wake the timer task if the OS timer is armed too late for this start.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (op == RTOS_TMR_CMD_START && shard->tick_timer_ready &&
+      (!shard->tick_timer_armed ||
+       (INT32)(match - shard->tick_timer_match) < 0)) {
+    wake_timer_task(shard);
+  }
+#endif
+}
+#endif
+
+/*
+  @ RTOSTmrQueueStatsGet().
+  Get the depth and drain time statistics of the command queues, summed over
+  the shards (maxima and the last drain are the largest of any shard), all zero
+  when RTOS_CFG_TMR_CMD_QUEUE_SIZE is 0.
+*/
+void RTOSTmrQueueStatsGet(RTOS_TMR_QUEUE_STATS *stats) {
+  memset(stats, 0, sizeof(*stats));
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    TMR_SHARD *shard = &TmrShard[i];
+    RTOS_TMR_QUEUE_STATS s;
+
+    pthread_mutex_lock(&shard->mutex);
+    s = shard->cmd_stats;
+    pthread_mutex_unlock(&shard->mutex);
+    stats->depth += timer_ring_depth(&shard->cmd_ring);
+    stats->applied += s.applied;
+    stats->drains += s.drains;
+    stats->overflows +=
+        __atomic_load_n(&shard->cmd_stats.overflows, __ATOMIC_RELAXED);
+    stats->total_drain_ns += s.total_drain_ns;
+    if (s.max_depth > stats->max_depth)
+      stats->max_depth = s.max_depth;
+    if (s.max_drain_ns > stats->max_drain_ns)
+      stats->max_drain_ns = s.max_drain_ns;
+    if (s.last_drain_ns > stats->last_drain_ns)
+      stats->last_drain_ns = s.last_drain_ns;
+  }
+#endif
+}
+
+/*
+  @ compare_due_timers().
+  qsort() order of the dispatch array: highest class first, earliest deadline
+  first within a class.
+*/
+static int compare_due_timers(const void *a, const void *b) {
+  const TMR_DUE *due_a = a;
+  const TMR_DUE *due_b = b;
+
+  if (due_a->prio != due_b->prio) {
+    return due_b->prio - due_a->prio;
+  }
+  INT32 diff = (INT32)(due_a->match - due_b->match);
+  return (diff > 0) - (diff < 0);
+}
+
+/*
+  @ order_due_timers().
+  Put the dispatch array in dispatch order. A counting sort by class, highest
+  first, keeps the order within a class, which the stores hand out by deadline
+  already: a class is only sorted by deadline if deferred or overdue timers
+  broke it. Caller holds the shard mutex.
+*/
+static void order_due_timers(TMR_SHARD *shard) {
+  INT32U start[RTOS_TMR_PRIO_CLASSES + 1] = {0};
+  TMR_DUE *due = shard->due;
+  TMR_DUE *sorted = shard->due_sort;
+
+  for (INT32U i = 0; i < shard->due_count; i++) {
+    start[RTOS_TMR_PRIO_CLASSES - due[i].prio]++;
+  }
+  for (INT32U p = 1; p <= RTOS_TMR_PRIO_CLASSES; p++) {
+    start[p] += start[p - 1];
+  }
+  for (INT32U i = 0; i < shard->due_count; i++) {
+    sorted[start[RTOS_TMR_PRIO_CLASSES - 1 - due[i].prio]++] = due[i];
+  }
+  shard->due = sorted;
+  shard->due_sort = due;
+  // start[p] is now the end of the class p places from the highest.
+  for (INT32U p = 0, first = 0; p < RTOS_TMR_PRIO_CLASSES;
+       first = start[p++]) {
+    for (INT32U i = first + 1; i < start[p]; i++) {
+      if (compare_due_timers(&sorted[i - 1], &sorted[i]) > 0) {
+        qsort(&sorted[first], start[p] - first, sizeof(TMR_DUE),
+              compare_due_timers);
+        break;
+      }
+    }
+  }
+}
+
+/*
+  @ collect_expired_timers().
+  - Claim the timers the store hands out as due (RUNNING to COMPLETED) and
+  append them to the dispatch array of the shard, behind the ones deferred by
+  earlier ticks, then order the array if they broke its order. Tombstones and
+  timers whose stop is still queued are dropped.
+  - Returns RTOS_FALSE if the array filled up and could not grow, the timers
+  left stay in the store for the next round. Caller holds the shard mutex.
+*/
+static INT8U collect_expired_timers(TMR_SHARD *shard, INT32U *expired) {
+  INT8U sorted = RTOS_TRUE;
+  INT8U done = RTOS_TRUE;
+  RTOS_TMR *timer;
+
+  while (1) {
+    if (shard->due_count == shard->due_cap) {
+      TMR_DUE *due = realloc(shard->due, 2 * shard->due_cap * sizeof(TMR_DUE));
+      if (due != NULL) {
+        shard->due = due;
+        due = realloc(shard->due_sort, 2 * shard->due_cap * sizeof(TMR_DUE));
+      }
+      if (due == NULL) {
+        done = RTOS_FALSE;
+        break;
+      }
+      shard->due_sort = due;
+      shard->due_cap *= 2;
+    }
+    if ((timer = shard->store->pop_expired(shard)) == NULL) {
+      break;
+    }
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+    shard->timer_count--;
+#endif
+    // Drop a timer whose stop is still queued, or a tombstone.
+    INT8U state = RTOS_TMR_STATE_RUNNING;
+    if (!__atomic_compare_exchange_n(&timer->RTOSTmrState, &state,
+                                     RTOS_TMR_STATE_COMPLETED, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+      // Cancelled before it came due, it counted as a tombstone.
+      if (state == RTOS_TMR_STATE_STOPPED) {
+        __atomic_sub_fetch(&shard->tombstones, 1, __ATOMIC_RELAXED);
+      }
+#endif
+      continue;
+    }
+#if RTOS_CFG_TMR_TRACE_EN
+    trace_timer_event(RTOS_TMR_TRACE_EXPIRE, timer, timer->RTOSTmrMatch);
+#endif
+    (*expired)++;
+    TMR_DUE *due = &shard->due[shard->due_count++];
+    due->timer = timer;
+    due->handle = timer->RTOSTmrHandle;
+    due->match = timer->RTOSTmrMatch;
+    due->prio = __atomic_load_n(&timer->RTOSTmrPrio, __ATOMIC_RELAXED);
+    if (shard->due_count > 1 && compare_due_timers(due - 1, due) > 0) {
+      sorted = RTOS_FALSE;
+    }
+  }
+  if (!sorted) {
+    order_due_timers(shard);
+  }
+  return done;
+}
+
+/*
+  @ dispatch_expired_timers().
+  - Go through the dispatch array of the shard in order: call the Callback
+  Function of each timer, then free a One Shot timer and re-insert a Periodic
+  one. A timer stopped, restarted or deleted since its expiry is skipped.
+  - The callback runs without the shard mutex held, so it may start or stop
+  timers itself.
+  - The callback of a timer set to RTOS_TMR_EXEC_POOL is handed to the
+  executor instead, a Periodic timer is re-inserted right away.
+  - With defer, once the callbacks ran for the tick budget, the entries left
+  below class RTOS_CFG_TMR_BUDGET_PRIO stay in the array for the next tick.
+  Caller holds the shard mutex.
+*/
+static void dispatch_expired_timers(TMR_SHARD *shard, INT32U tick,
+                                    INT8U defer) {
+  INT64U budget = defer ? __atomic_load_n(&tick_budget_ns, __ATOMIC_RELAXED)
+                        : 0;
+  INT64U budget_start = budget ? timer_clock_ns() : 0;
+  INT32U kept = 0;
+
+  for (INT32U i = 0; i < shard->due_count; i++) {
+    TMR_DUE due = shard->due[i];
+    RTOS_TMR *timer = due.timer;
+
+    if (budget != 0 && due.prio < RTOS_CFG_TMR_BUDGET_PRIO &&
+        (kept != 0 || timer_clock_ns() - budget_start >= budget)) {
+      // Budget spent, this and the rest of the low classes wait.
+      shard->due[kept++] = due;
+      continue;
+    }
+    if (__atomic_load_n(&timer->RTOSTmrHandle, __ATOMIC_ACQUIRE) !=
+            due.handle ||
+        __atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE) !=
+            RTOS_TMR_STATE_COMPLETED ||
+        timer->RTOSTmrMatch != due.match) {
+      continue;
+    }
+#if RTOS_CFG_TMR_STATS_EN
+    record_timer_lateness(shard, due.match, due.prio);
+#endif
+    INT8U state;
+#if RTOS_CFG_TMR_EXEC_THREADS
+    if (timer->RTOSTmrFlags & RTOS_TMR_FLAG_POOL) {
+      state = RTOS_TMR_STATE_COMPLETED;
+      if (timer->RTOSTmrOpt == RTOS_TMR_PERIODIC &&
+          __atomic_compare_exchange_n(&timer->RTOSTmrState, &state,
+                                      RTOS_TMR_STATE_RUNNING, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        timer->RTOSTmrMatch = next_timer_period(timer, due.match, tick);
+        apply_timer_slack(shard, timer);
+        store_link(shard, timer);
+      }
+      if (!submit_timer_exec(timer)) {
+        // Every executor ring is full, run it here.
+        pthread_mutex_unlock(&shard->mutex);
+        run_timer_exec(timer, shard - TmrShard);
+        pthread_mutex_lock(&shard->mutex);
+      }
+      continue;
+    }
+#endif
+    pthread_mutex_unlock(&shard->mutex);
+
+    run_timer_callback(timer, get_timer_cold(timer)->RTOSTmrCallbackArg,
+                       shard - TmrShard);
+
+    pthread_mutex_lock(&shard->mutex);
+    // Leave the timer alone if the callback (or another thread) stopped,
+    // restarted or deleted it meanwhile, it may even be reissued by now.
+    if (__atomic_load_n(&timer->RTOSTmrHandle, __ATOMIC_ACQUIRE) !=
+        due.handle) {
+      continue;
+    }
+    state = RTOS_TMR_STATE_COMPLETED;
+    if (timer->RTOSTmrOpt == RTOS_TMR_ONE_SHOT) {
+      // Freed under the mutex, see free_expired_timer().
+      if (__atomic_compare_exchange_n(&timer->RTOSTmrState, &state,
+                                      RTOS_TMR_STATE_UNUSED, 0,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free_timer_obj(timer);
+      }
+    } else if (__atomic_compare_exchange_n(&timer->RTOSTmrState, &state,
+                                           RTOS_TMR_STATE_RUNNING, 0,
+                                           __ATOMIC_ACQ_REL,
+                                           __ATOMIC_ACQUIRE)) {
+      timer->RTOSTmrMatch = next_timer_period(timer, due.match, tick);
+      apply_timer_slack(shard, timer);
+      store_link(shard, timer);
+    }
+  }
+  shard->due_count = kept;
+#if RTOS_CFG_TMR_STATS_EN
+  shard->budget_deferred += kept;
+#endif
+}
+
+/*
+  @ process_timer_tick().
+  - Process one tick of the timer store.
+  - The store prepares the tick (the wheel cascades its higher levels) and
+  hands out the timers due by it, which are dispatched highest priority class
+  first and earliest deadline first within a class, see
+  dispatch_expired_timers().
+  - Tombstones that come due are dropped, and the store is compacted when
+  they pile up.
+*/
+void process_timer_tick(TMR_SHARD *shard) {
+#if RTOS_CFG_TMR_STATS_EN
+  INT64U tick_start = timer_clock_ns();
+#endif
+  INT32U expired = 0;
+  INT8U done;
+
+  pthread_mutex_lock(&shard->mutex);
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  drain_timer_cmds(shard);
+#endif
+  INT32U tick = shard->tick;
+
+  store_dropped(shard, shard->store->begin_tick(shard));
+  do {
+    // A full dispatch array that cannot grow is emptied, deferring nothing,
+    // before the store hands out more.
+    done = collect_expired_timers(shard, &expired);
+    dispatch_expired_timers(shard, tick, done);
+  } while (!done);
+  shard->tick++;
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+  INT32 tombstones = __atomic_load_n(&shard->tombstones, __ATOMIC_RELAXED);
+  if (tombstones >= RTOS_CFG_TMR_COMPACT_MIN &&
+      (INT32U)tombstones * 2 > shard->timer_count &&
+      shard->tick - shard->compact_tick >= RTOS_TMR_WHEEL_L0_SIZE) {
+    // At most once per turn of wheel level 0, which drops the near tombstones
+    // by itself anyway.
+    store_dropped(shard, shard->store->compact(shard));
+    shard->compactions++;
+    shard->compact_tick = shard->tick;
+  }
+#endif
+#if RTOS_CFG_TMR_PERSIST_EN
+  persist_timer_clock(shard);
+#endif
+  pthread_mutex_unlock(&shard->mutex);
+#if RTOS_CFG_TMR_STATS_EN
+  record_timer_hist(&shard->tick_expired, expired);
+  record_timer_hist(&shard->tick_time, timer_clock_ns() - tick_start);
+#endif
+}
+
+/*
+  @ advance_timer_ticks().
+  - Process every tick up to and including last_tick in one pass.
+  - Ticks without an expiry or cascade are skipped by jumping the shard tick
+  straight to the next deadline, so catching up after a long sleep costs only
+  the ticks that have work.
+*/
+void advance_timer_ticks(TMR_SHARD *shard, INT32U last_tick) {
+  INT32U deadline;
+
+  pthread_mutex_lock(&shard->mutex);
+  while ((INT32)(last_tick - shard->tick) >= 0) {
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+    drain_timer_cmds(shard);
+#endif
+    if (!next_timer_deadline(shard, &deadline) ||
+        (INT32)(deadline - last_tick) > 0) {
+      shard->tick = last_tick + 1;
+      break;
+    }
+    shard->tick = deadline;
+    pthread_mutex_unlock(&shard->mutex);
+    process_timer_tick(shard);
+    pthread_mutex_lock(&shard->mutex);
+  }
+  pthread_mutex_unlock(&shard->mutex);
+}
+
+/*
+  @ advance_timer_shards().
+  Process the next step ticks (at most RTOS_TMR_ADVANCE_STEP) of all shards in
+  lockstep: every shard runs up to the earliest deadline of any shard before
+  the next one is looked for, so the callbacks of different shards run in
+  tick order.
+*/
+static void advance_timer_shards(INT32U step) {
+  INT32U last = TmrShard[0].tick + step - 1;
+  INT32U until;
+  INT32U deadline;
+
+  if (TmrShardCount == 1) {
+    advance_timer_ticks(&TmrShard[0], last);
+    return;
+  }
+  do {
+    until = last;
+    for (INT32U i = 0; i < TmrShardCount; i++) {
+      TMR_SHARD *shard = &TmrShard[i];
+      pthread_mutex_lock(&shard->mutex);
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+      drain_timer_cmds(shard);
+#endif
+      if (next_timer_deadline(shard, &deadline) &&
+          (INT32)(deadline - until) < 0) {
+        until = deadline;
+      }
+      pthread_mutex_unlock(&shard->mutex);
+    }
+    for (INT32U i = 0; i < TmrShardCount; i++) {
+      advance_timer_ticks(&TmrShard[i], until);
+    }
+  } while (until != last);
+}
+
+/*
+  @ RTOSTmrAdvance().
+  - Virtual time: run the next ticks timer ticks right away on the calling
+  thread, with the same expiry logic as the timer tasks. Ticks without work
+  are skipped, so simulated days take as long as their expiries.
+  - Only without OSTickInitialize(), which makes the ticks follow the clock.
+  Call it from one thread at a time, the callbacks may start and stop timers.
+*/
+INT8U RTOSTmrAdvance(INT64U ticks, INT8U *perr) {
+  if (tick_clock_ready) {
+    RTOS_TMR_ERR("\nOS tick is running, cannot advance the time\n");
+    *perr = RTOS_ERR_TMR_TICK_RUNNING;
+    return RTOS_FALSE;
+  }
+  while (ticks != 0) {
+    INT32U step =
+        ticks < RTOS_TMR_ADVANCE_STEP ? (INT32U)ticks : RTOS_TMR_ADVANCE_STEP;
+    advance_timer_shards(step);
+    ticks -= step;
+  }
+  *perr = RTOS_ERR_NONE;
+  return RTOS_TRUE;
+}
+
+#if RTOS_CFG_TMR_TICKLESS_EN
+/*
+  @ run_tickless_pass().
+  Catch up on all ticks of a shard that elapsed while sleeping, then re-arm
+  the OS timer for the next tick with work.
+*/
+static void run_tickless_pass(TMR_SHARD *shard) {
+  advance_timer_ticks(shard, elapsed_ticks());
+  pthread_mutex_lock(&shard->mutex);
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  drain_timer_cmds(shard);
+#endif
+  rearm_tick_timer(shard);
+  pthread_mutex_unlock(&shard->mutex);
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+  // A start queued after the drain may need an earlier wakeup.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (timer_ring_depth(&shard->cmd_ring) != 0) {
+    wake_timer_task(shard);
+  }
+#endif
+}
+#endif
+
+/*
+  @ RTOSTmrTask().
+  - Timer task to manage the running timers.
+  - Wait for the tick signal and process the expired timers of that tick in
+  the timer store, see process_timer_tick().
+  - In tickless mode the signal comes from the one shot OS timer, and all
+  ticks elapsed since the last wakeup are processed at once.
+  - Every shard runs its own timer task, temp is the shard.
+*/
+void *RTOSTmrTask(void *temp) {
+  TMR_SHARD *shard = temp;
+
+  while (1) {
+    // Wait for signal from RTOSTmrSignal(), Once get the signal, process the
+    // tick and increment the timer tick counter.
+    sem_wait(&shard->task_sem);
+#if RTOS_CFG_TMR_TICKLESS_EN
+    run_tickless_pass(shard);
+#else
+    process_timer_tick(shard);
+#endif
+  }
+  return temp;
+}
+
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+/*
+  @ read_event_fd().
+  Read and so clear the counter of a non-blocking timerfd or eventfd, 0 if it
+  was not readable.
+*/
+static INT64U read_event_fd(INT32 fd) {
+  INT64U count = 0;
+
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+    return 0;
+  }
+  return count;
+}
+
+/*
+  @ init_timer_event_fds().
+  Create the epoll fd of RTOSTmrFdGet() with the wakeup eventfd in it.
+*/
+static INT8U init_timer_event_fds(void) {
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  tmr_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  tmr_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (tmr_epoll_fd < 0 || tmr_wake_fd < 0 ||
+      epoll_ctl(tmr_epoll_fd, EPOLL_CTL_ADD, tmr_wake_fd, &event) < 0) {
+    return RTOS_ERR_TMR_EVENT_FD;
+  }
+  return RTOS_SUCCESS;
+}
+#endif
+
+/*
+  @ RTOSTmrFdGet().
+  - Event loop mode: the fd the application polls for readability (epoll,
+  select or poll) to know when to call RTOSTmrProcess().
+  - -1 before OSTickInitialize() and in the other modes.
+*/
+INT32 RTOSTmrFdGet(void) {
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  return tmr_epoll_fd;
+#else
+  return -1;
+#endif
+}
+
+/*
+  @ RTOSTmrProcess().
+  - Event loop mode: do the work of the timer tasks on the calling thread.
+  Processes every tick of every shard that came due since the last call and
+  re-arms the timerfds, the callbacks run right here.
+  - Call it when the fd of RTOSTmrFdGet() is readable (calling it at other
+  times is harmless), from one thread at a time.
+  - Does nothing in the other modes, where the timer tasks do the work.
+*/
+void RTOSTmrProcess(void) {
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  read_event_fd(tmr_wake_fd);
+#if RTOS_CFG_TMR_TICKLESS_EN
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    TMR_SHARD *shard = &TmrShard[i];
+    if (shard->tick_timer_ready) {
+      read_event_fd(shard->tick_timer_id);
+      run_tickless_pass(shard);
+    }
+  }
+#else
+  // One tick per expiry of the periodic timerfd, as RTOSTmrSignal() does.
+  INT64U ticks = tmr_tick_fd < 0 ? 0 : read_event_fd(tmr_tick_fd);
+  for (INT64U n = 0; n < ticks; n++) {
+    for (INT32U i = 0; i < TmrShardCount; i++) {
+      process_timer_tick(&TmrShard[i]);
+    }
+  }
+#endif
+#endif
+}
+
+/*
+  @ init_timer_shards().
+  - Create shard_count shards, 0 for one per online CPU, each with an empty
+  timer store of the given kind (RTOS_TMR_STORE_*), its mutex, semaphore and
+  command queue.
+  - With RTOS_CFG_TMR_SHARD_PIN_EN shard n gets CPU n modulo the online CPUs.
+*/
+INT8U init_timer_shards(INT32U shard_count, INT8U store) {
+  INT32 cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  const TMR_STORE_OPS *ops;
+
+  switch (store) {
+  case RTOS_TMR_STORE_WHEEL:
+    ops = &timer_wheel_store;
+    break;
+  case RTOS_TMR_STORE_HEAP:
+    ops = &timer_heap_store;
+    break;
+  default:
+    return RTOS_ERR_TMR_INVALID_STORE;
+  }
+  if (cpus < 1) {
+    cpus = 1;
+  }
+  if (shard_count == 0) {
+    shard_count = cpus;
+  }
+  if (shard_count > RTOS_CFG_TMR_MAX_SHARDS) {
+    return RTOS_ERR_TMR_INVALID_SHARD;
+  }
+  TMR_SHARD *shards =
+      aligned_alloc(RTOS_CACHE_LINE_SIZE, shard_count * sizeof(TMR_SHARD));
+  if (shards == NULL) {
+    return RTOS_MALLOC_ERR;
+  }
+  memset(shards, 0, shard_count * sizeof(TMR_SHARD));
+  for (INT32U i = 0; i < shard_count; i++) {
+    TMR_SHARD *shard = &shards[i];
+    pthread_mutex_init(&shard->mutex, NULL);
+    sem_init(&shard->task_sem, 0, 0);
+    shard->cpu = RTOS_CFG_TMR_SHARD_PIN_EN ? (INT32)(i % cpus) : -1;
+    shard->store = ops;
+    if (ops->init(shard) != RTOS_SUCCESS) {
+      return RTOS_MALLOC_ERR;
+    }
+    shard->due = malloc(RTOS_TMR_DUE_INIT_SIZE * sizeof(TMR_DUE));
+    shard->due_sort = malloc(RTOS_TMR_DUE_INIT_SIZE * sizeof(TMR_DUE));
+    if (shard->due == NULL || shard->due_sort == NULL) {
+      return RTOS_MALLOC_ERR;
+    }
+    shard->due_cap = RTOS_TMR_DUE_INIT_SIZE;
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+    if (init_timer_ring(&shard->cmd_ring, RTOS_CFG_TMR_CMD_QUEUE_SIZE) !=
+        RTOS_SUCCESS) {
+      return RTOS_MALLOC_ERR;
+    }
+#endif
+  }
+  TmrShard = shards;
+  TmrShardCount = shard_count;
+#if RTOS_CFG_TMR_TICKLESS_EN
+  // OSTickInitialize() ran first, give the new shards their OS timer.
+  if (tick_clock_ready) {
+    for (INT32U i = 0; i < shard_count; i++) {
+      create_tick_timer(&TmrShard[i]);
+    }
+  }
+#endif
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ free_timer_shards().
+  Free the shards made by init_timer_shards(), so they can be made again with
+  another timer store. Only while no timer task runs and no timer is linked.
+*/
+void free_timer_shards(void) {
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    TMR_SHARD *shard = &TmrShard[i];
+#if RTOS_CFG_TMR_TICKLESS_EN
+    if (shard->tick_timer_ready) {
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+      close(shard->tick_timer_id);
+#else
+      timer_delete(shard->tick_timer_id);
+#endif
+    }
+#endif
+#if RTOS_CFG_TMR_CMD_QUEUE_SIZE
+    free(shard->cmd_ring.cell);
+#endif
+    shard->store->destroy(shard);
+    free(shard->due);
+    free(shard->due_sort);
+    sem_destroy(&shard->task_sem);
+    pthread_mutex_destroy(&shard->mutex);
+  }
+  free(TmrShard);
+  TmrShard = NULL;
+  TmrShardCount = 0;
+}
+
+/*
+  @ RTOSTmrInit().
+  - Initialize the all timer attributes.
+  - Create shard_count shards (0 for one per online CPU), each with its own
+  timer task, see init_timer_shards().
+  - store picks the structure the shards keep their running timers in:
+  RTOS_TMR_STORE_WHEEL for many short, often cancelled timers,
+  RTOS_TMR_STORE_HEAP for fewer, longer ones.
+*/
+void RTOSTmrInit(INT32U shard_count, INT8U store) {
+  INT8U retVal;
+  INT32U timer_count = 0;
+  pthread_attr_t attr;
+
+  fprintf(
+      stdout,
+      "\n\nPlease Enter the number of Timers required in the Pool for the OS ");
+  scanf("%d", &timer_count);
+
+  // Create timer pool.
+  retVal = Create_Timer_Pool(timer_count);
+
+  // Check the return value.
+  if (retVal != RTOS_SUCCESS) {
+    RTOS_TMR_ERR("\nTimer Creation failed Error = %d\n", retVal);
+    return;
+  }
+  RTOS_TMR_POOL_INFO pool_info;
+  RTOSTmrPoolInfoGet(&pool_info);
+  RTOS_TMR_INFO("\nTimer Pool: %u timers in %u chunks, %u bytes per timer\n",
+                pool_info.pool_size, pool_info.chunk_count,
+                pool_info.bytes_per_timer);
+  // Initialize the shards with their timer store and command queue.
+  retVal = init_timer_shards(shard_count, store);
+  if (retVal != RTOS_SUCCESS) {
+    RTOS_TMR_ERR("\nShard Creation failed Error = %d\n", retVal);
+    return;
+  }
+  RTOS_TMR_INFO("\n\nTimer Store (%s) Initialized Successfully (%u shards)\n",
+                TmrShard[0].store->name, TmrShardCount);
+
+#if RTOS_CFG_TMR_PERSIST_EN
+  // Relink the timers of the pool file, see RTOSTmrPersistOpen().
+  restore_timer_pool();
+  RTOS_TMR_PERSIST_INFO persist_info;
+  RTOSTmrPersistInfoGet(&persist_info);
+  if (persist_info.file_bytes != 0) {
+    RTOS_TMR_INFO("\nTimer Pool File: %u timers restored, %u overdue, "
+                  "%u dropped\n",
+                  persist_info.restored, persist_info.overdue,
+                  persist_info.dropped);
+  }
+#endif
+
+  // Initialize Mutex if any
+  pthread_mutex_init(&timer_pool_mutex, NULL);
+
+#if RTOS_CFG_TMR_EXEC_THREADS
+  // Create the callback executor threads.
+  retVal = init_timer_exec();
+  if (retVal != RTOS_SUCCESS) {
+    RTOS_TMR_ERR("\nExecutor Creation failed Error = %d\n", retVal);
+    return;
+  }
+#endif
+
+  // Create the watchdog of the timer callbacks.
+  retVal = init_timer_watchdog();
+  if (retVal != RTOS_SUCCESS) {
+    RTOS_TMR_ERR("\nWatchdog Creation failed Error = %d\n", retVal);
+    return;
+  }
+
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  // No timer tasks, the application calls RTOSTmrProcess() from its loop.
+  (void)attr;
+#else
+  // Create the timer task of every shard, pinned to the CPU of the shard.
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    TMR_SHARD *shard = &TmrShard[i];
+    pthread_attr_init(&attr);
+    if (shard->cpu >= 0) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(shard->cpu, &cpu_set);
+      pthread_attr_setaffinity_np(&attr, sizeof(cpu_set), &cpu_set);
+    }
+    pthread_create(&shard->thread, &attr, RTOSTmrTask, shard);
+    pthread_attr_destroy(&attr);
+  }
+#endif
+  RTOS_TMR_INFO("\nRTOS Initialization Done...\n");
+}
+
+/*
+  @ note_pool_low_water().
+  Track the fewest free timers left in the pool. Caller holds
+  timer_pool_mutex.
+*/
+static inline void note_pool_low_water(void) {
+#if RTOS_CFG_TMR_STATS_EN
+  if (FreeTmrCount < FreeTmrLowWater) {
+    FreeTmrLowWater = FreeTmrCount;
+  }
+#endif
+}
+
+/*
+  @ get_pool_low_water().
+  Fewest free timers left in the pool since the last reset.
+*/
+INT32U get_pool_low_water(void) {
+  pthread_mutex_lock(&timer_pool_mutex);
+  INT32U low_water =
+      FreeTmrLowWater < FreeTmrCount ? FreeTmrLowWater : FreeTmrCount;
+  pthread_mutex_unlock(&timer_pool_mutex);
+  return low_water;
+}
+
+/*
+  @ reset_pool_low_water().
+  Restart the low-water mark from the current free count.
+*/
+void reset_pool_low_water(void) {
+  pthread_mutex_lock(&timer_pool_mutex);
+  FreeTmrLowWater = FreeTmrCount;
+  pthread_mutex_unlock(&timer_pool_mutex);
+}
+
+/*
+  @ clear_timer_obj().
+  Reset the fields of a timer that goes back to the pool and move it to its
+  next generation, which voids every handle made so far. The cold fields are
+  left to the next fill_timer_obj(), no handle reaches them meanwhile.
+*/
+static void clear_timer_obj(RTOS_TMR *ptmr) {
+  RTOS_TMR_HANDLE handle = ptmr->RTOSTmrHandle + RTOS_TMR_HANDLE_GEN_ONE;
+
+  if (handle < RTOS_TMR_HANDLE_GEN_ONE) {
+    // Generation 0 is skipped, see RTOS_TMR_NO_HANDLE.
+    handle += RTOS_TMR_HANDLE_GEN_ONE;
+  }
+  __atomic_store_n(&ptmr->RTOSTmrHandle, handle, __ATOMIC_RELEASE);
+  ptmr->RTOSTmrPrev = RTOS_TMR_NO_ID;
+  ptmr->RTOSTmrNext = RTOS_TMR_NO_ID;
+  ptmr->RTOSTmrMatch = 0;
+  ptmr->RTOSTmrDelay = 0;
+  ptmr->RTOSTmrPeriod = 0;
+  ptmr->RTOSTmrOpt = 0;
+  ptmr->RTOSTmrFlags = 0;
+  ptmr->RTOSTmrSlack = 0;
+  ptmr->RTOSTmrPrio = RTOS_TMR_PRIO_NORMAL;
+  ptmr->RTOSTmrSlot = RTOS_TMR_WHEEL_NO_SLOT;
+  // Change the state.
+  ptmr->RTOSTmrState = RTOS_TMR_STATE_UNUSED;
+}
+
+#if RTOS_CFG_TMR_CACHE_SIZE
+/*
+  @ tmr_cache_exit().
+  Thread exit: give the ids left in the thread cache back to the pool.
+*/
+static void tmr_cache_exit(void *arg) {
+  TMR_CACHE *cache = arg;
+  flush_timer_cache(cache, cache->count);
+}
+
+static void tmr_cache_key_create(void) {
+  pthread_key_create(&tmr_cache_key, tmr_cache_exit);
+}
+
+/*
+  @ tmr_cache_register().
+  First use of the thread cache: make sure it is flushed at thread exit.
+*/
+static void tmr_cache_register(TMR_CACHE *cache) {
+  pthread_once(&tmr_cache_once, tmr_cache_key_create);
+  pthread_setspecific(tmr_cache_key, cache);
+  cache->registered = RTOS_TRUE;
+}
+
+/*
+  @ refill_timer_cache().
+  Move half a cache of free ids from the pool into the thread cache under a
+  single timer_pool_mutex acquisition, growing the pool if needed.
+*/
+void refill_timer_cache(TMR_CACHE *cache) {
+  if (!cache->registered) {
+    tmr_cache_register(cache);
+  }
+  pthread_mutex_lock(&timer_pool_mutex);
+  if (FreeTmrCount == 0) {
+    grow_timer_pool();
+  }
+  while (FreeTmrCount != 0 && cache->count < RTOS_CFG_TMR_CACHE_SIZE / 2) {
+    cache->id[cache->count++] = FreeTmrStack[--FreeTmrCount];
+  }
+  note_pool_low_water();
+  pthread_mutex_unlock(&timer_pool_mutex);
+}
+
+/*
+  @ flush_timer_cache().
+  Move the top count ids of the thread cache back to the pool under a single
+  timer_pool_mutex acquisition.
+*/
+void flush_timer_cache(TMR_CACHE *cache, INT32U count) {
+  pthread_mutex_lock(&timer_pool_mutex);
+  while (count-- != 0) {
+    FreeTmrStack[FreeTmrCount++] = cache->id[--cache->count];
+  }
+  pthread_mutex_unlock(&timer_pool_mutex);
+}
+#endif
+
+/*
+  @ alloc_timer_obj().
+  - Allocate a timer object from free timer pool, growing the pool by a chunk
+  when no timer is free. Pops an id off the free stack, O(1).
+  - With RTOS_CFG_TMR_CACHE_SIZE the id comes from the thread cache, the pool
+  (and timer_pool_mutex) is only touched to refill it in batches.
 */
 RTOS_TMR *alloc_timer_obj(void) {
-  printf("nadaf alloc_timer_obj start");
+#if RTOS_CFG_TMR_CACHE_SIZE
+  if (tmr_cache.count == 0) {
+    refill_timer_cache(&tmr_cache);
+    if (tmr_cache.count == 0) {
+      return NULL;
+    }
+  }
+  return get_timer_obj(tmr_cache.id[--tmr_cache.count]);
+#else
+  RTOS_TMR_DEBUG("alloc_timer_obj start");
   RTOS_TMR *tempTmr = NULL;
   // Lock resources.
   pthread_mutex_lock(&timer_pool_mutex);
   // Check for availability of timers.
+  RTOS_TMR_DEBUG("alloc_timer_obj FreeTmrCount = %d\n", FreeTmrCount);
+  if (FreeTmrCount == 0) {
+    grow_timer_pool();
+  }
   // Assign the timer object.
-  printf("nadaf alloc_timer_obj FreeTmrCount = %d\n", FreeTmrCount);
   if (FreeTmrCount != 0) {
-    printf("nadaf FreeTmrListPtr = %p\n", FreeTmrListPtr);
-    tempTmr = FreeTmrListPtr;
-    printf("nadaf FreeTmrListPtr->RTOSTmrNext = %p\n",
-           FreeTmrListPtr->RTOSTmrNext);
-    FreeTmrListPtr = FreeTmrListPtr->RTOSTmrNext;
-    tempTmr->RTOSTmrNext = NULL;
-    if (FreeTmrCount != 1)
-      FreeTmrListPtr->RTOSTmrPrev = NULL;
-    FreeTmrCount--;
+    tempTmr = get_timer_obj(FreeTmrStack[--FreeTmrCount]);
+    note_pool_low_water();
+    RTOS_TMR_DEBUG("alloc_timer_obj id = %d\n",
+                   RTOS_TMR_HANDLE_ID(tempTmr->RTOSTmrHandle));
   }
   // Unlock resources.
   pthread_mutex_unlock(&timer_pool_mutex);
-  printf("nadaf alloc_timer_obj end");
+  RTOS_TMR_DEBUG("alloc_timer_obj end");
   return tempTmr;
+#endif
 }
 
 /*
   @ free_timer_obj().
-  Free the allocated timer object and put it back into free pool.
+  - Free the allocated timer object and push its id back on the free stack.
+  - With RTOS_CFG_TMR_CACHE_SIZE the id goes to the thread cache, which is
+  flushed half to the pool when it is full.
 */
 void free_timer_obj(RTOS_TMR *ptmr) {
-  printf("nadaf free_timer_obj start ptmr = %p\n", ptmr);
-  printf("nadaf free_timer_obj FreeTmrCount = %d\n", FreeTmrCount);
+#if RTOS_CFG_TMR_CACHE_SIZE
+  clear_timer_obj(ptmr);
+  // Return the timer to the thread cache.
+  if (!tmr_cache.registered) {
+    tmr_cache_register(&tmr_cache);
+  }
+  if (tmr_cache.count == RTOS_CFG_TMR_CACHE_SIZE) {
+    flush_timer_cache(&tmr_cache, RTOS_CFG_TMR_CACHE_SIZE / 2);
+  }
+  tmr_cache.id[tmr_cache.count++] = RTOS_TMR_HANDLE_ID(ptmr->RTOSTmrHandle);
+#else
+  RTOS_TMR_DEBUG("free_timer_obj start ptmr = %p\n", ptmr);
+  RTOS_TMR_DEBUG("free_timer_obj FreeTmrCount = %d\n", FreeTmrCount);
   // Lock resources.
   pthread_mutex_lock(&timer_pool_mutex);
-  // Clear timer fields.
-  ptmr->RTOSTmrCallback = NULL;
-  ptmr->RTOSTmrCallbackArg = NULL;
-  ptmr->RTOSTmrPrev = NULL;
-  ptmr->RTOSTmrMatch = 0;
-  ptmr->RTOSTmrDelay = 0;
-  ptmr->RTOSTmrPeriod = 0;
-  ptmr->RTOSTmrName = NULL;
-  ptmr->RTOSTmrOpt = 0;
-  ptmr->RTOSTmrNext = FreeTmrListPtr;
-  // Change the state.
-  ptmr->RTOSTmrState = RTOS_TMR_STATE_UNUSED;
+  clear_timer_obj(ptmr);
   // Return the timer to free timer pool.
-  FreeTmrListPtr = ptmr;
-  FreeTmrCount++;
+  FreeTmrStack[FreeTmrCount++] = RTOS_TMR_HANDLE_ID(ptmr->RTOSTmrHandle);
   // Unlock resources.
   pthread_mutex_unlock(&timer_pool_mutex);
-  printf("nadaf free_timer_obj end\n");
+  RTOS_TMR_DEBUG("free_timer_obj end\n");
+#endif
+}
+
+/*
+  @ alloc_timer_batch().
+  Allocate up to count timer objects, the thread cache first and the rest
+  under a single timer_pool_mutex acquisition. Returns the number allocated.
+*/
+INT32U alloc_timer_batch(RTOS_TMR **timers, INT32U count) {
+  INT32U n = 0;
+
+#if RTOS_CFG_TMR_CACHE_SIZE
+  while (n < count && tmr_cache.count != 0) {
+    timers[n++] = get_timer_obj(tmr_cache.id[--tmr_cache.count]);
+  }
+#endif
+  if (n == count) {
+    return n;
+  }
+  pthread_mutex_lock(&timer_pool_mutex);
+  while (n < count) {
+    if (FreeTmrCount == 0 && grow_timer_pool() != RTOS_SUCCESS) {
+      break;
+    }
+    timers[n++] = get_timer_obj(FreeTmrStack[--FreeTmrCount]);
+  }
+  note_pool_low_water();
+  pthread_mutex_unlock(&timer_pool_mutex);
+  return n;
+}
+
+/*
+  @ free_timer_batch().
+  Free count timer objects, into the thread cache while it has room and the
+  rest under a single timer_pool_mutex acquisition.
+*/
+void free_timer_batch(RTOS_TMR **timers, INT32U count) {
+  INT32U n = 0;
+
+  for (INT32U i = 0; i < count; i++) {
+    clear_timer_obj(timers[i]);
+  }
+#if RTOS_CFG_TMR_CACHE_SIZE
+  if (count != 0 && !tmr_cache.registered) {
+    tmr_cache_register(&tmr_cache);
+  }
+  while (n < count && tmr_cache.count < RTOS_CFG_TMR_CACHE_SIZE) {
+    tmr_cache.id[tmr_cache.count++] =
+        RTOS_TMR_HANDLE_ID(timers[n++]->RTOSTmrHandle);
+  }
+#endif
+  if (n == count) {
+    return;
+  }
+  pthread_mutex_lock(&timer_pool_mutex);
+  while (n < count) {
+    FreeTmrStack[FreeTmrCount++] =
+        RTOS_TMR_HANDLE_ID(timers[n++]->RTOSTmrHandle);
+  }
+  pthread_mutex_unlock(&timer_pool_mutex);
+}
+
+/*
+  @ defer_timer_free().
+  RTOS_TRUE if the callback of a deleted timer is queued or running on the
+  executor, which then frees the timer when the callback returns.
+*/
+INT8U defer_timer_free(RTOS_TMR *ptmr) {
+#if RTOS_CFG_TMR_EXEC_THREADS
+  if (__atomic_fetch_or(&ptmr->RTOSTmrFlags, RTOS_TMR_FLAG_FREE,
+                        __ATOMIC_ACQ_REL) &
+      RTOS_TMR_FLAG_BUSY) {
+    return RTOS_TRUE;
+  }
+#else
+  (void)ptmr;
+#endif
+  return RTOS_FALSE;
+}
+
+/*
+  @ release_timer_obj().
+  Free a deleted timer, unless the executor frees it, see defer_timer_free().
+*/
+void release_timer_obj(RTOS_TMR *ptmr) {
+  if (!defer_timer_free(ptmr)) {
+    free_timer_obj(ptmr);
+  }
+}
+
+/*
+  @ free_expired_timer().
+  Free a timer after its callback on the executor, under the shard mutex: its
+  handle goes stale while neither RTOSTmrCancel() nor claim_timer_delete() can
+  be between checking the handle and claiming the timer.
+*/
+void free_expired_timer(RTOS_TMR *ptmr) {
+  TMR_SHARD *shard = timer_shard(ptmr);
+
+  pthread_mutex_lock(&shard->mutex);
+  free_timer_obj(ptmr);
+  pthread_mutex_unlock(&shard->mutex);
 }
 
 /*
@@ -567,9 +2944,56 @@ void free_timer_obj(RTOS_TMR *ptmr) {
   interval specified in a call to the alarm or alarmd function expires.
   - The CLOCK_REALTIME clock measures the amount of time that has elapsed since
     00:00:00 January 1, 1970 Greenwich Mean Time (GMT).
+  - In tickless mode every shard gets a CLOCK_MONOTONIC timer that is created
+  but not armed, tick 0 is now and the timer is armed one shot for each next
+  deadline of the shard.
+  - In event loop mode no signal is used: the OS timers are timerfds in the
+  epoll set of RTOSTmrFdGet(), see RTOSTmrProcess().
 */
 void OSTickInitialize(void) {
-  printf("nadaf OSTickInitialize start\n");
+  RTOS_TMR_DEBUG("OSTickInitialize start\n");
+#if RTOS_CFG_TMR_EVENT_LOOP_EN
+  if (init_timer_event_fds() != RTOS_SUCCESS) {
+    RTOS_TMR_ERR("\nEvent fd creation failed\n");
+    return;
+  }
+#endif
+#if RTOS_CFG_TMR_TICKLESS_EN
+#if !RTOS_CFG_TMR_EVENT_LOOP_EN
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = tick_timer_signal;
+  action.sa_flags = SA_SIGINFO;
+  sigaction(SIGALRM, &action, NULL);
+#endif
+
+  // Tick 0 is now. Create the timer object of every shard, started by the
+  // first running timer; shards created later get theirs in
+  // init_timer_shards().
+  clock_gettime(CLOCK_MONOTONIC, &tick_epoch);
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    create_tick_timer(&TmrShard[i]);
+  }
+  tick_clock_ready = RTOS_TRUE;
+#elif RTOS_CFG_TMR_EVENT_LOOP_EN
+  struct itimerspec time_value = {{0, RTOS_CFG_TMR_TASK_RATE}, {1, 0}};
+  struct epoll_event event;
+
+  // The same periodic tick from a timerfd, polled with the wakeup eventfd.
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  tmr_tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (tmr_tick_fd < 0 ||
+      epoll_ctl(tmr_epoll_fd, EPOLL_CTL_ADD, tmr_tick_fd, &event) < 0) {
+    RTOS_TMR_ERR("\nTick timerfd creation failed\n");
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &tick_epoch);
+  tick_epoch.tv_sec += time_value.it_value.tv_sec;
+  tick_clock_ready = RTOS_TRUE;
+  timerfd_settime(tmr_tick_fd, 0, &time_value, NULL);
+#else
   timer_t timer_id;
   struct itimerspec time_value;
 
@@ -582,10 +3006,16 @@ void OSTickInitialize(void) {
 
   signal(SIGALRM, &RTOSTmrSignal);
 
+  // Tick 0 is the first expiry, 1 second from now.
+  clock_gettime(CLOCK_MONOTONIC, &tick_epoch);
+  tick_epoch.tv_sec += time_value.it_value.tv_sec;
+  tick_clock_ready = RTOS_TRUE;
+
   // Create the timer object.
   timer_create(CLOCK_REALTIME, NULL, &timer_id);
 
   // Start timer.
   timer_settime(timer_id, 0, &time_value, NULL);
-  printf("nadaf OSTickInitialize end\n");
+#endif
+  RTOS_TMR_DEBUG("OSTickInitialize end\n");
 }
@@ -0,0 +1,173 @@
+// Header Files
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdint.h>
+
+#if RTOS_CFG_TMR_EXEC_THREADS
+/*****************************************************
+ * Callback Executor
+ *****************************************************
+ * The timer task hands expired RTOS_TMR_EXEC_POOL timers round robin to the
+ * job rings of the worker threads and posts exec_sem once per job. A woken
+ * worker takes the job from its own ring or steals it from another one.
+ * RTOS_TMR_FLAG_BUSY keeps a timer on at most one worker at a time.
+ */
+
+// Job ring and thread of every worker.
+TMR_RING exec_ring[RTOS_CFG_TMR_EXEC_THREADS];
+pthread_t exec_thread[RTOS_CFG_TMR_EXEC_THREADS];
+
+// Counts the queued jobs.
+sem_t exec_sem;
+
+// Ring the next job goes to, shared by the timer tasks of all shards.
+INT32U exec_next = 0;
+
+/*
+  @ init_timer_exec().
+  Create the job rings and the worker threads.
+*/
+INT8U init_timer_exec(void) {
+  sem_init(&exec_sem, 0, 0);
+  for (INT32U i = 0; i < RTOS_CFG_TMR_EXEC_THREADS; i++) {
+    if (init_timer_ring(&exec_ring[i], RTOS_CFG_TMR_EXEC_QUEUE_SIZE) !=
+        RTOS_SUCCESS) {
+      return RTOS_MALLOC_ERR;
+    }
+  }
+  for (INT32U i = 0; i < RTOS_CFG_TMR_EXEC_THREADS; i++) {
+    pthread_create(&exec_thread[i], NULL, RTOSTmrExecTask,
+                   (void *)(uintptr_t)i);
+  }
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ submit_timer_exec().
+  - Queue the callback of an expired timer on the executor.
+  - A timer whose callback is still busy is not queued again, it is marked to
+  run once more when the running callback returns, so a Periodic timer never
+  runs concurrently with itself.
+  - Returns RTOS_FALSE if every ring is full, the caller then runs the job
+  itself with run_timer_exec().
+*/
+INT8U submit_timer_exec(RTOS_TMR *timer) {
+  INT8U flags = __atomic_load_n(&timer->RTOSTmrFlags, __ATOMIC_RELAXED);
+  INT8U busy;
+
+  do {
+    busy = flags & RTOS_TMR_FLAG_BUSY;
+  } while (!__atomic_compare_exchange_n(
+      &timer->RTOSTmrFlags, &flags,
+      flags | (busy ? RTOS_TMR_FLAG_AGAIN : RTOS_TMR_FLAG_BUSY), 0,
+      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+  if (busy) {
+    return RTOS_TRUE;
+  }
+
+  TMR_CMD cmd = {timer, 0, timer->RTOSTmrHandle, RTOS_TMR_CMD_EXEC};
+  for (INT32U i = 0; i < RTOS_CFG_TMR_EXEC_THREADS; i++) {
+    INT32U index = __atomic_fetch_add(&exec_next, 1, __ATOMIC_RELAXED) %
+                   RTOS_CFG_TMR_EXEC_THREADS;
+    if (push_timer_ring(&exec_ring[index], &cmd)) {
+      sem_post(&exec_sem);
+      return RTOS_TRUE;
+    }
+  }
+  return RTOS_FALSE;
+}
+
+/*
+  @ run_timer_exec().
+  - Run the callback of a timer submitted to the executor, again as long as
+  it expired meanwhile and is still running. runner is the executor worker, or
+  the timer task when the rings are full.
+  - Then free a completed One Shot timer, or a timer deleted while busy.
+*/
+void run_timer_exec(RTOS_TMR *timer, INT32U runner) {
+  RTOS_TMR_COLD *cold = get_timer_cold(timer);
+  INT8U flags, state, autofree = RTOS_FALSE;
+
+  while (1) {
+    run_timer_callback(timer, cold->RTOSTmrCallbackArg, runner);
+
+    flags = __atomic_load_n(&timer->RTOSTmrFlags, __ATOMIC_ACQUIRE);
+    if (!(flags & RTOS_TMR_FLAG_AGAIN)) {
+      break;
+    }
+    __atomic_and_fetch(&timer->RTOSTmrFlags, ~RTOS_TMR_FLAG_AGAIN,
+                       __ATOMIC_ACQ_REL);
+    if (__atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE) !=
+        RTOS_TMR_STATE_RUNNING) {
+      break;
+    }
+  }
+
+  // Claim a completed One Shot timer before the timer leaves BUSY. A delete
+  // claims it only from COMPLETED, so one of the two frees it.
+  state = RTOS_TMR_STATE_COMPLETED;
+  if (timer->RTOSTmrOpt == RTOS_TMR_ONE_SHOT &&
+      __atomic_compare_exchange_n(&timer->RTOSTmrState, &state,
+                                  RTOS_TMR_STATE_UNUSED, 0, __ATOMIC_ACQ_REL,
+                                  __ATOMIC_ACQUIRE)) {
+    autofree = RTOS_TRUE;
+  }
+  do {
+    if (flags & RTOS_TMR_FLAG_AGAIN) {
+      // Expired again after the last check, run it once more.
+      __atomic_and_fetch(&timer->RTOSTmrFlags, ~RTOS_TMR_FLAG_AGAIN,
+                         __ATOMIC_ACQ_REL);
+      if (!autofree && __atomic_load_n(&timer->RTOSTmrState,
+                                       __ATOMIC_ACQUIRE) ==
+                           RTOS_TMR_STATE_RUNNING) {
+        run_timer_callback(timer, cold->RTOSTmrCallbackArg, runner);
+      }
+      flags = __atomic_load_n(&timer->RTOSTmrFlags, __ATOMIC_ACQUIRE);
+    }
+  } while (!__atomic_compare_exchange_n(
+      &timer->RTOSTmrFlags, &flags,
+      flags & ~(RTOS_TMR_FLAG_BUSY | RTOS_TMR_FLAG_AGAIN), 0,
+      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  if (autofree) {
+    free_expired_timer(timer);
+  } else if (flags & RTOS_TMR_FLAG_FREE) {
+    // Deleted while busy, the delete left the free to us.
+    free_expired_timer(timer);
+  }
+}
+
+/*
+  @ RTOSTmrExecTask().
+  - Worker thread of the callback executor: wait for a job, take it from the
+  own ring first, otherwise steal it from the ring of another worker.
+  - One pass over the rings can miss the job while other workers take and
+  submit jobs around it, the worker then hands the post back and waits again.
+*/
+void *RTOSTmrExecTask(void *temp) {
+  INT32U self = (INT32U)(uintptr_t)temp;
+  TMR_CMD cmd;
+  INT32U i;
+
+  while (1) {
+    sem_wait(&exec_sem);
+    for (i = 0; i < RTOS_CFG_TMR_EXEC_THREADS; i++) {
+      if (pop_timer_ring(&exec_ring[(self + i) % RTOS_CFG_TMR_EXEC_THREADS],
+                         &cmd)) {
+        break;
+      }
+    }
+    if (i == RTOS_CFG_TMR_EXEC_THREADS) {
+      sem_post(&exec_sem);
+      sched_yield();
+      continue;
+    }
+    run_timer_exec(cmd.timer, RTOS_CFG_TMR_MAX_SHARDS + self);
+  }
+  return temp;
+}
+#endif
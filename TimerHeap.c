@@ -0,0 +1,225 @@
+// Header Files
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/*****************************************************
+ * Timer Store: 4-ary Min-Heap
+ *****************************************************
+ * The running timers of a shard in an array ordered as a heap on RTOSTmrMatch,
+ * every timer keeps its position in RTOSTmrIndex so it can be removed without
+ * a search. Insert and remove are O(log n), there is no cascading and no work
+ * at all for ticks without an expiry. Four children per entry keep the heap
+ * shallow and the children of an entry in one cache line.
+ */
+
+/*
+  @ heap_before().
+  Whether timer a expires before timer b, wrap-safe.
+*/
+static inline INT8U heap_before(const RTOS_TMR *a, const RTOS_TMR *b) {
+  return (INT32)(a->RTOSTmrMatch - b->RTOSTmrMatch) < 0;
+}
+
+/*
+  @ heap_place().
+  Put a timer at a position of the heap array.
+*/
+static inline void heap_place(TMR_SHARD *shard, RTOS_TMR *timer,
+                              INT32U index) {
+  shard->heap[index] = timer;
+  timer->RTOSTmrIndex = index;
+}
+
+/*
+  @ heap_sift_up().
+  Move the timer at index up until its parent expires no later.
+*/
+static void heap_sift_up(TMR_SHARD *shard, INT32U index) {
+  RTOS_TMR *timer = shard->heap[index];
+
+  while (index > 0) {
+    INT32U parent = (index - 1) / RTOS_TMR_HEAP_ARITY;
+    if (!heap_before(timer, shard->heap[parent]))
+      break;
+    heap_place(shard, shard->heap[parent], index);
+    index = parent;
+  }
+  heap_place(shard, timer, index);
+}
+
+/*
+  @ heap_sift_down().
+  Move the timer at index down until none of its children expires earlier.
+*/
+static void heap_sift_down(TMR_SHARD *shard, INT32U index) {
+  RTOS_TMR *timer = shard->heap[index];
+
+  while (1) {
+    INT32U first = index * RTOS_TMR_HEAP_ARITY + 1;
+    if (first >= shard->heap_size)
+      break;
+    INT32U last = first + RTOS_TMR_HEAP_ARITY;
+    if (last > shard->heap_size)
+      last = shard->heap_size;
+    INT32U best = first;
+    for (INT32U child = first + 1; child < last; child++) {
+      if (heap_before(shard->heap[child], shard->heap[best]))
+        best = child;
+    }
+    if (!heap_before(shard->heap[best], timer))
+      break;
+    heap_place(shard, shard->heap[best], index);
+    index = best;
+  }
+  heap_place(shard, timer, index);
+}
+
+/*
+  @ init_timer_heap().
+  Allocate the heap array with RTOS_TMR_HEAP_INIT_SIZE entries.
+*/
+static INT8U init_timer_heap(TMR_SHARD *shard) {
+  shard->heap = malloc(RTOS_TMR_HEAP_INIT_SIZE * sizeof(RTOS_TMR *));
+  if (shard->heap == NULL) {
+    return RTOS_MALLOC_ERR;
+  }
+  shard->heap_size = 0;
+  shard->heap_cap = RTOS_TMR_HEAP_INIT_SIZE;
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ destroy_timer_heap().
+  Free the heap array.
+*/
+static void destroy_timer_heap(TMR_SHARD *shard) {
+  free(shard->heap);
+  shard->heap = NULL;
+  shard->heap_size = 0;
+  shard->heap_cap = 0;
+}
+
+/*
+  @ heap_insert().
+  Add the timer to the heap, doubling the array when it is full.
+  Caller holds the shard mutex.
+*/
+static INT8U heap_insert(TMR_SHARD *shard, RTOS_TMR *timer) {
+  if (shard->heap_size == shard->heap_cap) {
+    RTOS_TMR **heap =
+        realloc(shard->heap, 2 * shard->heap_cap * sizeof(RTOS_TMR *));
+    if (heap == NULL) {
+      return RTOS_MALLOC_ERR;
+    }
+    shard->heap = heap;
+    shard->heap_cap *= 2;
+  }
+  shard->heap[shard->heap_size] = timer;
+  heap_sift_up(shard, shard->heap_size++);
+  timer->RTOSTmrSlot = 0;
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ heap_remove().
+  Take the timer out of the heap: the last entry fills its place and is
+  sifted up or down from there. Caller holds the shard mutex.
+*/
+static void heap_remove(TMR_SHARD *shard, RTOS_TMR *timer) {
+  INT32U index = timer->RTOSTmrIndex;
+  RTOS_TMR *last = shard->heap[--shard->heap_size];
+
+  if (index != shard->heap_size) {
+    heap_place(shard, last, index);
+    heap_sift_up(shard, index);
+    heap_sift_down(shard, last->RTOSTmrIndex);
+  }
+  timer->RTOSTmrNext = RTOS_TMR_NO_ID;
+  timer->RTOSTmrPrev = RTOS_TMR_NO_ID;
+  timer->RTOSTmrSlot = RTOS_TMR_WHEEL_NO_SLOT;
+}
+
+/*
+  @ heap_begin_tick().
+  Nothing to prepare, the root of the heap is always the next expiry.
+*/
+static INT32U heap_begin_tick(TMR_SHARD *shard) {
+  (void)shard;
+  return 0;
+}
+
+/*
+  @ heap_pop_expired().
+  Take the root of the heap if it is due by the current tick.
+*/
+static RTOS_TMR *heap_pop_expired(TMR_SHARD *shard) {
+  if (shard->heap_size == 0 ||
+      (INT32)(shard->tick - shard->heap[0]->RTOSTmrMatch) < 0) {
+    return NULL;
+  }
+  RTOS_TMR *timer = shard->heap[0];
+  heap_remove(shard, timer);
+  return timer;
+}
+
+/*
+  @ heap_next_deadline().
+  The expiry of the root, or the current tick if that already passed.
+  Returns RTOS_FALSE if the heap is empty.
+*/
+static INT8U heap_next_deadline(TMR_SHARD *shard, INT32U *deadline) {
+  if (shard->heap_size == 0) {
+    return RTOS_FALSE;
+  }
+  INT32U match = shard->heap[0]->RTOSTmrMatch;
+  *deadline = (INT32)(match - shard->tick) < 0 ? shard->tick : match;
+  return RTOS_TRUE;
+}
+
+/*
+  @ compact_timer_heap().
+  Unlink every tombstone in one pass over the array, then rebuild the heap
+  bottom up, O(n). Returns the number unlinked. Caller holds the shard mutex.
+*/
+static INT32U compact_timer_heap(TMR_SHARD *shard) {
+  INT32U size = 0;
+  INT32U dropped = 0;
+
+  for (INT32U i = 0; i < shard->heap_size; i++) {
+    RTOS_TMR *timer = shard->heap[i];
+    if (__atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE) ==
+        RTOS_TMR_STATE_STOPPED) {
+      timer->RTOSTmrNext = RTOS_TMR_NO_ID;
+      timer->RTOSTmrPrev = RTOS_TMR_NO_ID;
+      timer->RTOSTmrSlot = RTOS_TMR_WHEEL_NO_SLOT;
+      dropped++;
+      continue;
+    }
+    heap_place(shard, timer, size++);
+  }
+  shard->heap_size = size;
+  for (INT32U i = size > 1 ? (size - 2) / RTOS_TMR_HEAP_ARITY + 1 : 0;
+       i-- > 0;) {
+    heap_sift_down(shard, i);
+  }
+  return dropped;
+}
+
+// Min-heap store, see TMR_STORE_OPS. There is no cheap way to find a busy
+// tick in a heap, timers with slack are only rounded to a coarser tick.
+const TMR_STORE_OPS timer_heap_store = {
+    .name = "heap",
+    .lazy_rearm = RTOS_FALSE,
+    .init = init_timer_heap,
+    .destroy = destroy_timer_heap,
+    .insert = heap_insert,
+    .remove = heap_remove,
+    .begin_tick = heap_begin_tick,
+    .pop_expired = heap_pop_expired,
+    .next_deadline = heap_next_deadline,
+    .busy_tick = NULL,
+    .compact = compact_timer_heap,
+};
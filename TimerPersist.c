@@ -0,0 +1,472 @@
+// Header Files
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*****************************************************
+ * Persistence
+ *****************************************************
+ * RTOSTmrPersistOpen() maps the file over an address range sized for the
+ * largest pool, and grow_timer_pool() takes its chunks from there, growing
+ * the file, instead of from the heap. The timers refer to each other by pool
+ * id only, so the chunks mean the same wherever the file is mapped. What does
+ * not carry over is fixed up by restore_timer_pool(): the callback, argument
+ * and name pointers of the cold fields, through the callback ids, and the
+ * deadlines, through the wall clock time of the last tick of every shard.
+ */
+
+// Callbacks by id, see RTOSTmrCallbackRegister().
+static RTOS_TMR_CALLBACK callback_fn[RTOS_CFG_TMR_CALLBACK_IDS];
+static INT8 *callback_name[RTOS_CFG_TMR_CALLBACK_IDS];
+static pthread_mutex_t callback_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#if RTOS_CFG_TMR_PERSIST_EN
+_Static_assert(sizeof(RTOS_TMR_PERSIST_HEADER) <= RTOS_TMR_PERSIST_HEADER_BYTES,
+               "the header of the persisted pool outgrew its space");
+
+// The mapping, NULL until RTOSTmrPersistOpen(), and the header as the last
+// process left it, read by restore_timer_pool().
+static RTOS_TMR_PERSIST_HEADER *persist_map = NULL;
+static RTOS_TMR_PERSIST_HEADER persist_last;
+static INT32 persist_fd = -1;
+static INT8U persist_pending = RTOS_FALSE;
+static RTOS_TMR_PERSIST_INFO persist_info;
+
+// Address of a callback in the last run and its id, sorted by address.
+typedef struct persist_callback {
+  INT64U addr;
+  INT32U id;
+} PERSIST_CALLBACK;
+
+extern RTOS_TMR *TmrPoolChunk[];
+extern RTOS_TMR_COLD *TmrPoolCold[];
+extern INT32U TmrPoolChunkCount;
+extern INT32U *FreeTmrStack;
+extern INT32U FreeTmrStackSize;
+extern INT32U FreeTmrCount;
+extern pthread_mutex_t timer_pool_mutex;
+extern TMR_SHARD *TmrShard;
+extern INT32U TmrShardCount;
+
+static INT64U wall_clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (INT64U)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+  @ persist_chunk_at().
+  Address of chunk index of the timers in the mapping, its cold fields follow.
+*/
+static inline INT8U *persist_chunk_at(INT32U index) {
+  return (INT8U *)persist_map + RTOS_TMR_PERSIST_HEADER_BYTES +
+         (INT64U)index * RTOS_TMR_PERSIST_CHUNK_BYTES;
+}
+
+/*
+  @ check_persist_header().
+  RTOS_TRUE if the file of file_bytes bytes holds a pool of this build.
+*/
+static INT8U check_persist_header(const RTOS_TMR_PERSIST_HEADER *header,
+                                  INT64U file_bytes) {
+  return memcmp(header->magic, RTOS_TMR_PERSIST_MAGIC,
+                sizeof(header->magic)) == 0 &&
+         header->version == RTOS_TMR_PERSIST_VERSION &&
+         header->timer_size == sizeof(RTOS_TMR) &&
+         header->cold_size == sizeof(RTOS_TMR_COLD) &&
+         header->chunk_size == RTOS_CFG_TMR_POOL_CHUNK_SIZE &&
+         header->tick_ns == RTOS_CFG_TMR_TASK_RATE &&
+         header->chunk_count <= RTOS_CFG_TMR_POOL_MAX_CHUNKS &&
+         RTOS_TMR_PERSIST_HEADER_BYTES +
+                 (INT64U)header->chunk_count * RTOS_TMR_PERSIST_CHUNK_BYTES <=
+             file_bytes;
+}
+
+/*
+  @ adopt_persist_chunks().
+  Make the chunks found in the file the pool, with the ids of their unused
+  timers on the free stack. Caller holds timer_pool_mutex.
+*/
+static INT8U adopt_persist_chunks(INT32U chunk_count) {
+  INT32U size = chunk_count * RTOS_CFG_TMR_POOL_CHUNK_SIZE;
+
+  FreeTmrStack = malloc(size * sizeof(INT32U));
+  if (FreeTmrStack == NULL) {
+    return RTOS_MALLOC_ERR;
+  }
+  FreeTmrStackSize = size;
+  for (INT32U i = 0; i < chunk_count; i++) {
+    TmrPoolChunk[i] = (RTOS_TMR *)persist_chunk_at(i);
+    TmrPoolCold[i] =
+        (RTOS_TMR_COLD *)(persist_chunk_at(i) + RTOS_TMR_CHUNK_BYTES);
+  }
+  // Lowest ids on top, so they are handed out first.
+  for (INT32U id = size; id > 0; id--) {
+    RTOS_TMR *timer = &TmrPoolChunk[(id - 1) >> RTOS_CFG_TMR_POOL_CHUNK_BITS]
+                                   [(id - 1) &
+                                    (RTOS_CFG_TMR_POOL_CHUNK_SIZE - 1)];
+    if (timer->RTOSTmrState == RTOS_TMR_STATE_UNUSED) {
+      FreeTmrStack[FreeTmrCount++] = id - 1;
+    }
+  }
+  __atomic_store_n(&TmrPoolChunkCount, chunk_count, __ATOMIC_RELEASE);
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ compare_persist_callback().
+  qsort() and bsearch() order of PERSIST_CALLBACK: by address.
+*/
+static int compare_persist_callback(const void *a, const void *b) {
+  INT64U addr_a = ((const PERSIST_CALLBACK *)a)->addr;
+  INT64U addr_b = ((const PERSIST_CALLBACK *)b)->addr;
+  return (addr_a > addr_b) - (addr_a < addr_b);
+}
+
+/*
+  @ restore_timer_obj().
+  - Give a timer of the last run its callback, argument and name of this run,
+  and link it again if it was running: the ticks it had left at the last tick
+  of its shard, less the ticks since. A timer whose expiry had begun expires
+  again. Returns RTOS_FALSE if the timer has to go back to the pool.
+  - known holds the callbacks of the last run that have an id in this one.
+*/
+static INT8U restore_timer_obj(RTOS_TMR *timer, const PERSIST_CALLBACK *known,
+                               INT32U known_count, INT64U now_ns) {
+  RTOS_TMR_COLD *cold = get_timer_cold(timer);
+  PERSIST_CALLBACK key = {(INT64U)(uintptr_t)cold->RTOSTmrCallback, 0};
+  const PERSIST_CALLBACK *found;
+  INT8U state = timer->RTOSTmrState;
+
+  found = bsearch(&key, known, known_count, sizeof(*known),
+                  compare_persist_callback);
+  if (found == NULL || state == RTOS_TMR_STATE_DELETING ||
+      (timer->RTOSTmrFlags & RTOS_TMR_FLAG_FREE)) {
+    return RTOS_FALSE;
+  }
+  cold->RTOSTmrCallback = callback_fn[found->id];
+  cold->RTOSTmrName = callback_name[found->id];
+  // An argument into the old mapping, e.g. the payload, moves with it.
+  INT64U offset = (INT64U)(uintptr_t)cold->RTOSTmrCallbackArg - persist_last.base;
+  if (offset < RTOS_TMR_PERSIST_MAX_BYTES) {
+    cold->RTOSTmrCallbackArg = (INT8U *)persist_map + offset;
+  }
+
+  // The stores are new, and the shard may be gone.
+  RTOS_TMR_PERSIST_CLOCK clock = persist_last.clock[timer->RTOSTmrShard];
+  timer->RTOSTmrShard %= TmrShardCount;
+  timer->RTOSTmrFlags &= RTOS_CFG_TMR_EXEC_THREADS ? RTOS_TMR_FLAG_POOL : 0;
+  timer->RTOSTmrNext = RTOS_TMR_NO_ID;
+  timer->RTOSTmrPrev = RTOS_TMR_NO_ID;
+  timer->RTOSTmrSlot = RTOS_TMR_WHEEL_NO_SLOT;
+  if (state == RTOS_TMR_STATE_STOPPED) {
+    return RTOS_TRUE;
+  }
+  INT64 left = 0;
+  if (state == RTOS_TMR_STATE_RUNNING) {
+    left = (INT32)(timer->RTOSTmrMatch - clock.tick);
+    if (clock.wall_ns != 0 && now_ns > clock.wall_ns) {
+      left -= (INT64)((now_ns - clock.wall_ns) / RTOS_CFG_TMR_TASK_RATE);
+    }
+  }
+  if (left <= 0) {
+    persist_info.overdue++;
+    left = 0;
+  }
+  insert_timer_entry(timer, (INT32U)left);
+  return RTOS_TRUE;
+}
+#endif
+
+/*
+  @ RTOSTmrCallbackRegister().
+  - Give callback the id it is restored by, with the name its restored timers
+  get, see RTOSTmrPersistOpen(). Every run registers the same callbacks under
+  the same ids before RTOSTmrInit(); timers of a callback without an id are
+  not restored.
+  - Fails with RTOS_ERR_TMR_NO_CALLBACK for a NULL callback, and with
+  RTOS_ERR_TMR_CALLBACK_ID for an id of RTOS_CFG_TMR_CALLBACK_IDS or more or a
+  callback that has another id already.
+*/
+INT8U RTOSTmrCallbackRegister(INT32U id, RTOS_TMR_CALLBACK callback,
+                              INT8 *name, INT8U *perr) {
+  if (callback == NULL) {
+    *perr = RTOS_ERR_TMR_NO_CALLBACK;
+    return RTOS_FALSE;
+  }
+  if (id >= RTOS_CFG_TMR_CALLBACK_IDS) {
+    *perr = RTOS_ERR_TMR_CALLBACK_ID;
+    return RTOS_FALSE;
+  }
+  pthread_mutex_lock(&callback_mutex);
+  for (INT32U i = 0; i < RTOS_CFG_TMR_CALLBACK_IDS; i++) {
+    if (i != id && callback_fn[i] == callback) {
+      pthread_mutex_unlock(&callback_mutex);
+      *perr = RTOS_ERR_TMR_CALLBACK_ID;
+      return RTOS_FALSE;
+    }
+  }
+  callback_fn[id] = callback;
+  callback_name[id] = name;
+#if RTOS_CFG_TMR_PERSIST_EN
+  if (persist_map != NULL) {
+    persist_map->callback[id] = (INT64U)(uintptr_t)callback;
+  }
+#endif
+  pthread_mutex_unlock(&callback_mutex);
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
+}
+
+/*
+  @ RTOSTmrPersistOpen().
+  - Keep the timer pool in the file at path, made if missing, before
+  RTOSTmrInit() or any timer. If the file holds the pool of an earlier run,
+  its timers are restored when RTOSTmrInit() makes the shards: running ones
+  expire at the same wall clock time, those due meanwhile at the first tick.
+  Handles stay valid across the restart.
+  - Only the timers of a callback registered with RTOSTmrCallbackRegister()
+  are restored. Their callback argument is kept as is, unless it pointed into
+  the timer (the payload, see RTOSTmrCreatePayload()), so pointers to memory
+  of the last run must not be used as arguments.
+  - Fails with RTOS_ERR_TMR_PERSIST if persistence is not built in
+  (RTOS_CFG_TMR_PERSIST_EN), the pool exists already, the file cannot be
+  mapped, another process has it open, or it holds no pool of this build.
+*/
+INT8U RTOSTmrPersistOpen(const INT8 *path, INT8U *perr) {
+#if RTOS_CFG_TMR_PERSIST_EN
+  struct stat st;
+  INT8U err = RTOS_ERR_TMR_PERSIST;
+
+  pthread_mutex_lock(&timer_pool_mutex);
+  if (persist_map != NULL || TmrPoolChunkCount != 0) {
+    pthread_mutex_unlock(&timer_pool_mutex);
+    *perr = RTOS_ERR_TMR_PERSIST;
+    return RTOS_FALSE;
+  }
+  INT32 fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &st) != 0 ||
+      (st.st_size == 0 &&
+       ftruncate(fd, RTOS_TMR_PERSIST_HEADER_BYTES) != 0)) {
+    RTOS_TMR_ERR("\nCannot open the timer pool file %s\n", path);
+    goto fail;
+  }
+  void *map = mmap(NULL, RTOS_TMR_PERSIST_MAX_BYTES, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    RTOS_TMR_ERR("\nCannot map the timer pool file %s\n", path);
+    goto fail;
+  }
+  RTOS_TMR_PERSIST_HEADER *header = map;
+  if (st.st_size != 0 && !check_persist_header(header, st.st_size)) {
+    RTOS_TMR_ERR("\n%s holds no timer pool of this build\n", path);
+    munmap(map, RTOS_TMR_PERSIST_MAX_BYTES);
+    goto fail;
+  }
+  persist_last = *header;
+  persist_map = header;
+  if (st.st_size != 0 && header->chunk_count != 0) {
+    err = adopt_persist_chunks(header->chunk_count);
+    if (err != RTOS_SUCCESS) {
+      munmap(map, RTOS_TMR_PERSIST_MAX_BYTES);
+      persist_map = NULL;
+      goto fail;
+    }
+    persist_pending = RTOS_TRUE;
+  }
+  memcpy(header->magic, RTOS_TMR_PERSIST_MAGIC, sizeof(header->magic));
+  header->version = RTOS_TMR_PERSIST_VERSION;
+  header->timer_size = sizeof(RTOS_TMR);
+  header->cold_size = sizeof(RTOS_TMR_COLD);
+  header->chunk_size = RTOS_CFG_TMR_POOL_CHUNK_SIZE;
+  header->tick_ns = RTOS_CFG_TMR_TASK_RATE;
+  header->base = (INT64U)(uintptr_t)map;
+  pthread_mutex_lock(&callback_mutex);
+  for (INT32U i = 0; i < RTOS_CFG_TMR_CALLBACK_IDS; i++) {
+    header->callback[i] = (INT64U)(uintptr_t)callback_fn[i];
+  }
+  pthread_mutex_unlock(&callback_mutex);
+  persist_fd = fd;
+  pthread_mutex_unlock(&timer_pool_mutex);
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
+
+fail:
+  if (fd >= 0) {
+    close(fd);
+  }
+  pthread_mutex_unlock(&timer_pool_mutex);
+  *perr = err;
+  return RTOS_FALSE;
+#else
+  (void)path;
+  *perr = RTOS_ERR_TMR_PERSIST;
+  return RTOS_FALSE;
+#endif
+}
+
+/*
+  @ RTOSTmrPersistSync().
+  Write the pool file out to disk, so it also survives a crash of the
+  machine: the page cache keeps it across a crash of the process alone.
+  Fails with RTOS_ERR_TMR_PERSIST if no file is open or the write fails.
+*/
+INT8U RTOSTmrPersistSync(INT8U *perr) {
+#if RTOS_CFG_TMR_PERSIST_EN
+  if (persist_map == NULL ||
+      msync(persist_map,
+            RTOS_TMR_PERSIST_HEADER_BYTES +
+                (INT64U)__atomic_load_n(&TmrPoolChunkCount, __ATOMIC_ACQUIRE) *
+                    RTOS_TMR_PERSIST_CHUNK_BYTES,
+            MS_SYNC) != 0) {
+    *perr = RTOS_ERR_TMR_PERSIST;
+    return RTOS_FALSE;
+  }
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
+#else
+  *perr = RTOS_ERR_TMR_PERSIST;
+  return RTOS_FALSE;
+#endif
+}
+
+/*
+  @ RTOSTmrPersistInfoGet().
+  Get what the restore of the pool found and the size of the file, all zero
+  without a file.
+*/
+void RTOSTmrPersistInfoGet(RTOS_TMR_PERSIST_INFO *info) {
+  memset(info, 0, sizeof(*info));
+#if RTOS_CFG_TMR_PERSIST_EN
+  if (persist_map != NULL) {
+    *info = persist_info;
+    info->file_bytes =
+        RTOS_TMR_PERSIST_HEADER_BYTES +
+        (INT64U)__atomic_load_n(&TmrPoolChunkCount, __ATOMIC_ACQUIRE) *
+            RTOS_TMR_PERSIST_CHUNK_BYTES;
+  }
+#endif
+}
+
+/*
+  @ map_persist_chunk().
+  - Grow the pool file by the chunk index and return its timers and cold
+  fields, or NULL in both without a file.
+  - Returns RTOS_MALLOC_ERR if the file cannot grow. Caller holds
+  timer_pool_mutex.
+*/
+INT8U map_persist_chunk(INT32U index, RTOS_TMR **chunk, RTOS_TMR_COLD **cold) {
+  *chunk = NULL;
+  *cold = NULL;
+#if RTOS_CFG_TMR_PERSIST_EN
+  if (persist_map == NULL) {
+    return RTOS_SUCCESS;
+  }
+  if (ftruncate(persist_fd, RTOS_TMR_PERSIST_HEADER_BYTES +
+                                (INT64U)(index + 1) *
+                                    RTOS_TMR_PERSIST_CHUNK_BYTES) != 0) {
+    return RTOS_MALLOC_ERR;
+  }
+  *chunk = (RTOS_TMR *)persist_chunk_at(index);
+  *cold = (RTOS_TMR_COLD *)(persist_chunk_at(index) + RTOS_TMR_CHUNK_BYTES);
+#else
+  (void)index;
+#endif
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ persist_timer_chunks().
+  Record in the file header that its first chunk_count chunks are set up.
+*/
+void persist_timer_chunks(INT32U chunk_count) {
+#if RTOS_CFG_TMR_PERSIST_EN
+  if (persist_map != NULL) {
+    persist_map->chunk_count = chunk_count;
+  }
+#else
+  (void)chunk_count;
+#endif
+}
+
+/*
+  @ persist_timer_clock().
+  Record the tick of the shard at the wall clock time now, what the restore
+  rebases the deadlines of its timers on. Caller holds the shard mutex.
+*/
+void persist_timer_clock(TMR_SHARD *shard) {
+#if RTOS_CFG_TMR_PERSIST_EN
+  if (persist_map != NULL) {
+    RTOS_TMR_PERSIST_CLOCK *clock = &persist_map->clock[shard - TmrShard];
+    clock->wall_ns = wall_clock_ns();
+    clock->tick = shard->tick;
+  }
+#else
+  (void)shard;
+#endif
+}
+
+/*
+  @ restore_timer_pool().
+  - Once the shards are made, relink the timers of the pool file, see
+  restore_timer_obj(), and free those whose callback has no id. Does nothing
+  without a pool to restore.
+  - Before the timer tasks run, nothing else uses the pool yet.
+*/
+void restore_timer_pool(void) {
+#if RTOS_CFG_TMR_PERSIST_EN
+  PERSIST_CALLBACK known[RTOS_CFG_TMR_CALLBACK_IDS];
+  INT32U known_count = 0;
+
+  if (persist_map == NULL) {
+    return;
+  }
+  INT64U t0 = timer_clock_ns();
+  if (persist_pending) {
+    pthread_mutex_lock(&callback_mutex);
+    for (INT32U i = 0; i < RTOS_CFG_TMR_CALLBACK_IDS; i++) {
+      if (persist_last.callback[i] != 0 && callback_fn[i] != NULL) {
+        known[known_count].addr = persist_last.callback[i];
+        known[known_count++].id = i;
+      }
+    }
+    pthread_mutex_unlock(&callback_mutex);
+    qsort(known, known_count, sizeof(*known), compare_persist_callback);
+
+    INT64U now_ns = wall_clock_ns();
+    INT32U size = persist_last.chunk_count * RTOS_CFG_TMR_POOL_CHUNK_SIZE;
+    for (INT32U id = 0; id < size; id++) {
+      RTOS_TMR *timer = get_timer_obj(id);
+      if (timer->RTOSTmrState == RTOS_TMR_STATE_UNUSED) {
+        continue;
+      }
+      if (restore_timer_obj(timer, known, known_count, now_ns)) {
+        persist_info.restored++;
+      } else {
+        persist_info.dropped++;
+        free_timer_obj(timer);
+      }
+    }
+    persist_pending = RTOS_FALSE;
+  }
+  // The ticks of the new shards start at the wall clock time now.
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    pthread_mutex_lock(&TmrShard[i].mutex);
+    persist_timer_clock(&TmrShard[i]);
+    pthread_mutex_unlock(&TmrShard[i].mutex);
+  }
+  persist_map->shard_count = TmrShardCount;
+  persist_info.restore_ns = timer_clock_ns() - t0;
+#endif
+}
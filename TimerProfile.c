@@ -0,0 +1,323 @@
+// Header Files
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*****************************************************
+ * Callback Profiling
+ *****************************************************
+ * Every callback run goes through run_timer_callback(), which times it and
+ * adds it to the profile of the timer name. The name table is open addressed
+ * and looked up without a lock, only a new name takes prof_mutex. Slow
+ * callbacks go to slow_ring under prof_mutex too, which is off the fast path.
+ * Every runner publishes its running callback in cb_run for the watchdog.
+ */
+
+#if RTOS_CFG_TMR_PROFILE_EN
+// Profiles by name, the extra last entry takes the names that do not fit.
+static RTOS_TMR_PROFILE prof_table[RTOS_CFG_TMR_PROFILE_SIZE + 1] = {
+    [RTOS_CFG_TMR_PROFILE_SIZE] = {.name = "(other)"}};
+static INT8U prof_used[RTOS_CFG_TMR_PROFILE_SIZE];
+
+// Protects new names in prof_table and slow_ring.
+static pthread_mutex_t prof_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Last slow callbacks, slow_count is the total recorded.
+static RTOS_TMR_SLOW_CB slow_ring[RTOS_CFG_TMR_SLOW_RING_SIZE];
+static INT64U slow_count = 0;
+
+// Callbacks taking longer go to slow_ring.
+static INT64U slow_threshold_ns = RTOS_CFG_TMR_SLOW_CB_NS;
+
+// Running callback of every runner.
+static TMR_CB_RUN cb_run[RTOS_TMR_RUNNERS];
+
+#if RTOS_CFG_TMR_WATCHDOG_TICKS
+static pthread_t watchdog_thread;
+#endif
+
+extern INT32U TmrShardCount;
+
+/*
+  @ profile_name().
+  Name a timer is profiled under.
+*/
+static inline const INT8 *profile_name(const INT8 *name) {
+  return name != NULL ? name : "(unnamed)";
+}
+
+/*
+  @ find_timer_profile().
+  - Profile of the timers named name, added on first use.
+  - Names are compared on their first RTOS_TMR_PROFILE_NAME_LEN - 1
+  characters, names beyond RTOS_CFG_TMR_PROFILE_SIZE share the last entry.
+*/
+static RTOS_TMR_PROFILE *find_timer_profile(const INT8 *name) {
+  INT32U hash = 2166136261U;
+  for (INT32U i = 0; i < RTOS_TMR_PROFILE_NAME_LEN - 1 && name[i]; i++) {
+    hash = (hash ^ (INT8U)name[i]) * 16777619U;
+  }
+
+  INT8U locked = RTOS_FALSE;
+  for (INT32U i = 0; i < RTOS_CFG_TMR_PROFILE_SIZE; i++) {
+    INT32U index = (hash + i) & (RTOS_CFG_TMR_PROFILE_SIZE - 1);
+    if (!__atomic_load_n(&prof_used[index], __ATOMIC_ACQUIRE)) {
+      if (!locked) {
+        // Look again under the lock, another thread may be adding it.
+        pthread_mutex_lock(&prof_mutex);
+        locked = RTOS_TRUE;
+        i--;
+        continue;
+      }
+      strncpy(prof_table[index].name, name, RTOS_TMR_PROFILE_NAME_LEN - 1);
+      __atomic_store_n(&prof_used[index], RTOS_TRUE, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&prof_mutex);
+      return &prof_table[index];
+    }
+    if (strncmp(prof_table[index].name, name, RTOS_TMR_PROFILE_NAME_LEN - 1) ==
+        0) {
+      if (locked) {
+        pthread_mutex_unlock(&prof_mutex);
+      }
+      return &prof_table[index];
+    }
+  }
+  if (locked) {
+    pthread_mutex_unlock(&prof_mutex);
+  }
+  return &prof_table[RTOS_CFG_TMR_PROFILE_SIZE];
+}
+
+/*
+  @ record_slow_callback().
+  Add a slow callback to slow_ring, overwriting the oldest.
+*/
+static void record_slow_callback(const INT8 *name, INT32U id, INT32U runner,
+                                 INT64U start_ns, INT64U duration_ns) {
+  pthread_mutex_lock(&prof_mutex);
+  RTOS_TMR_SLOW_CB *slow =
+      &slow_ring[slow_count++ % RTOS_CFG_TMR_SLOW_RING_SIZE];
+  strncpy(slow->name, name, RTOS_TMR_PROFILE_NAME_LEN - 1);
+  slow->name[RTOS_TMR_PROFILE_NAME_LEN - 1] = '\0';
+  slow->id = id;
+  slow->runner = runner;
+  slow->start_ns = start_ns;
+  slow->duration_ns = duration_ns;
+  pthread_mutex_unlock(&prof_mutex);
+}
+#endif
+
+/*
+  @ run_timer_callback().
+  - Call the Callback Function of a timer with arg, timed and added to the
+  profile of the timer name.
+  - runner is the timer task or executor worker running it (see
+  RTOS_TMR_RUNNERS), which publishes the callback to the watchdog.
+*/
+void run_timer_callback(RTOS_TMR *timer, void *arg, INT32U runner) {
+#if RTOS_CFG_TMR_PROFILE_EN
+  // Read the timer first, the callback may delete it.
+  RTOS_TMR_COLD *cold = get_timer_cold(timer);
+  RTOS_TMR_CALLBACK callback = cold->RTOSTmrCallback;
+  INT8 *name = cold->RTOSTmrName;
+  INT32U id = timer->RTOSTmrHandle;
+  TMR_CB_RUN *run = runner < RTOS_TMR_RUNNERS ? &cb_run[runner] : NULL;
+  INT64U start = timer_clock_ns();
+
+  if (run != NULL) {
+    run->name = name;
+    run->id = id;
+    __atomic_add_fetch(&run->seq, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&run->start_ns, start, __ATOMIC_RELEASE);
+  }
+  callback(arg);
+  INT64U duration = timer_clock_ns() - start;
+  if (run != NULL) {
+    __atomic_store_n(&run->start_ns, 0, __ATOMIC_RELEASE);
+  }
+
+  RTOS_TMR_PROFILE *prof = find_timer_profile(profile_name(name));
+  __atomic_add_fetch(&prof->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&prof->total_ns, duration, __ATOMIC_RELAXED);
+  INT64U max = __atomic_load_n(&prof->max_ns, __ATOMIC_RELAXED);
+  while (duration > max &&
+         !__atomic_compare_exchange_n(&prof->max_ns, &max, duration, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+  if (duration > __atomic_load_n(&slow_threshold_ns, __ATOMIC_RELAXED)) {
+    __atomic_add_fetch(&prof->slow, 1, __ATOMIC_RELAXED);
+    record_slow_callback(profile_name(name), id, runner, start, duration);
+  }
+#else
+  get_timer_cold(timer)->RTOSTmrCallback(arg);
+#endif
+}
+
+/*
+  @ init_timer_watchdog().
+  Create the watchdog thread, if RTOS_CFG_TMR_WATCHDOG_TICKS is set.
+*/
+INT8U init_timer_watchdog(void) {
+#if RTOS_CFG_TMR_PROFILE_EN && RTOS_CFG_TMR_WATCHDOG_TICKS
+  if (pthread_create(&watchdog_thread, NULL, RTOSTmrWatchdogTask, NULL) != 0) {
+    return RTOS_MALLOC_ERR;
+  }
+#endif
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ RTOSTmrWatchdogTask().
+  - Check the running callback of every timer task and executor worker once
+  per tick.
+  - Report a callback running for RTOS_CFG_TMR_WATCHDOG_TICKS ticks or more
+  once, and count it in the stalls of its profile.
+*/
+void *RTOSTmrWatchdogTask(void *temp) {
+#if RTOS_CFG_TMR_PROFILE_EN && RTOS_CFG_TMR_WATCHDOG_TICKS
+  const INT64U limit =
+      (INT64U)RTOS_CFG_TMR_WATCHDOG_TICKS * RTOS_CFG_TMR_TASK_RATE;
+  const struct timespec period = {RTOS_CFG_TMR_TASK_RATE / 1000000000,
+                                  RTOS_CFG_TMR_TASK_RATE % 1000000000};
+
+  while (1) {
+    nanosleep(&period, NULL);
+    INT64U now = timer_clock_ns();
+    for (INT32U runner = 0; runner < RTOS_TMR_RUNNERS; runner++) {
+      if (runner == TmrShardCount) {
+        // Skip the runners of the shards that do not exist.
+        runner = RTOS_CFG_TMR_MAX_SHARDS;
+        if (runner == RTOS_TMR_RUNNERS) {
+          break;
+        }
+      }
+      TMR_CB_RUN *run = &cb_run[runner];
+      INT64U start = __atomic_load_n(&run->start_ns, __ATOMIC_ACQUIRE);
+      if (start == 0 || now - start < limit) {
+        continue;
+      }
+      INT32U seq = __atomic_load_n(&run->seq, __ATOMIC_RELAXED);
+      INT8 *name = run->name;
+      INT32U id = run->id;
+      // Make sure name and id belong to the callback started at start.
+      if (__atomic_load_n(&run->start_ns, __ATOMIC_ACQUIRE) != start ||
+          run->flagged == seq) {
+        continue;
+      }
+      run->flagged = seq;
+      __atomic_add_fetch(&find_timer_profile(profile_name(name))->stalls, 1,
+                         __ATOMIC_RELAXED);
+      RTOS_TMR_ERR("\nWatchdog: callback of timer %s (id %u) running for %llu "
+                   "ms on runner %u\n",
+                   profile_name(name), id,
+                   (unsigned long long)((now - start) / 1000000), runner);
+    }
+  }
+#endif
+  return temp;
+}
+
+#if RTOS_CFG_TMR_PROFILE_EN
+/*
+  @ compare_profile_total().
+  qsort() order of profiles, most total time first.
+*/
+static int compare_profile_total(const void *a, const void *b) {
+  const RTOS_TMR_PROFILE *pa = a, *pb = b;
+  return pa->total_ns < pb->total_ns ? 1 : pa->total_ns > pb->total_ns ? -1 : 0;
+}
+#endif
+
+/*
+  @ RTOSTmrProfileGet().
+  Copy up to max callback profiles, the most total time first, returns the
+  number copied.
+*/
+INT32U RTOSTmrProfileGet(RTOS_TMR_PROFILE *profiles, INT32U max) {
+  INT32U count = 0;
+#if RTOS_CFG_TMR_PROFILE_EN
+  RTOS_TMR_PROFILE *all =
+      malloc((RTOS_CFG_TMR_PROFILE_SIZE + 1) * sizeof(RTOS_TMR_PROFILE));
+  if (all == NULL) {
+    return 0;
+  }
+  for (INT32U i = 0; i <= RTOS_CFG_TMR_PROFILE_SIZE; i++) {
+    RTOS_TMR_PROFILE *prof = &prof_table[i];
+    if (i < RTOS_CFG_TMR_PROFILE_SIZE &&
+        !__atomic_load_n(&prof_used[i], __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    if (__atomic_load_n(&prof->count, __ATOMIC_RELAXED) == 0 &&
+        __atomic_load_n(&prof->stalls, __ATOMIC_RELAXED) == 0) {
+      continue;
+    }
+    RTOS_TMR_PROFILE *copy = &all[count++];
+    memcpy(copy->name, prof->name, RTOS_TMR_PROFILE_NAME_LEN);
+    copy->count = __atomic_load_n(&prof->count, __ATOMIC_RELAXED);
+    copy->total_ns = __atomic_load_n(&prof->total_ns, __ATOMIC_RELAXED);
+    copy->max_ns = __atomic_load_n(&prof->max_ns, __ATOMIC_RELAXED);
+    copy->slow = __atomic_load_n(&prof->slow, __ATOMIC_RELAXED);
+    copy->stalls = __atomic_load_n(&prof->stalls, __ATOMIC_RELAXED);
+  }
+  qsort(all, count, sizeof(RTOS_TMR_PROFILE), compare_profile_total);
+  if (count > max) {
+    count = max;
+  }
+  memcpy(profiles, all, count * sizeof(RTOS_TMR_PROFILE));
+  free(all);
+#endif
+  return count;
+}
+
+/*
+  @ RTOSTmrSlowGet().
+  Copy up to max of the last slow callbacks, the newest first, returns the
+  number copied.
+*/
+INT32U RTOSTmrSlowGet(RTOS_TMR_SLOW_CB *slow, INT32U max) {
+  INT32U count = 0;
+#if RTOS_CFG_TMR_PROFILE_EN
+  pthread_mutex_lock(&prof_mutex);
+  INT64U next = slow_count;
+  while (count < max && count < RTOS_CFG_TMR_SLOW_RING_SIZE && next > 0) {
+    slow[count++] = slow_ring[--next % RTOS_CFG_TMR_SLOW_RING_SIZE];
+  }
+  pthread_mutex_unlock(&prof_mutex);
+#endif
+  return count;
+}
+
+/*
+  @ RTOSTmrSlowThresholdSet().
+  Set the run time in ns above which a callback counts as slow.
+*/
+void RTOSTmrSlowThresholdSet(INT64U ns) {
+#if RTOS_CFG_TMR_PROFILE_EN
+  __atomic_store_n(&slow_threshold_ns, ns, __ATOMIC_RELAXED);
+#endif
+}
+
+/*
+  @ RTOSTmrProfileReset().
+  Clear the callback profiles and the slow callbacks, the names stay.
+*/
+void RTOSTmrProfileReset(void) {
+#if RTOS_CFG_TMR_PROFILE_EN
+  pthread_mutex_lock(&prof_mutex);
+  for (INT32U i = 0; i <= RTOS_CFG_TMR_PROFILE_SIZE; i++) {
+    RTOS_TMR_PROFILE *prof = &prof_table[i];
+    __atomic_store_n(&prof->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prof->total_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prof->max_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prof->slow, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prof->stalls, 0, __ATOMIC_RELAXED);
+  }
+  slow_count = 0;
+  pthread_mutex_unlock(&prof_mutex);
+#endif
+}
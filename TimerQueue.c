@@ -0,0 +1,96 @@
+// Header Files
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <stdlib.h>
+
+/*****************************************************
+ * Bounded Lock-free Ring
+ *****************************************************
+ * Multi-producer/multi-consumer ring of fixed size TMR_CMD cells (Vyukov).
+ * A cell is free for the producer at position pos when its seq == pos, and
+ * holds a command for the consumer at position pos when its seq == pos + 1.
+ */
+
+/*
+  @ init_timer_ring().
+  Allocate the cells of a ring, size must be a power of 2.
+*/
+INT8U init_timer_ring(TMR_RING *ring, INT32U size) {
+  ring->cell = aligned_alloc(RTOS_CACHE_LINE_SIZE,
+                             (size * sizeof(TMR_RING_CELL) +
+                              RTOS_CACHE_LINE_SIZE - 1) /
+                                 RTOS_CACHE_LINE_SIZE * RTOS_CACHE_LINE_SIZE);
+  if (ring->cell == NULL) {
+    return RTOS_MALLOC_ERR;
+  }
+  for (INT32U i = 0; i < size; i++) {
+    ring->cell[i].seq = i;
+  }
+  ring->mask = size - 1;
+  ring->head = 0;
+  ring->tail = 0;
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ push_timer_ring().
+  Append a command, RTOS_FALSE if the ring is full. Never blocks.
+*/
+INT8U push_timer_ring(TMR_RING *ring, const TMR_CMD *cmd) {
+  INT32U pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+  while (1) {
+    TMR_RING_CELL *cell = &ring->cell[pos & ring->mask];
+    INT32 diff = (INT32)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+    if (diff == 0) {
+      // Claim the cell, then publish the command in it.
+      if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        cell->cmd = *cmd;
+        __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+        return RTOS_TRUE;
+      }
+    } else if (diff < 0) {
+      return RTOS_FALSE;
+    } else {
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/*
+  @ pop_timer_ring().
+  Take the oldest command, RTOS_FALSE if the ring is empty. Never blocks.
+*/
+INT8U pop_timer_ring(TMR_RING *ring, TMR_CMD *cmd) {
+  INT32U pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+  while (1) {
+    TMR_RING_CELL *cell = &ring->cell[pos & ring->mask];
+    INT32 diff =
+        (INT32)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+    if (diff == 0) {
+      // Claim the command, then hand the cell back to the producers.
+      if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *cmd = cell->cmd;
+        __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+        return RTOS_TRUE;
+      }
+    } else if (diff < 0) {
+      return RTOS_FALSE;
+    } else {
+      pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/*
+  @ timer_ring_depth().
+  Number of commands in the ring, a snapshot.
+*/
+INT32U timer_ring_depth(TMR_RING *ring) {
+  INT32U tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+}
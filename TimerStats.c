@@ -0,0 +1,221 @@
+// Header Files
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/*****************************************************
+ * Statistics
+ *****************************************************
+ * Every shard records into its own histograms, written by its timer task only
+ * and read or reset by any thread with relaxed atomics, so no lock is taken
+ * on the hot path. RTOSTmrStatsGet() merges the shards.
+ */
+
+// Time of tick 0 and whether it is set, see OSTickInitialize().
+extern struct timespec tick_epoch;
+extern INT8U tick_clock_ready;
+
+extern TMR_SHARD *TmrShard;
+extern INT32U TmrShardCount;
+
+/*
+  @ timer_clock_ns().
+  CLOCK_MONOTONIC in ns.
+*/
+INT64U timer_clock_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (INT64U)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+  @ hist_index().
+  Bucket of a value: values below 2^RTOS_TMR_HIST_SUB_BITS have their own
+  bucket, larger ones go by their highest bit and the RTOS_TMR_HIST_SUB_BITS
+  bits below it.
+*/
+static INT32U hist_index(INT64U value) {
+  if (value < (1U << RTOS_TMR_HIST_SUB_BITS)) {
+    return (INT32U)value;
+  }
+  INT32U msb = 63 - __builtin_clzll(value);
+  INT32U sub = (value >> (msb - RTOS_TMR_HIST_SUB_BITS)) &
+               ((1U << RTOS_TMR_HIST_SUB_BITS) - 1);
+  return ((msb - RTOS_TMR_HIST_SUB_BITS + 1) << RTOS_TMR_HIST_SUB_BITS) + sub;
+}
+
+/*
+  @ hist_value().
+  Highest value that falls in a bucket.
+*/
+static INT64U hist_value(INT32U index) {
+  if (index < (1U << RTOS_TMR_HIST_SUB_BITS)) {
+    return index;
+  }
+  INT32U msb = (index >> RTOS_TMR_HIST_SUB_BITS) + RTOS_TMR_HIST_SUB_BITS - 1;
+  INT64U sub = index & ((1U << RTOS_TMR_HIST_SUB_BITS) - 1);
+  INT32U shift = msb - RTOS_TMR_HIST_SUB_BITS;
+  return (((1ULL << RTOS_TMR_HIST_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+/*
+  @ record_timer_hist().
+  Add a value to a histogram, lock-free.
+*/
+void record_timer_hist(RTOS_TMR_HIST *hist, INT64U value) {
+  __atomic_add_fetch(&hist->bucket[hist_index(value)], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&hist->sum, value, __ATOMIC_RELAXED);
+  INT64U max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+  while (value > max &&
+         !__atomic_compare_exchange_n(&hist->max, &max, value, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+/*
+  @ record_timer_lateness().
+  Record how late the timer task dispatches a timer of class prio due at tick
+  match, measured against the wall clock time of that tick, overall and for
+  the class. Nothing is recorded until OSTickInitialize() has set the time of
+  tick 0.
+*/
+void record_timer_lateness(TMR_SHARD *shard, INT32U match, INT8U prio) {
+#if RTOS_CFG_TMR_STATS_EN
+  if (!tick_clock_ready) {
+    return;
+  }
+  INT64U due = (INT64U)tick_epoch.tv_sec * 1000000000ULL + tick_epoch.tv_nsec +
+               (INT64U)match * RTOS_CFG_TMR_TASK_RATE;
+  INT64U now = timer_clock_ns();
+  INT64U late = now > due ? now - due : 0;
+  record_timer_hist(&shard->lateness, late);
+  record_timer_hist(&shard->prio_lateness[prio], late);
+#endif
+}
+
+#if RTOS_CFG_TMR_STATS_EN
+/*
+  @ merge_timer_hist().
+  Add the histogram src to dst.
+*/
+static void merge_timer_hist(RTOS_TMR_HIST *dst, RTOS_TMR_HIST *src) {
+  for (INT32U i = 0; i < RTOS_TMR_HIST_BUCKETS; i++) {
+    dst->bucket[i] += __atomic_load_n(&src->bucket[i], __ATOMIC_RELAXED);
+  }
+  dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+  dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+  INT64U max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+  if (max > dst->max) {
+    dst->max = max;
+  }
+}
+
+/*
+  @ reset_timer_hist().
+  Clear a histogram.
+*/
+static void reset_timer_hist(RTOS_TMR_HIST *hist) {
+  for (INT32U i = 0; i < RTOS_TMR_HIST_BUCKETS; i++) {
+    __atomic_store_n(&hist->bucket[i], 0, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&hist->count, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&hist->sum, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&hist->max, 0, __ATOMIC_RELAXED);
+}
+#endif
+
+/*
+  @ RTOSTmrStatsGet().
+  Get the statistics of all shards merged. The histograms and the pool
+  low-water mark are zero when RTOS_CFG_TMR_STATS_EN is 0, the tombstones and
+  compactions when RTOS_CFG_TMR_LAZY_CANCEL_EN is 0.
+*/
+void RTOSTmrStatsGet(RTOS_TMR_STATS *stats) {
+  memset(stats, 0, sizeof(*stats));
+#if RTOS_CFG_TMR_STATS_EN
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    merge_timer_hist(&stats->lateness, &TmrShard[i].lateness);
+    for (INT32U p = 0; p < RTOS_TMR_PRIO_CLASSES; p++) {
+      merge_timer_hist(&stats->prio_lateness[p], &TmrShard[i].prio_lateness[p]);
+    }
+    merge_timer_hist(&stats->tick_time, &TmrShard[i].tick_time);
+    merge_timer_hist(&stats->tick_expired, &TmrShard[i].tick_expired);
+    pthread_mutex_lock(&TmrShard[i].mutex);
+    stats->slack_placed += TmrShard[i].slack_placed;
+    stats->slack_coalesced += TmrShard[i].slack_coalesced;
+    stats->budget_deferred += TmrShard[i].budget_deferred;
+    pthread_mutex_unlock(&TmrShard[i].mutex);
+  }
+  stats->pool_low_water = get_pool_low_water();
+  INT64U busy_ticks = stats->tick_expired.count - stats->tick_expired.bucket[0];
+  if (busy_ticks != 0) {
+    stats->coalesce_ratio = (double)stats->tick_expired.sum / busy_ticks;
+  }
+#endif
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    INT32 tombstones =
+        __atomic_load_n(&TmrShard[i].tombstones, __ATOMIC_RELAXED);
+    stats->tombstones += tombstones > 0 ? tombstones : 0;
+    pthread_mutex_lock(&TmrShard[i].mutex);
+    stats->compactions += TmrShard[i].compactions;
+    pthread_mutex_unlock(&TmrShard[i].mutex);
+  }
+#endif
+}
+
+/*
+  @ RTOSTmrStatsReset().
+  Clear the statistics of all shards and restart the pool low-water mark
+  from the current free count.
+*/
+void RTOSTmrStatsReset(void) {
+#if RTOS_CFG_TMR_STATS_EN
+  for (INT32U i = 0; i < TmrShardCount; i++) {
+    reset_timer_hist(&TmrShard[i].lateness);
+    for (INT32U p = 0; p < RTOS_TMR_PRIO_CLASSES; p++) {
+      reset_timer_hist(&TmrShard[i].prio_lateness[p]);
+    }
+    reset_timer_hist(&TmrShard[i].tick_time);
+    reset_timer_hist(&TmrShard[i].tick_expired);
+    pthread_mutex_lock(&TmrShard[i].mutex);
+    TmrShard[i].slack_placed = 0;
+    TmrShard[i].slack_coalesced = 0;
+    TmrShard[i].budget_deferred = 0;
+    pthread_mutex_unlock(&TmrShard[i].mutex);
+  }
+  reset_pool_low_water();
+#endif
+}
+
+/*
+  @ RTOSTmrHistPercentile().
+  Value below which fraction q (0.0 to 1.0) of the recorded values fall, as
+  the highest value of its bucket, 0 for an empty histogram.
+*/
+INT64U RTOSTmrHistPercentile(const RTOS_TMR_HIST *hist, double q) {
+  INT64U total = 0;
+  for (INT32U i = 0; i < RTOS_TMR_HIST_BUCKETS; i++) {
+    total += hist->bucket[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  INT64U rank = (INT64U)(q * total + 0.5);
+  INT64U seen = 0;
+  if (rank == 0) {
+    rank = 1;
+  }
+  for (INT32U i = 0; i < RTOS_TMR_HIST_BUCKETS; i++) {
+    seen += hist->bucket[i];
+    if (seen >= rank) {
+      INT64U value = hist_value(i);
+      return value < hist->max ? value : hist->max;
+    }
+  }
+  return hist->max;
+}
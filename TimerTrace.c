@@ -0,0 +1,274 @@
+// Header Files
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*****************************************************
+ * Trace
+ *****************************************************
+ * trace_timer_event() appends to the ring of the calling thread, made on its
+ * first event and linked in trace_rings. Nothing is shared on that path but
+ * the ring's own tail, read once per event. The drainer thread moves the
+ * rings to the trace file and frees the rings of exited threads.
+ */
+
+#if RTOS_CFG_TMR_TRACE_EN
+// Every ring made so far, trace_mutex protects the list and the file.
+static TMR_TRACE_RING *trace_rings = NULL;
+static INT32U trace_ring_count = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Ring of the calling thread, closed by trace_key when the thread exits.
+// Once closed, trace_exiting keeps a later destructor from opening another.
+static __thread TMR_TRACE_RING *trace_ring = NULL;
+static __thread INT8U trace_exiting = RTOS_FALSE;
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+// Events are recorded while trace_on is set, see RTOSTmrTraceStart().
+static INT8U trace_on = RTOS_FALSE;
+static INT8U trace_running = RTOS_FALSE;
+static FILE *trace_file = NULL;
+static pthread_t trace_thread;
+
+extern TMR_SHARD *TmrShard;
+
+/*
+  @ close_trace_ring().
+  Thread exit: leave the ring to the drainer, which frees it once drained.
+  The thread forgets it first, the drainer may free it as soon as it is
+  closed.
+*/
+static void close_trace_ring(void *ring) {
+  trace_ring = NULL;
+  trace_exiting = RTOS_TRUE;
+  __atomic_store_n(&((TMR_TRACE_RING *)ring)->closed, RTOS_TRUE,
+                   __ATOMIC_RELEASE);
+}
+
+/*
+  @ make_trace_key().
+  Create the key that closes the ring of an exiting thread.
+*/
+static void make_trace_key(void) {
+  pthread_key_create(&trace_key, close_trace_ring);
+}
+
+/*
+  @ open_trace_ring().
+  Make the ring of the calling thread and link it in trace_rings.
+  Returns NULL if out of memory.
+*/
+static TMR_TRACE_RING *open_trace_ring(void) {
+  TMR_TRACE_RING *ring =
+      aligned_alloc(RTOS_CACHE_LINE_SIZE, sizeof(TMR_TRACE_RING));
+
+  if (ring == NULL) {
+    return NULL;
+  }
+  memset(ring, 0, offsetof(TMR_TRACE_RING, event));
+  pthread_once(&trace_key_once, make_trace_key);
+  pthread_setspecific(trace_key, ring);
+  pthread_mutex_lock(&trace_mutex);
+  ring->thread = trace_ring_count++;
+  ring->next = trace_rings;
+  trace_rings = ring;
+  pthread_mutex_unlock(&trace_mutex);
+  trace_ring = ring;
+  return ring;
+}
+
+/*
+  @ write_trace_ring().
+  Write the events of a ring up to head to the trace file and release them,
+  plus a RTOS_TMR_TRACE_DROP event if it lost any since the last time.
+  Caller holds trace_mutex.
+*/
+static void write_trace_ring(TMR_TRACE_RING *ring, INT64U head) {
+  INT64U tail = ring->tail;
+  INT64U dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+  while (tail != head) {
+    INT32U index = tail & (RTOS_CFG_TMR_TRACE_SIZE - 1);
+    INT64U count = RTOS_CFG_TMR_TRACE_SIZE - index;
+    if (count > head - tail) {
+      count = head - tail;
+    }
+    fwrite(&ring->event[index], sizeof(RTOS_TMR_TRACE_EVENT), count,
+           trace_file);
+    tail += count;
+  }
+  __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+  if (dropped != ring->dropped_seen) {
+    RTOS_TMR_TRACE_EVENT drop = {.arg = dropped - ring->dropped_seen,
+                                 .thread = ring->thread,
+                                 .event = RTOS_TMR_TRACE_DROP};
+    fwrite(&drop, sizeof(drop), 1, trace_file);
+    ring->dropped_seen = dropped;
+  }
+}
+
+/*
+  @ drain_trace_rings().
+  Write out every ring and free the drained rings of exited threads.
+*/
+static void drain_trace_rings(void) {
+  TMR_TRACE_RING **link = &trace_rings;
+
+  pthread_mutex_lock(&trace_mutex);
+  while (*link != NULL) {
+    TMR_TRACE_RING *ring = *link;
+    // closed before head, so no event follows the head read.
+    INT8U closed = __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+    INT64U head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (trace_file != NULL) {
+      write_trace_ring(ring, head);
+    } else {
+      __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+    }
+    if (closed) {
+      *link = ring->next;
+      free(ring);
+    } else {
+      link = &ring->next;
+    }
+  }
+  if (trace_file != NULL) {
+    fflush(trace_file);
+  }
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+/*
+  @ RTOSTmrTraceTask().
+  Drainer thread: write the rings to the trace file every
+  RTOS_CFG_TMR_TRACE_DRAIN_NS until RTOSTmrTraceStop().
+*/
+static void *RTOSTmrTraceTask(void *temp) {
+  struct timespec period = {RTOS_CFG_TMR_TRACE_DRAIN_NS / 1000000000,
+                            RTOS_CFG_TMR_TRACE_DRAIN_NS % 1000000000};
+
+  while (__atomic_load_n(&trace_running, __ATOMIC_ACQUIRE)) {
+    nanosleep(&period, NULL);
+    drain_trace_rings();
+  }
+  return temp;
+}
+#endif
+
+/*
+  @ trace_timer_event().
+  Record an event of the timer in the ring of the calling thread, dropped
+  (and counted) if the ring is full. Does nothing while no trace runs, or
+  once the ring of an exiting thread is closed.
+*/
+void trace_timer_event(INT8U event, RTOS_TMR *timer, INT32U arg) {
+#if RTOS_CFG_TMR_TRACE_EN
+  TMR_TRACE_RING *ring = trace_ring;
+
+  if (!__atomic_load_n(&trace_on, __ATOMIC_RELAXED)) {
+    return;
+  }
+  if (ring == NULL &&
+      (trace_exiting || (ring = open_trace_ring()) == NULL)) {
+    return;
+  }
+  INT64U head = ring->head;
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+      RTOS_CFG_TMR_TRACE_SIZE) {
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    return;
+  }
+  RTOS_TMR_TRACE_EVENT *e =
+      &ring->event[head & (RTOS_CFG_TMR_TRACE_SIZE - 1)];
+  e->tick = __atomic_load_n(&TmrShard[timer->RTOSTmrShard].tick,
+                            __ATOMIC_RELAXED);
+  e->id = timer->RTOSTmrHandle;
+  e->arg = arg;
+  e->thread = ring->thread;
+  e->event = event;
+  e->shard = timer->RTOSTmrShard;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+#else
+  (void)event;
+  (void)timer;
+  (void)arg;
+#endif
+}
+
+/*
+  @ RTOSTmrTraceStart().
+  - Start recording the timer events of all threads and a drainer thread
+  writing them to the file at path, see RTOS_TMR_TRACE_HEADER.
+  - Fails with RTOS_ERR_TMR_TRACE if the trace is not built in
+  (RTOS_CFG_TMR_TRACE_EN), already running, or the file cannot be written.
+*/
+INT8U RTOSTmrTraceStart(const INT8 *path, INT8U *perr) {
+#if RTOS_CFG_TMR_TRACE_EN
+  RTOS_TMR_TRACE_HEADER header = {.version = RTOS_TMR_TRACE_VERSION,
+                                  .event_size = sizeof(RTOS_TMR_TRACE_EVENT),
+                                  .tick_ns = RTOS_CFG_TMR_TASK_RATE};
+
+  if (trace_running) {
+    *perr = RTOS_ERR_TMR_TRACE;
+    return RTOS_FALSE;
+  }
+  // Events left over from an earlier trace are not part of this one.
+  drain_trace_rings();
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    RTOS_TMR_ERR("\nCannot open the trace file %s\n", path);
+    *perr = RTOS_ERR_TMR_TRACE;
+    return RTOS_FALSE;
+  }
+  memcpy(header.magic, RTOS_TMR_TRACE_MAGIC, sizeof(header.magic));
+  fwrite(&header, sizeof(header), 1, file);
+  pthread_mutex_lock(&trace_mutex);
+  trace_file = file;
+  pthread_mutex_unlock(&trace_mutex);
+  trace_running = RTOS_TRUE;
+  if (pthread_create(&trace_thread, NULL, RTOSTmrTraceTask, NULL) != 0) {
+    trace_running = RTOS_FALSE;
+    pthread_mutex_lock(&trace_mutex);
+    trace_file = NULL;
+    pthread_mutex_unlock(&trace_mutex);
+    fclose(file);
+    *perr = RTOS_ERR_TMR_TRACE;
+    return RTOS_FALSE;
+  }
+  __atomic_store_n(&trace_on, RTOS_TRUE, __ATOMIC_RELAXED);
+  *perr = RTOS_SUCCESS;
+  return RTOS_TRUE;
+#else
+  (void)path;
+  *perr = RTOS_ERR_TMR_TRACE;
+  return RTOS_FALSE;
+#endif
+}
+
+/*
+  @ RTOSTmrTraceStop().
+  Stop recording, write out what the rings still hold and close the trace
+  file. Does nothing if no trace runs.
+*/
+void RTOSTmrTraceStop(void) {
+#if RTOS_CFG_TMR_TRACE_EN
+  if (!trace_running) {
+    return;
+  }
+  __atomic_store_n(&trace_on, RTOS_FALSE, __ATOMIC_RELAXED);
+  __atomic_store_n(&trace_running, RTOS_FALSE, __ATOMIC_RELEASE);
+  pthread_join(trace_thread, NULL);
+  drain_trace_rings();
+  pthread_mutex_lock(&trace_mutex);
+  fclose(trace_file);
+  trace_file = NULL;
+  pthread_mutex_unlock(&trace_mutex);
+#endif
+}
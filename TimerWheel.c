@@ -0,0 +1,324 @@
+// Header Files
+#include "TimerAPI.h"
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/*****************************************************
+ * Timer Store: Hierarchical Timing Wheel
+ *****************************************************
+ * Level 0 has one slot per tick, every further level RTOS_TMR_WHEEL_LN_SIZE
+ * slots spanning a whole turn of the level below. Insert and remove are O(1);
+ * a higher level slot is cascaded down whenever the level below completes a
+ * turn. An occupancy bitmap lets empty slots be skipped a word at a time.
+ * The slot lists link the timers by pool id, which keeps RTOS_TMR small.
+ */
+
+// Timer pool chunks, see TimerAPI.c.
+extern RTOS_TMR *TmrPoolChunk[];
+
+/*
+  @ wheel_timer().
+  Timer of a pool id linked in the wheel, the id is not checked.
+*/
+static inline RTOS_TMR *wheel_timer(INT32U id) {
+  return &TmrPoolChunk[id >> RTOS_CFG_TMR_POOL_CHUNK_BITS]
+                      [id & (RTOS_CFG_TMR_POOL_CHUNK_SIZE - 1)];
+}
+
+/*
+   @ init_timer_wheel().
+   Initialize the Timing wheel.
+*/
+static INT8U init_timer_wheel(TMR_SHARD *shard) {
+  for (INT32U i = 0; i < RTOS_TMR_WHEEL_SLOTS; i++) {
+    shard->wheel[i].timer_count = 0;
+    shard->wheel[i].list_id = RTOS_TMR_NO_ID;
+  }
+  for (INT32U i = 0; i < RTOS_TMR_WHEEL_SLOTS / 64; i++) {
+    shard->wheel_map[i] = 0;
+  }
+  return RTOS_SUCCESS;
+}
+
+/*
+   @ destroy_timer_wheel().
+   Nothing to free, the wheel is part of the shard.
+*/
+static void destroy_timer_wheel(TMR_SHARD *shard) { (void)shard; }
+
+/*
+  @ wheel_slot_index().
+  - Pick the wheel slot for an expiry tick.
+  - The level is chosen by the distance from the current tick, the slot in the
+  level by the expiry bits of that level, so no list is ever searched.
+  - A deadline that already passed (started while the tick was processed) is
+  placed in the slot of the current tick.
+*/
+static INT32U wheel_slot_index(TMR_SHARD *shard, INT32U match) {
+  INT32U delta = match - shard->tick;
+  if ((INT32)delta < 0) {
+    match = shard->tick;
+    delta = 0;
+  }
+  if (delta < RTOS_TMR_WHEEL_L0_SIZE) {
+    return match & (RTOS_TMR_WHEEL_L0_SIZE - 1);
+  }
+  INT32U shift = RTOS_TMR_WHEEL_L0_BITS;
+  INT32U base = RTOS_TMR_WHEEL_L0_SIZE;
+  for (int level = 1; level < RTOS_TMR_WHEEL_LEVELS - 1; level++) {
+    if (delta < (1U << (shift + RTOS_TMR_WHEEL_LN_BITS)))
+      break;
+    shift += RTOS_TMR_WHEEL_LN_BITS;
+    base += RTOS_TMR_WHEEL_LN_SIZE;
+  }
+  return base + ((match >> shift) & (RTOS_TMR_WHEEL_LN_SIZE - 1));
+}
+
+/*
+  @ wheel_link().
+  Link the timer at the head of its wheel slot. Caller holds the shard mutex.
+*/
+static INT8U wheel_link(TMR_SHARD *shard, RTOS_TMR *timer_obj) {
+  // RTOSTmrRestartLazy() may move RTOSTmrMatch without the mutex.
+  INT32U match = __atomic_load_n(&timer_obj->RTOSTmrMatch, __ATOMIC_ACQUIRE);
+  INT32U index = wheel_slot_index(shard, match);
+  WHEEL_SLOT *slot = &shard->wheel[index];
+  INT32U id = RTOS_TMR_HANDLE_ID(timer_obj->RTOSTmrHandle);
+
+  timer_obj->RTOSTmrPrev = RTOS_TMR_NO_ID;
+  timer_obj->RTOSTmrNext = slot->list_id;
+  if (slot->list_id != RTOS_TMR_NO_ID)
+    wheel_timer(slot->list_id)->RTOSTmrPrev = id;
+  else
+    shard->wheel_map[index / 64] |= 1ULL << (index % 64);
+  slot->list_id = id;
+  slot->timer_count++;
+  timer_obj->RTOSTmrSlot = index;
+  return RTOS_SUCCESS;
+}
+
+/*
+  @ wheel_unlink().
+  Unlink the timer from its wheel slot using its own Prev/Next ids.
+  Caller holds the shard mutex.
+*/
+static void wheel_unlink(TMR_SHARD *shard, RTOS_TMR *timer_obj) {
+  WHEEL_SLOT *slot = &shard->wheel[timer_obj->RTOSTmrSlot];
+
+  if (timer_obj->RTOSTmrPrev == RTOS_TMR_NO_ID) { // it is the first obj.
+    slot->list_id = timer_obj->RTOSTmrNext;
+  } else {
+    wheel_timer(timer_obj->RTOSTmrPrev)->RTOSTmrNext = timer_obj->RTOSTmrNext;
+  }
+  if (timer_obj->RTOSTmrNext != RTOS_TMR_NO_ID) { // it is not the last obj.
+    wheel_timer(timer_obj->RTOSTmrNext)->RTOSTmrPrev = timer_obj->RTOSTmrPrev;
+  }
+  if (--slot->timer_count == 0)
+    shard->wheel_map[timer_obj->RTOSTmrSlot / 64] &=
+        ~(1ULL << (timer_obj->RTOSTmrSlot % 64));
+  timer_obj->RTOSTmrNext = RTOS_TMR_NO_ID;
+  timer_obj->RTOSTmrPrev = RTOS_TMR_NO_ID;
+  timer_obj->RTOSTmrSlot = RTOS_TMR_WHEEL_NO_SLOT;
+}
+
+/*
+  @ wheel_next_slot().
+  Distance from slot 'from' to the next occupied slot of a wheel level, in
+  circular order, or -1 if the level is empty. Scans the occupancy bitmap a
+  word at a time.
+*/
+static INT32 wheel_next_slot(TMR_SHARD *shard, INT32U base, INT32U size,
+                             INT32U from) {
+  INT32U n = 0;
+  while (n < size) {
+    INT32U bit = base + ((from + n) & (size - 1));
+    INT32U avail = 64 - bit % 64;
+    if (avail > size - (bit - base))
+      avail = size - (bit - base);
+    INT64U word = shard->wheel_map[bit / 64] >> (bit % 64);
+    if (avail < 64)
+      word &= (1ULL << avail) - 1;
+    if (word != 0)
+      return n + __builtin_ctzll(word);
+    n += avail;
+  }
+  return -1;
+}
+
+/*
+  @ wheel_next_deadline().
+  - Find the next tick at which the timing wheel has work: the next occupied
+  level 0 slot, or the next cascade of an occupied higher level slot.
+  - Returns RTOS_FALSE if the wheel is empty. Caller holds the shard mutex.
+*/
+static INT8U wheel_next_deadline(TMR_SHARD *shard, INT32U *deadline) {
+  INT32U tick = shard->tick;
+  INT32U best = 0;
+  INT8U found = RTOS_FALSE;
+  INT32 dist = wheel_next_slot(shard, 0, RTOS_TMR_WHEEL_L0_SIZE,
+                               tick & (RTOS_TMR_WHEEL_L0_SIZE - 1));
+  if (dist >= 0) {
+    best = dist;
+    found = RTOS_TRUE;
+  }
+
+  // A higher level slot is due when the tick reaches its next cascade.
+  INT32U shift = RTOS_TMR_WHEEL_L0_BITS;
+  INT32U base = RTOS_TMR_WHEEL_L0_SIZE;
+  for (int level = 1; level < RTOS_TMR_WHEEL_LEVELS; level++) {
+    INT32U turn = (tick >> shift) + ((tick & ((1U << shift) - 1)) != 0);
+    dist = wheel_next_slot(shard, base, RTOS_TMR_WHEEL_LN_SIZE,
+                           turn & (RTOS_TMR_WHEEL_LN_SIZE - 1));
+    if (dist >= 0) {
+      INT32U cascade = ((turn + dist) << shift) - tick;
+      if (!found || cascade < best) {
+        best = cascade;
+        found = RTOS_TRUE;
+      }
+    }
+    shift += RTOS_TMR_WHEEL_LN_BITS;
+    base += RTOS_TMR_WHEEL_LN_SIZE;
+  }
+  *deadline = tick + best;
+  return found;
+}
+
+/*
+  @ wheel_busy_tick().
+  First tick in [match, match + slack] whose level 0 slot holds timers, found
+  in the occupancy bitmap. Returns RTOS_FALSE if there is none or match is
+  beyond level 0. Caller holds the shard mutex.
+*/
+static INT8U wheel_busy_tick(TMR_SHARD *shard, INT32U match, INT32U slack,
+                             INT32U *tick) {
+  INT32U delta = match - shard->tick;
+
+  if (delta >= RTOS_TMR_WHEEL_L0_SIZE) {
+    return RTOS_FALSE;
+  }
+  INT32 dist = wheel_next_slot(shard, 0, RTOS_TMR_WHEEL_L0_SIZE,
+                               match & (RTOS_TMR_WHEEL_L0_SIZE - 1));
+  if (dist < 0 || (INT32U)dist > slack ||
+      delta + dist >= RTOS_TMR_WHEEL_L0_SIZE) {
+    return RTOS_FALSE;
+  }
+  *tick = match + dist;
+  return RTOS_TRUE;
+}
+
+/*
+  @ cascade_wheel_slot().
+  Re-insert every timer of a higher level slot relative to the current tick,
+  which moves them one or more levels down. Tombstones are dropped instead.
+  Returns the number dropped. Caller holds the shard mutex.
+*/
+static INT32U cascade_wheel_slot(TMR_SHARD *shard, INT32U index) {
+  INT32U next = shard->wheel[index].list_id;
+  INT32U dropped = 0;
+
+  shard->wheel[index].list_id = RTOS_TMR_NO_ID;
+  shard->wheel[index].timer_count = 0;
+  shard->wheel_map[index / 64] &= ~(1ULL << (index % 64));
+  while (next != RTOS_TMR_NO_ID) {
+    RTOS_TMR *timer = wheel_timer(next);
+    next = timer->RTOSTmrNext;
+    timer->RTOSTmrSlot = RTOS_TMR_WHEEL_NO_SLOT;
+#if RTOS_CFG_TMR_LAZY_CANCEL_EN
+    if (__atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE) ==
+        RTOS_TMR_STATE_STOPPED) {
+      timer->RTOSTmrNext = RTOS_TMR_NO_ID;
+      timer->RTOSTmrPrev = RTOS_TMR_NO_ID;
+      dropped++;
+      continue;
+    }
+#endif
+    wheel_link(shard, timer);
+  }
+  return dropped;
+}
+
+/*
+  @ wheel_begin_tick().
+  Cascade the higher levels on every turn of the level below.
+*/
+static INT32U wheel_begin_tick(TMR_SHARD *shard) {
+  INT32U tick = shard->tick;
+  INT32U index = tick & (RTOS_TMR_WHEEL_L0_SIZE - 1);
+  INT32U shift = RTOS_TMR_WHEEL_L0_BITS;
+  INT32U base = RTOS_TMR_WHEEL_L0_SIZE;
+  INT32U dropped = 0;
+
+  for (int level = 1; index == 0 && level < RTOS_TMR_WHEEL_LEVELS; level++) {
+    index = (tick >> shift) & (RTOS_TMR_WHEEL_LN_SIZE - 1);
+    dropped += cascade_wheel_slot(shard, base + index);
+    shift += RTOS_TMR_WHEEL_LN_BITS;
+    base += RTOS_TMR_WHEEL_LN_SIZE;
+  }
+  return dropped;
+}
+
+/*
+  @ wheel_pop_expired().
+  Unlink the next timer of the level 0 slot of the current tick. A timer in
+  the slot that is due on a later turn of the wheel, or was restarted lazily
+  since it was linked, is moved on.
+*/
+static RTOS_TMR *wheel_pop_expired(TMR_SHARD *shard) {
+  WHEEL_SLOT *slot = &shard->wheel[shard->tick & (RTOS_TMR_WHEEL_L0_SIZE - 1)];
+  while (slot->list_id != RTOS_TMR_NO_ID) {
+    RTOS_TMR *timer = wheel_timer(slot->list_id);
+    wheel_unlink(shard, timer);
+    INT32U match = __atomic_load_n(&timer->RTOSTmrMatch, __ATOMIC_ACQUIRE);
+    if ((INT32)(shard->tick - match) >= 0) {
+      return timer;
+    }
+    wheel_link(shard, timer);
+  }
+  return NULL;
+}
+
+/*
+  @ compact_timer_wheel().
+  Unlink every tombstone of the wheel in one pass over the occupied slots, so
+  they do not pile up in slots the tick reaches only much later. Returns the
+  number unlinked. Caller holds the shard mutex.
+*/
+static INT32U compact_timer_wheel(TMR_SHARD *shard) {
+  INT32U dropped = 0;
+
+  for (INT32U word = 0; word < RTOS_TMR_WHEEL_SLOTS / 64; word++) {
+    INT64U bits = shard->wheel_map[word];
+    while (bits != 0) {
+      INT32U index = word * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      INT32U next = shard->wheel[index].list_id;
+      while (next != RTOS_TMR_NO_ID) {
+        RTOS_TMR *timer = wheel_timer(next);
+        next = timer->RTOSTmrNext;
+        if (__atomic_load_n(&timer->RTOSTmrState, __ATOMIC_ACQUIRE) ==
+            RTOS_TMR_STATE_STOPPED) {
+          wheel_unlink(shard, timer);
+          dropped++;
+        }
+      }
+    }
+  }
+  return dropped;
+}
+
+// Timing wheel store, see TMR_STORE_OPS.
+const TMR_STORE_OPS timer_wheel_store = {
+    .name = "wheel",
+    .lazy_rearm = RTOS_TRUE,
+    .init = init_timer_wheel,
+    .destroy = destroy_timer_wheel,
+    .insert = wheel_link,
+    .remove = wheel_unlink,
+    .begin_tick = wheel_begin_tick,
+    .pop_expired = wheel_pop_expired,
+    .next_deadline = wheel_next_deadline,
+    .busy_tick = wheel_busy_tick,
+    .compact = compact_timer_wheel,
+};
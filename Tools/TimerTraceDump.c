@@ -0,0 +1,83 @@
+/*
+  - Decoder of the trace files written by RTOSTmrTraceStart().
+  - Prints one line per event: tick, time of the tick in ms, thread, shard,
+  event, timer id and argument (Delay for create and start, the deadline
+  for an expiry, the events lost for a drop), then the count of every event.
+  With -s only the counts.
+
+  Usage: TimerTraceDump [-s] trace_file
+*/
+
+// Include header files.
+#include "TimerMgrHeader.h"
+#include "TypeDefines.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_EVENT_KINDS (RTOS_TMR_TRACE_DROP + 1)
+
+static const char *event_name[TRACE_EVENT_KINDS] = {
+    "?", "create", "start", "stop", "delete", "expire", "drop"};
+
+int main(int argc, char **argv) {
+  RTOS_TMR_TRACE_HEADER header;
+  RTOS_TMR_TRACE_EVENT e;
+  INT64U count[TRACE_EVENT_KINDS] = {0};
+  INT64U lost = 0;
+  INT32U summary = 0;
+  FILE *file;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s")) != -1) {
+    if (opt == 's') {
+      summary = 1;
+    } else {
+      optind = argc;
+      break;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-s] trace_file\n", argv[0]);
+    return 1;
+  }
+  file = fopen(argv[optind], "rb");
+  if (file == NULL) {
+    fprintf(stderr, "\nCannot open %s\n", argv[optind]);
+    return 1;
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, RTOS_TMR_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != RTOS_TMR_TRACE_VERSION ||
+      header.event_size != sizeof(RTOS_TMR_TRACE_EVENT)) {
+    fprintf(stderr, "\n%s is not a version %d timer trace\n", argv[optind],
+            RTOS_TMR_TRACE_VERSION);
+    fclose(file);
+    return 1;
+  }
+
+  if (!summary) {
+    printf("tick,ms,thread,shard,event,id,arg\n");
+  }
+  while (fread(&e, sizeof(e), 1, file) == 1) {
+    INT32U kind = e.event < TRACE_EVENT_KINDS ? e.event : 0;
+    count[kind]++;
+    if (kind == RTOS_TMR_TRACE_DROP) {
+      lost += e.arg;
+    }
+    if (!summary) {
+      printf("%u,%llu,%u,%u,%s,%u,%u\n", e.tick,
+             (unsigned long long)e.tick * header.tick_ns / 1000000, e.thread,
+             e.shard, event_name[kind], e.id, e.arg);
+    }
+  }
+  fclose(file);
+
+  fprintf(summary ? stdout : stderr, "\n");
+  for (INT32U i = 1; i < TRACE_EVENT_KINDS; i++) {
+    fprintf(summary ? stdout : stderr, "%-7s %llu\n", event_name[i],
+            (unsigned long long)count[i]);
+  }
+  fprintf(summary ? stdout : stderr, "lost    %llu\n", (unsigned long long)lost);
+  return 0;
+}